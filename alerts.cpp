@@ -0,0 +1,123 @@
+#include "alerts.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace alerts {
+
+const char* Rule::channelName(Channel channel) {
+    switch (channel) {
+        case Channel::Pressure: return "pressure";
+        case Channel::Temperature: return "temperature";
+        case Channel::Velocity: return "velocity";
+    }
+    return "pressure";
+}
+
+Channel Rule::channelByName(const std::string& name) {
+    if (name == "pressure") return Channel::Pressure;
+    if (name == "temperature") return Channel::Temperature;
+    if (name == "velocity") return Channel::Velocity;
+    throw std::invalid_argument("unknown channel '" + name + "' (pressure, temperature, velocity)");
+}
+
+Engine::Engine(std::vector<Rule> rules, size_t ring_size)
+    : rules_(std::move(rules)), states_(new State[rules_.size()]), ring_(std::max<size_t>(ring_size, 1)) {}
+
+void Engine::evaluate(int64_t mono_ns, int64_t wall_ms, float pressure, float temperature, float velocity) {
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < rules_.size(); i++) {
+        const Rule& rule = rules_[i];
+        State& state = states_[i];
+        double value = rule.channel == Channel::Pressure ? pressure
+                     : rule.channel == Channel::Temperature ? temperature : velocity;
+        if (rule.kind == Kind::Rate) {
+            if (!state.has_reference) {
+                state.has_reference = true;
+                state.reference_ns = mono_ns;
+                state.reference_value = value;
+                continue;
+            }
+            const int64_t elapsed_ns = mono_ns - state.reference_ns;
+            if (elapsed_ns <= 0 || elapsed_ns < rule.window_ms * 1000000) continue;
+            const double rate = (value - state.reference_value) * 1e9 / static_cast<double>(elapsed_ns);
+            state.reference_ns = mono_ns;
+            state.reference_value = value;
+            value = rate;
+        }
+
+        const bool active = state.active.load(std::memory_order_relaxed);
+        const bool crossed = rule.op == Op::Above ? value > rule.threshold : value < rule.threshold;
+        const bool back = rule.op == Op::Above ? value < rule.threshold - rule.hysteresis
+                                               : value > rule.threshold + rule.hysteresis;
+        if (!active && crossed) {
+            state.active.store(true, std::memory_order_relaxed);
+            active_.fetch_add(1, std::memory_order_relaxed);
+            emit(static_cast<uint32_t>(i), wall_ms, true, value);
+        } else if (active && back) {
+            state.active.store(false, std::memory_order_relaxed);
+            active_.fetch_sub(1, std::memory_order_relaxed);
+            emit(static_cast<uint32_t>(i), wall_ms, false, value);
+        }
+    }
+}
+
+void Engine::emit(uint32_t rule, int64_t wall_ms, bool raised, double value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Event& event = ring_[(last_seq_ + 1) % ring_.size()];
+        event.seq = ++last_seq_;
+        event.wall_ms = wall_ms;
+        event.rule = rule;
+        event.raised = raised;
+        event.value = value;
+    }
+    cv_.notify_all();
+}
+
+std::vector<Event> Engine::eventsAfter(uint64_t after, size_t max) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Only the last ring_.size() events are still there
+    uint64_t first = std::max<uint64_t>(after + 1, last_seq_ >= ring_.size() ? last_seq_ - ring_.size() + 1 : 1);
+    std::vector<Event> events;
+    for (uint64_t seq = first; seq <= last_seq_ && events.size() < max; seq++) {
+        events.push_back(ring_[seq % ring_.size()]);
+    }
+    return events;
+}
+
+bool Engine::waitForEvents(uint64_t after, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, timeout, [&] { return closed_ || last_seq_ > after; });
+    return last_seq_ > after;
+}
+
+void Engine::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+bool Engine::closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+const std::vector<Rule>& Engine::rules() const { return rules_; }
+
+bool Engine::active(size_t rule) const {
+    return states_[rule].active.load(std::memory_order_relaxed);
+}
+
+Engine::Stats Engine::getStats() const {
+    Stats stats;
+    stats.samples = samples_.load(std::memory_order_relaxed);
+    stats.active = active_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.events = last_seq_;
+    stats.overwritten = last_seq_ > ring_.size() ? last_seq_ - ring_.size() : 0;
+    return stats;
+}
+
+} // namespace alerts
@@ -0,0 +1,97 @@
+#ifndef ALERTS_HPP
+#define ALERTS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Alert rules evaluated on every parsed sample, in the serial reader loop:
+//   Threshold - the value crosses `threshold` (op Above: >, Below: <)
+//   Rate      - the change per second over `window_ms` crosses `threshold`. Windows are tumbling:
+//               the rate is taken once the window is over, then the next one starts at that sample
+// A rule is raised when it crosses and cleared once it's back by `hysteresis` (Above: below
+// threshold - hysteresis), so a value that hovers at the threshold raises it once. Both transitions
+// are events in a ring of fixed size - readers that fall more than the ring behind lose the oldest.
+// evaluate() doesn't allocate and only takes the ring's lock when there is an event
+namespace alerts {
+
+enum class Channel { Pressure, Temperature, Velocity };
+enum class Kind { Threshold, Rate };
+enum class Op { Above, Below };
+
+struct Rule {
+    std::string name;
+    Channel channel = Channel::Pressure;
+    Kind kind = Kind::Threshold;
+    Op op = Op::Above;
+    double threshold = 0;
+    double hysteresis = 0;                           // >= 0
+    int64_t window_ms = 1000;                        // Rate only, 0 = from one sample to the next
+
+    static const char* channelName(Channel channel);
+    static Channel channelByName(const std::string& name);   // Throws std::invalid_argument
+};
+
+struct Event {
+    uint64_t seq = 0;                                // From 1 on, one per event
+    int64_t wall_ms = 0;                             // Time of the sample
+    uint32_t rule = 0;                               // Index into rules()
+    bool raised = false;                             // False: cleared
+    double value = 0;                                // Value or rate that crossed
+};
+
+class Engine {
+public:
+    struct Stats {
+        uint64_t samples = 0;
+        uint64_t events = 0;                         // Last event sequence
+        uint64_t overwritten = 0;                    // Events no longer in the ring
+        size_t active = 0;                           // Rules raised now
+    };
+
+    explicit Engine(std::vector<Rule> rules = {}, size_t ring_size = 1024);
+
+    // One sample, serial reader thread only. mono_ns is for rates, wall_ms goes into the events
+    void evaluate(int64_t mono_ns, int64_t wall_ms, float pressure, float temperature, float velocity);
+    // Events with seq > after, oldest first, at most max
+    std::vector<Event> eventsAfter(uint64_t after, size_t max) const;
+    // Until there is an event with seq > after, the timeout ran out or close() was called. True if there is one
+    bool waitForEvents(uint64_t after, std::chrono::milliseconds timeout) const;
+    void close();                                    // Wakes and ends every waiter, for the shutdown
+    bool closed() const;
+
+    const std::vector<Rule>& rules() const;
+    bool active(size_t rule) const;
+    Stats getStats() const;
+
+private:
+    struct State {
+        std::atomic<bool> active{false};
+        bool has_reference = false;                  // Rate: start of the current window
+        int64_t reference_ns = 0;
+        double reference_value = 0;
+    };
+
+    std::vector<Rule> rules_;
+    std::unique_ptr<State[]> states_;
+    std::atomic<uint64_t> samples_{0};
+    std::atomic<size_t> active_{0};
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    std::vector<Event> ring_;                        // Event seq goes to ring_[seq % size]
+    uint64_t last_seq_ = 0;
+    bool closed_ = false;
+
+    void emit(uint32_t rule, int64_t wall_ms, bool raised, double value);
+};
+
+} // namespace alerts
+
+#endif // ALERTS_HPP
@@ -0,0 +1,187 @@
+// bench_ingest - drives the real server binary through a PTY with synthetic sensor frames and
+// reports how much of it ends up in the database, how fast, and how late.
+//
+// Usage: ./bench_ingest [--server=./server] [--rate=2000] [--duration=10] [--burst=1]
+//                       [--malformed=0.0] [--http-port=7190] [--db=bench_ingest.db] [--json]
+//   --rate       frames per second on average, 0 = as fast as the PTY accepts
+//   --burst      frames written back to back per tick (rate stays the same, ticks get sparser)
+//   --malformed  share of frames that don't parse, e.g. 0.05
+//   --json       print the summary as one JSON line instead of text (for comparing runs)
+//
+// End-to-end latency is measured from writing a frame to the PTY until GET /metrics reports it
+// stored in SQLite, so it includes the serial reader, the journal and the writer's commit.
+// /metrics is polled every 2 ms - that's also the resolution of the numbers.
+
+#include "bench_util.hpp"
+#include "nlohmann/json.hpp"
+#include <random>
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+
+struct MetricsSample {
+    std::chrono::steady_clock::time_point at;
+    uint64_t stored;
+};
+
+static std::pair<uint64_t, nlohmann::json> fetchStored(httplib::Client& client) {
+    auto res = client.Get("/metrics");
+    if (!res || res->status != 200) return {UINT64_MAX, nullptr};
+    auto json = nlohmann::json::parse(res->body);
+    return {json["storage"]["samples_stored"].get<uint64_t>(), json};
+}
+
+int main(int argc, char* argv[]) {
+    auto args = bench::parseArgs(argc, argv);
+    const std::string server_binary = bench::argOr(args, "server", "./server");
+    const double rate = std::stod(bench::argOr(args, "rate", "2000"));
+    const double duration_s = std::stod(bench::argOr(args, "duration", "10"));
+    const int burst = std::max(1, std::stoi(bench::argOr(args, "burst", "1")));
+    const double malformed_ratio = std::stod(bench::argOr(args, "malformed", "0"));
+    const int http_port = std::stoi(bench::argOr(args, "http-port", "7190"));
+    // Absolute, the server only accepts database paths with a directory part
+    const std::string db_path = std::filesystem::absolute(bench::argOr(args, "db", "bench_ingest.db")).string();
+    const bool json_output = args.count("json") > 0;
+
+    // Fresh database and journal every run, so runs are comparable
+    std::filesystem::remove(db_path);
+    std::filesystem::remove_all(db_path + ".frames");
+
+    bench::PtyPair pty = bench::createPtyPair();
+    pid_t pid = bench::spawnServer(server_binary, pty, http_port, db_path);
+    if (!bench::waitForServer("localhost", http_port, std::chrono::seconds(10))) {
+        std::cerr << "Server didn't come up on port " << http_port << "\n";
+        bench::stopServer(pid);
+        return 1;
+    }
+    if (!bench::startReading(pty.master_fd, "localhost", http_port)) {
+        std::cerr << "GET /start failed\n";
+        bench::stopServer(pid);
+        return 1;
+    }
+
+    const uint64_t total_frames = rate > 0 ? static_cast<uint64_t>(rate * duration_s) : UINT64_MAX;
+    std::vector<std::chrono::steady_clock::time_point> sent_at;  // Per valid frame, in order
+    sent_at.reserve(rate > 0 ? total_frames : 1 << 20);
+    std::atomic<uint64_t> valid_sent{0};
+    std::atomic<bool> sending{true};
+
+    // Poller - records when each stored count was first seen. After sending stops it waits
+    // for the rest, giving up after 5 s without progress (= lost frames)
+    std::vector<MetricsSample> samples;
+    std::thread poller([&] {
+        httplib::Client client("localhost", http_port);
+        client.set_keep_alive(true);
+        auto last_progress = std::chrono::steady_clock::now();
+        while (true) {
+            auto [stored, json] = fetchStored(client);
+            auto now = std::chrono::steady_clock::now();
+            if (stored != UINT64_MAX && (samples.empty() || stored != samples.back().stored)) {
+                samples.push_back({now, stored});
+                last_progress = now;
+            }
+            if (!sending.load()) {
+                if (stored != UINT64_MAX && stored >= valid_sent.load()) break;
+                if (now - last_progress > std::chrono::seconds(5)) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    uint64_t sent = 0, malformed = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(duration_s));
+    auto tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(rate > 0 ? burst / rate : 0.0));
+    auto next_tick = start;
+    char frame[96];
+
+    while (sent < total_frames && std::chrono::steady_clock::now() < deadline) {
+        if (rate > 0) {
+            std::this_thread::sleep_until(next_tick);
+            next_tick += tick;
+        }
+        for (int i = 0; i < burst && sent < total_frames; i++, sent++) {
+            int len;
+            bool bad = unit(rng) < malformed_ratio;
+            if (bad) {
+                len = snprintf(frame, sizeof(frame), "$%.2f,%.2f\n", 100 * unit(rng), 20 + unit(rng));
+                malformed++;
+            } else {
+                double t = static_cast<double>(sent) / 1000.0;
+                len = snprintf(frame, sizeof(frame), "$%.2f,%.2f,%.2f\n",
+                               1013.0 + 5.0 * std::sin(t), 21.5 + 0.5 * std::sin(t / 10.0), 3.0 + unit(rng));
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (!bench::writeAll(pty.master_fd, frame, static_cast<size_t>(len))) {
+                std::cerr << "Write to PTY failed: " << strerror(errno) << "\n";
+                sent = total_frames;
+                break;
+            }
+            if (!bad) {
+                sent_at.push_back(now);
+                valid_sent++;
+            }
+        }
+    }
+    auto send_end = std::chrono::steady_clock::now();
+    sending = false;
+    poller.join();
+
+    httplib::Client client("localhost", http_port);
+    auto [stored, metrics] = fetchStored(client);
+    bench::stopServer(pid);
+    close(pty.master_fd);
+
+    // Latency of frame i = first time the stored count reached i + 1
+    std::vector<double> latencies_ms;
+    latencies_ms.reserve(sent_at.size());
+    uint64_t previous = 0;
+    for (const auto& sample : samples) {
+        for (uint64_t i = previous; i < std::min<uint64_t>(sample.stored, sent_at.size()); i++) {
+            latencies_ms.push_back(std::chrono::duration<double, std::milli>(sample.at - sent_at[i]).count());
+        }
+        previous = std::max(previous, sample.stored);
+    }
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+
+    const uint64_t valid = sent - malformed;
+    const uint64_t stored_count = stored == UINT64_MAX ? previous : stored;
+    const double send_s = std::chrono::duration<double>(send_end - start).count();
+    const double ingest_s = samples.empty() ? send_s : std::chrono::duration<double>(samples.back().at - start).count();
+
+    nlohmann::json summary = {
+        {"rate_target", rate},
+        {"burst", burst},
+        {"malformed_ratio", malformed_ratio},
+        {"sent", sent},
+        {"malformed", malformed},
+        {"send_rate", sent / send_s},
+        {"stored", stored_count},
+        {"lost", valid > stored_count ? valid - stored_count : 0},
+        {"ingest_rate", stored_count / ingest_s},
+        {"parse_errors", metrics.is_null() ? nlohmann::json(nullptr) : metrics["ingest"]["parse_errors"]},
+        {"latency_ms", {
+            {"p50", bench::percentile(latencies_ms, 50)},
+            {"p99", bench::percentile(latencies_ms, 99)},
+            {"p999", bench::percentile(latencies_ms, 99.9)},
+            {"max", latencies_ms.empty() ? 0.0 : latencies_ms.back()}
+        }}
+    };
+
+    if (json_output) {
+        std::cout << summary.dump() << "\n";
+    } else {
+        std::cout << "Sent:          " << sent << " frames (" << malformed << " malformed) in "
+                  << send_s << " s, " << summary["send_rate"].get<double>() << " frames/s\n";
+        std::cout << "Stored:        " << stored_count << ", lost " << summary["lost"] << "\n";
+        std::cout << "Ingest rate:   " << summary["ingest_rate"].get<double>() << " samples/s sustained\n";
+        std::cout << "Parse errors:  " << summary["parse_errors"] << "\n";
+        std::cout << "Latency (ms):  p50 " << summary["latency_ms"]["p50"] << ", p99 " << summary["latency_ms"]["p99"]
+                  << ", p99.9 " << summary["latency_ms"]["p999"] << ", max " << summary["latency_ms"]["max"] << "\n";
+    }
+    return summary["lost"].get<uint64_t>() == 0 ? 0 : 2;
+}
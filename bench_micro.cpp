@@ -0,0 +1,506 @@
+// bench - microbenchmarks of the ingest and serving hot paths (Google Benchmark).
+//
+// Every benchmark takes a size argument, so it shows how a stage scales, and reports items/s.
+// Compare runs across commits with the JSON output, e.g.:
+//   ./bench --benchmark_out=bench.json --benchmark_out_format=json
+//   ./bench --benchmark_filter=ExtractFrames
+// The database benchmarks work on temporary files under $TMPDIR/serial_server_bench, or under
+// $BENCH_DB_DIR - point it at the SD card / eMMC of the target to compare the database profiles:
+//   BENCH_DB_DIR=/mnt/sdcard/bench ./bench --benchmark_filter=Profile
+
+#include "server_api.hpp"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+
+uint8_t bench_frequency = 115;
+bool bench_debug = false;
+ConfigStore bench_config(DeviceConfig{bench_frequency, bench_debug});
+const std::string bench_port = "/dev/ttyBENCH";
+
+std::string sensorFrame(std::mt19937& rng) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    char frame[64];
+    int len = snprintf(frame, sizeof(frame), "$%.2f,%.2f,%.2f\n",
+                       1000.0f + 30.0f * unit(rng), 15.0f + 10.0f * unit(rng), 5.0f * unit(rng));
+    return std::string(frame, len);
+}
+
+const char* const profile_names[] = {"durable", "balanced", "throughput"};
+
+fs::path benchDirectory() {
+    const char* env_dir = std::getenv("BENCH_DB_DIR");
+    fs::path dir = env_dir ? fs::absolute(env_dir) : fs::temp_directory_path() / "serial_server_bench";
+    fs::create_directories(dir);
+    return dir;
+}
+
+// Fresh database file per benchmark run
+std::unique_ptr<DatabaseManager> freshDatabase(const std::string& name,
+                                               const DatabaseProfile& profile = DatabaseProfile()) {
+    fs::path path = benchDirectory() / name;
+    for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+        fs::remove(path.string() + suffix);
+    }
+    return std::make_unique<DatabaseManager>(path.string(), bench_port, bench_config, profile);
+}
+
+std::vector<FrameJournal::Record> journalRecords(size_t count, uint64_t first_seq, int64_t first_second) {
+    std::mt19937 rng(7);
+    std::vector<FrameJournal::Record> records(count);
+    for (size_t i = 0; i < count; i++) {
+        auto& record = records[i];
+        record.seq = first_seq + i;
+        record.wall_s = first_second + static_cast<int64_t>(i / 1000);  // 1 kHz device
+        record.frequency = bench_frequency;
+        record.debug = bench_debug;
+        record.pressure = fp16::fromFloat(std::uniform_real_distribution<float>(0.0f, 100.0f)(rng));
+        record.temperature = record.pressure;
+        record.velocity = record.pressure;
+    }
+    return records;
+}
+
+// What the device sends: 1 kHz, whole-second timestamps, slowly changing values printed with two
+// decimals (as DeviceSimulator does) - the data the chunk codec is made for
+std::vector<FrameJournal::Record> sensorRecords(size_t count, int64_t first_second) {
+    std::mt19937 rng(8);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::vector<FrameJournal::Record> records(count);
+    for (size_t i = 0; i < count; i++) {
+        double t = i / 1000.0;
+        auto& record = records[i];
+        record.seq = i + 1;
+        record.wall_s = first_second + static_cast<int64_t>(i / 1000);
+        record.frequency = bench_frequency;
+        record.debug = bench_debug;
+        auto value = [](double v) { return fp16::fromFloat(static_cast<float>(std::round(v * 100.0) / 100.0)); };
+        record.pressure = value(1013.25 + 2.5 * std::sin(6.283185 * 0.2 * t) + 0.05 * noise(rng));
+        record.temperature = value(21.5 + 0.8 * std::sin(6.283185 * t / 300.0) + 0.02 * noise(rng));
+        record.velocity = value(3.0 + 1.5 * std::sin(6.283185 * 1.3 * t) + 0.1 * noise(rng));
+    }
+    return records;
+}
+
+std::vector<chunk::Sample> chunkSamples(size_t count) {
+    std::vector<chunk::Sample> samples;
+    for (const auto& record : sensorRecords(count, 1700000000)) {
+        samples.push_back({record.wall_s, record.pressure, record.temperature, record.velocity});
+    }
+    return samples;
+}
+
+// Pages in use, without the free ones left behind by deletes
+int64_t usedBytes(const fs::path& path) {
+    sqlite3* db;
+    sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+    int64_t pages = 0, free_pages = 0, page_size = 0;
+    for (auto [pragma, value] : {std::pair<const char*, int64_t*>{"PRAGMA page_count;", &pages},
+                                 {"PRAGMA freelist_count;", &free_pages}, {"PRAGMA page_size;", &page_size}}) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, pragma, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            *value = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return (pages - free_pages) * page_size;
+}
+
+} // namespace
+
+// parseMessage() on `range(0)` sensor frames
+static void BM_ParseMessage(benchmark::State& state) {
+    std::mt19937 rng(1);
+    std::vector<std::string> messages;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        std::string frame = sensorFrame(rng);
+        messages.push_back(frame.substr(1, frame.size() - 2));  // Without '$' and '\n'
+    }
+    for (auto _ : state) {
+        for (const auto& message : messages) {
+            float pressure, temperature, velocity;
+            benchmark::DoNotOptimize(parseMessage(message, pressure, temperature, velocity));
+            benchmark::DoNotOptimize(velocity);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseMessage)->RangeMultiplier(8)->Range(1, 4096);
+
+// Framing of the serial reader: `range(0)` frames with a little noise between them, delivered in
+// reads of `range(1)` bytes as read() would return them
+static void BM_ExtractFrames(benchmark::State& state) {
+    std::mt19937 rng(2);
+    std::string stream;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        if (i % 16 == 0) stream += "noise";
+        stream += sensorFrame(rng);
+    }
+    const size_t chunk = static_cast<size_t>(state.range(1));
+    std::string data;
+    std::vector<std::string> frames;
+    for (auto _ : state) {
+        size_t count = 0;
+        for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+            data.append(stream, pos, chunk);
+            frames.clear();
+            benchmark::DoNotOptimize(extractFrames(data, frames));
+            count += frames.size();
+        }
+        benchmark::DoNotOptimize(count);
+        data.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(stream.size()));
+}
+BENCHMARK(BM_ExtractFrames)->ArgsProduct({{16, 256, 4096}, {32, 255, 4096}});
+
+// fp32 -> fp16 of `range(0)` values: batch (NEON / F16C), one at a time, and the scalar fallback
+static std::vector<float> randomFloats(size_t count) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> values(-1000.0f, 1000.0f);
+    std::vector<float> input(count);
+    for (auto& value : input) value = values(rng);
+    return input;
+}
+
+static void BM_Fp32ToFp16Batch(benchmark::State& state) {
+    auto input = randomFloats(state.range(0));
+    std::vector<uint16_t> output(input.size());
+    for (auto _ : state) {
+        fp16::fromFloat(input.data(), output.data(), input.size());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(fp16::implementation());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Fp32ToFp16Batch)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void BM_Fp32ToFp16Single(benchmark::State& state) {
+    auto input = randomFloats(state.range(0));
+    std::vector<uint16_t> output(input.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < input.size(); i++) {
+            output[i] = fp16::fromFloat(input[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Fp32ToFp16Single)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void BM_Fp32ToFp16Scalar(benchmark::State& state) {
+    auto input = randomFloats(state.range(0));
+    std::vector<uint16_t> output(input.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < input.size(); i++) {
+            output[i] = fp16::fromFloatScalar(input[i]);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Fp32ToFp16Scalar)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+// fp16 -> fp32, as done for every value in a /messages response
+static void BM_Fp16ToFp32Batch(benchmark::State& state) {
+    auto floats = randomFloats(state.range(0));
+    std::vector<uint16_t> input(floats.size());
+    fp16::fromFloat(floats.data(), input.data(), floats.size());
+    for (auto _ : state) {
+        fp16::toFloat(input.data(), floats.data(), input.size());
+        benchmark::DoNotOptimize(floats.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(fp16::implementation());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Fp16ToFp32Batch)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void BM_Fp16ToFp32Scalar(benchmark::State& state) {
+    auto floats = randomFloats(state.range(0));
+    std::vector<uint16_t> input(floats.size());
+    fp16::fromFloat(floats.data(), input.data(), floats.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < input.size(); i++) {
+            floats[i] = fp16::toFloatScalar(input[i]);
+        }
+        benchmark::DoNotOptimize(floats.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Fp16ToFp32Scalar)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+// storeSensorData(): `range(0)` single-row inserts, each its own (autocommit) transaction
+static void BM_StoreSensorData(benchmark::State& state) {
+    auto db = freshDatabase("store_sensor_data.db");
+    DatabaseManager::SensorData data{fp16::fromFloat(1013.25f), fp16::fromFloat(21.5f),
+                                     fp16::fromFloat(3.25f), 1700000000};
+    for (auto _ : state) {
+        for (int64_t i = 0; i < state.range(0); i++) {
+            data.timestamp++;
+            if (!db->storeSensorData(data)) {
+                state.SkipWithError("storeSensorData failed");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StoreSensorData)->RangeMultiplier(4)->Range(1, 64)->Unit(benchmark::kMicrosecond);
+
+// storeJournalRecords(): one transaction of `range(0)` records, as the journal writer does it
+static void BM_StoreJournalBatch(benchmark::State& state) {
+    auto db = freshDatabase("store_journal_batch.db");
+    uint64_t seq = 1;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto records = journalRecords(state.range(0), seq, 1700000000 + static_cast<int64_t>(seq / 1000));
+        seq += records.size();
+        state.ResumeTiming();
+        if (!db->storeJournalRecords(records)) {
+            state.SkipWithError("storeJournalRecords failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StoreJournalBatch)->RangeMultiplier(8)->Range(1, 4096)->Unit(benchmark::kMicrosecond);
+
+// getLastNMessages(range(0)) on a table with 200k rows
+static void BM_GetLastNMessages(benchmark::State& state) {
+    static std::unique_ptr<DatabaseManager> db;
+    if (!db) {
+        db = freshDatabase("get_last_n_messages.db");
+        db->storeJournalRecords(journalRecords(200000, 1, 1700000000));
+    }
+    for (auto _ : state) {
+        auto messages = db->getLastNMessages(static_cast<int>(state.range(0)));
+        benchmark::DoNotOptimize(messages.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetLastNMessages)->RangeMultiplier(8)->Range(1, 32768)->Unit(benchmark::kMicrosecond);
+
+// Ingest under each database profile (range(0) indexes profile_names): journal writer batches of
+// `range(1)` records. Batch size 1 is the worst case - a commit, and for 'durable' an fsync, per frame
+static void BM_ProfileIngest(benchmark::State& state) {
+    DatabaseProfile profile = DatabaseProfile::byName(profile_names[state.range(0)]);
+    auto db = freshDatabase("profile_ingest_" + profile.name + ".db", profile);
+    uint64_t seq = 1;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto records = journalRecords(state.range(1), seq, 1700000000 + static_cast<int64_t>(seq / 1000));
+        seq += records.size();
+        state.ResumeTiming();
+        if (!db->storeJournalRecords(records)) {
+            state.SkipWithError("storeJournalRecords failed");
+            return;
+        }
+    }
+    state.SetLabel(profile.name + "/" + db->getProfile().journal_mode);
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_ProfileIngest)->ArgsProduct({{0, 1, 2}, {1, 64, 512}})->Unit(benchmark::kMicrosecond);
+
+// Query under each database profile: getLastNMessages(range(1)) on 200k rows. The first
+// iterations pay for reading the file; after that cache_size / mmap_size decide what is re-read
+static void BM_ProfileQuery(benchmark::State& state) {
+    static std::unique_ptr<DatabaseManager> dbs[3];
+    DatabaseProfile profile = DatabaseProfile::byName(profile_names[state.range(0)]);
+    auto& db = dbs[state.range(0)];
+    if (!db) {
+        db = freshDatabase("profile_query_" + profile.name + ".db", profile);
+        db->storeJournalRecords(journalRecords(200000, 1, 1700000000));
+    }
+    for (auto _ : state) {
+        auto messages = db->getLastNMessages(static_cast<int>(state.range(1)));
+        benchmark::DoNotOptimize(messages.data());
+    }
+    state.SetLabel(profile.name);
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_ProfileQuery)->ArgsProduct({{0, 1, 2}, {100, 10000}})->Unit(benchmark::kMicrosecond);
+
+// chunk::encode() of `range(0)` samples. bytes_per_sample vs 6 bytes of raw fp16 values + the
+// timestamp - BM_LayoutQuery has what the row layout really costs in SQLite
+static void BM_ChunkEncode(benchmark::State& state) {
+    auto samples = chunkSamples(state.range(0));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        auto data = chunk::encode(samples.data(), samples.size());
+        bytes = data.size();
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.counters["bytes_per_sample"] = static_cast<double>(bytes) / samples.size();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ChunkEncode)->RangeMultiplier(4)->Range(256, 16384)->Unit(benchmark::kMicrosecond);
+
+static void BM_ChunkDecode(benchmark::State& state) {
+    auto samples = chunkSamples(state.range(0));
+    auto data = chunk::encode(samples.data(), samples.size());
+    std::vector<chunk::Sample> decoded;
+    decoded.reserve(samples.size());
+    for (auto _ : state) {
+        decoded.clear();
+        benchmark::DoNotOptimize(chunk::decode(data.data(), data.size(), decoded));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_ChunkDecode)->RangeMultiplier(4)->Range(256, 16384)->Unit(benchmark::kMicrosecond);
+
+// getLastNMessages(range(1)) on 200k samples stored one row per sample (range(0) = 0) or sealed
+// into chunks of 4096 (range(0) = 1). bytes_per_sample is the database size incl. indexes
+static void BM_LayoutQuery(benchmark::State& state) {
+    static std::unique_ptr<DatabaseManager> dbs[2];
+    static double bytes_per_sample[2];
+    const bool sealed = state.range(0) == 1;
+    auto& db = dbs[state.range(0)];
+    if (!db) {
+        const std::string name = sealed ? "layout_chunks.db" : "layout_rows.db";
+        db = freshDatabase(name);
+        const size_t count = 200000;
+        db->storeJournalRecords(sensorRecords(count, 1700000000));
+        if (sealed) {
+            db->sealChunks(std::numeric_limits<int64_t>::max(), 4096);
+        }
+        bytes_per_sample[state.range(0)] = static_cast<double>(usedBytes(benchDirectory() / name)) / count;
+    }
+    for (auto _ : state) {
+        auto messages = db->getLastNMessages(static_cast<int>(state.range(1)));
+        benchmark::DoNotOptimize(messages.data());
+    }
+    state.SetLabel(sealed ? "chunks" : "rows");
+    state.counters["bytes_per_sample"] = bytes_per_sample[state.range(0)];
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_LayoutQuery)->ArgsProduct({{0, 1}, {100, 10000, 100000}})->Unit(benchmark::kMicrosecond);
+
+// GET /messages body: messagesToJson() + dump() of `range(0)` messages
+static void BM_MessagesToJson(benchmark::State& state) {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> values(0.0f, 100.0f);
+    std::vector<DatabaseManager::SensorData> messages(state.range(0));
+    int64_t timestamp = 1700000000;
+    for (auto& msg : messages) {
+        msg = {fp16::fromFloat(values(rng)), fp16::fromFloat(values(rng)),
+               fp16::fromFloat(values(rng)), timestamp++};
+    }
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::string body = messagesToJson(messages).dump();
+        bytes += body.size();
+        benchmark::DoNotOptimize(body.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_MessagesToJson)->RangeMultiplier(8)->Range(1, 32768)->Unit(benchmark::kMicrosecond);
+
+// gzip of a GET /messages body of 100k samples (~7 MB) in 256 KiB chunks on range(0) threads.
+// ratio is compressed / plain size
+static void BM_GzipResponse(benchmark::State& state) {
+    static std::string body;
+    if (body.empty()) {
+        auto records = sensorRecords(100000, 1700000000);
+        std::vector<DatabaseManager::SensorData> messages;
+        for (const auto& record : records) {
+            messages.push_back({record.pressure, record.temperature, record.velocity, record.wall_s});
+        }
+        body = messagesToJson(messages).dump();
+    }
+    size_t compressed = 0;
+    for (auto _ : state) {
+        std::string data = compression::gzip(body.data(), body.size(), 6, 256 * 1024,
+                                             static_cast<size_t>(state.range(0)));
+        compressed = data.size();
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.counters["ratio"] = static_cast<double>(compressed) / body.size();
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_GzipResponse)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// GET /stats over the last range(0) minutes of a day of sensor data at 20 samples/s: merging the
+// minute / hour summaries and the JSON of them. memory_bytes is what the day of summaries takes
+static void BM_StatsQuery(benchmark::State& state) {
+    static std::unique_ptr<sketch::TimeWindows> windows;
+    if (!windows) {
+        windows = std::make_unique<sketch::TimeWindows>(1440, 720, 0.01);
+        auto records = sensorRecords(86400 * 20, 1700000000);
+        for (size_t i = 0; i < records.size(); i++) {
+            windows->add(1700000000 + static_cast<int64_t>(i / 20), fp16::toFloat(records[i].pressure),
+                         fp16::toFloat(records[i].temperature), fp16::toFloat(records[i].velocity));
+        }
+    }
+    const int64_t to = 1700000000 + 86400 - 1;
+    const std::vector<double> quantiles = {0.5, 0.9, 0.95, 0.99};
+    for (auto _ : state) {
+        auto result = windows->query(to - state.range(0) * 60 + 1, to);
+        nlohmann::json json;
+        for (const auto& field : result.fields) json.push_back(summaryToJson(field, quantiles, 10));
+        benchmark::DoNotOptimize(json);
+    }
+    state.counters["memory_bytes"] = static_cast<double>(windows->memoryBytes());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StatsQuery)->Arg(1)->Arg(60)->Arg(1440)->Unit(benchmark::kMicrosecond);
+
+// Alert rules evaluated per sample, range(0) of them: thresholds and 1 s rates alternating over the
+// three channels, at 20 samples/s of simulated time. Nothing crosses - the cost of every sample
+static void BM_AlertEvaluate(benchmark::State& state) {
+    std::vector<alerts::Rule> rules;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        alerts::Rule rule;
+        rule.name = "rule" + std::to_string(i);
+        rule.channel = static_cast<alerts::Channel>(i % 3);
+        rule.kind = i % 2 ? alerts::Kind::Rate : alerts::Kind::Threshold;
+        rule.threshold = 1e6;
+        rules.push_back(rule);
+    }
+    alerts::Engine engine(rules);
+    auto records = sensorRecords(4096, 1700000000);
+    std::vector<float> values(records.size() * 3);
+    for (size_t i = 0; i < records.size(); i++) {
+        values[3 * i] = fp16::toFloat(records[i].pressure);
+        values[3 * i + 1] = fp16::toFloat(records[i].temperature);
+        values[3 * i + 2] = fp16::toFloat(records[i].velocity);
+    }
+    int64_t mono_ns = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < records.size(); i++) {
+            mono_ns += 50000000;
+            engine.evaluate(mono_ns, mono_ns / 1000000, values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * records.size());
+}
+BENCHMARK(BM_AlertEvaluate)->Arg(1)->Arg(8)->Arg(64)->Unit(benchmark::kMicrosecond);
+
+// One trace::Span with an argument, tracing off (range(0) = 0) or on (1) - the cost added to every
+// traced section of the hot paths
+static void BM_TraceSpan(benchmark::State& state) {
+    trace::setEnabled(state.range(0) != 0);
+    int64_t i = 0;
+    for (auto _ : state) {
+        trace::Span span("ingest", "serial");
+        span.arg("frames", ++i);
+    }
+    trace::setEnabled(false);
+    trace::collect(true);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TraceSpan)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
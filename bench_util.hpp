@@ -0,0 +1,187 @@
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+// Helpers shared by the benchmark / load-test executables: a PTY that plays the device,
+// starting and stopping the real server binary, and some statistics.
+
+#include "httplib.h"
+#include <pty.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+namespace bench {
+
+struct PtyPair {
+    int master_fd;
+    std::string slave_name;
+};
+
+// Same as createPtyPair() in the integration test, but the master is raw so nothing
+// written by the benchmark gets translated or echoed.
+inline PtyPair createPtyPair() {
+    PtyPair p;
+    int master_fd, slave_fd;
+    char slave_name[128] = {0};
+    if (openpty(&master_fd, &slave_fd, slave_name, nullptr, nullptr) == -1) {
+        throw std::runtime_error("openpty failed");
+    }
+    struct termios tio;
+    tcgetattr(master_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master_fd, TCSANOW, &tio);
+    p.master_fd = master_fd;
+    p.slave_name = std::string(slave_name);
+    close(slave_fd);
+    return p;
+}
+
+// Parses '--key=value' arguments. Flags without a value map to "1"
+inline std::map<std::string, std::string> parseArgs(int argc, char* argv[]) {
+    std::map<std::string, std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) continue;
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            args[arg.substr(2)] = "1";
+        } else {
+            args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+        }
+    }
+    return args;
+}
+
+inline std::string argOr(const std::map<std::string, std::string>& args, const std::string& key,
+                         const std::string& fallback) {
+    auto it = args.find(key);
+    return it == args.end() ? fallback : it->second;
+}
+
+// Starts the server binary on the slave side of the PTY with its own database and journal.
+// env holds extra 'NAME=value' settings. quiet sends the server's stdout and stderr to /dev/null.
+inline pid_t spawnServer(const std::string& binary, const PtyPair& pty, int http_port,
+                         const std::string& db_path, const std::vector<std::string>& env = {},
+                         bool quiet = true) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed");
+    }
+    if (pid == 0) {
+        for (const auto& entry : env) {
+            size_t eq = entry.find('=');
+            if (eq != std::string::npos) {
+                setenv(entry.substr(0, eq).c_str(), entry.substr(eq + 1).c_str(), 1);
+            }
+        }
+        if (quiet) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+        std::string port = std::to_string(http_port);
+        execl(binary.c_str(), binary.c_str(), pty.slave_name.c_str(), "115000", "localhost",
+              port.c_str(), db_path.c_str(), (char*)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+// SIGINT and wait - returns the exit status of the server
+inline int stopServer(pid_t pid) {
+    kill(pid, SIGINT);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Polls until the HTTP server accepts connections
+inline bool waitForServer(const std::string& host, int port, std::chrono::seconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    httplib::Client client(host, port);
+    client.set_connection_timeout(std::chrono::milliseconds(200));
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (auto res = client.Get("/metrics")) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+// Reads one '\n'-terminated line from the device side of the PTY
+inline std::string readLine(int fd, std::chrono::milliseconds timeout) {
+    std::string line;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        if (n == 1) {
+            if (c == '\n') return line;
+            line += c;
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    return line;
+}
+
+// Sends GET /start and answers the '$0' the server writes to the device
+inline bool startReading(int master_fd, const std::string& host, int port) {
+    auto result = std::async(std::launch::async, [&] {
+        httplib::Client client(host, port);
+        client.set_read_timeout(std::chrono::seconds(15));
+        auto res = client.Get("/start");
+        return res && res->status == 200;
+    });
+    if (readLine(master_fd, std::chrono::seconds(10)) != "$0") {
+        return false;
+    }
+    const char reply[] = "$0,ok\n";
+    if (write(master_fd, reply, sizeof(reply) - 1) < 0) {
+        return false;
+    }
+    return result.get();
+}
+
+// Writes everything, waiting while the PTY buffer is full
+inline bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Nearest-rank percentile of an ascending sorted vector, p in [0:100]
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+} // namespace bench
+
+#endif // BENCH_UTIL_HPP
@@ -0,0 +1,234 @@
+#include "chunk_codec.hpp"
+#include <algorithm>
+
+namespace chunk {
+
+namespace {
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool readVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < size; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Most significant bit first, appended to the bytes already in `out`
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void write(uint64_t value, int bits) {
+        while (bits > 0) {
+            int take = std::min(bits, 8 - used_);
+            uint8_t part = static_cast<uint8_t>((value >> (bits - take)) & ((1u << take) - 1));
+            if (used_ == 0) out_.push_back(0);
+            out_.back() |= static_cast<uint8_t>(part << (8 - used_ - take));
+            used_ = (used_ + take) % 8;
+            bits -= take;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    int used_ = 0;                               // Bits used in out_.back()
+};
+
+struct FieldState {
+    uint16_t value = 0;
+    int leading = -1;
+    int trailing = 0;
+};
+
+void writeField(BitWriter& writer, FieldState& field, uint16_t value) {
+    uint16_t x = value ^ field.value;
+    field.value = value;
+    if (x == 0) {
+        writer.write(0, 1);
+        return;
+    }
+    int leading = __builtin_clz(x) - 16;
+    int trailing = __builtin_ctz(x);
+    if (field.leading >= 0 && leading >= field.leading && trailing >= field.trailing) {
+        writer.write(0b10, 2);
+        writer.write(x >> field.trailing, 16 - field.leading - field.trailing);
+    } else {
+        int length = 16 - leading - trailing;    // 1..16, leading 0..15
+        writer.write(0b11, 2);
+        writer.write(static_cast<uint64_t>(leading), 4);
+        writer.write(static_cast<uint64_t>(length - 1), 4);
+        writer.write(x >> trailing, length);
+        field.leading = leading;
+        field.trailing = trailing;
+    }
+}
+
+} // namespace
+
+std::vector<uint8_t> encode(const Sample* samples, size_t count) {
+    std::vector<uint8_t> out;
+    out.reserve(16 + count * 4);
+    writeVarint(out, count);
+    if (count == 0) return out;
+
+    const Sample& first = samples[0];
+    writeVarint(out, zigzag(first.timestamp));
+    for (uint16_t value : {first.pressure, first.temperature, first.velocity}) {
+        out.push_back(static_cast<uint8_t>(value));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    BitWriter writer(out);
+    FieldState fields[3];
+    fields[0].value = first.pressure;
+    fields[1].value = first.temperature;
+    fields[2].value = first.velocity;
+    int64_t previous = first.timestamp;
+    int64_t previous_delta = 0;
+    for (size_t i = 1; i < count; i++) {
+        const Sample& sample = samples[i];
+        int64_t delta = sample.timestamp - previous;
+        uint64_t dod = zigzag(delta - previous_delta);
+        previous = sample.timestamp;
+        previous_delta = delta;
+        if (dod == 0) {
+            writer.write(0, 1);
+        } else if (dod < (1u << 7)) {
+            writer.write(0b10, 2);
+            writer.write(dod, 7);
+        } else if (dod < (1u << 9)) {
+            writer.write(0b110, 3);
+            writer.write(dod, 9);
+        } else if (dod < (1u << 12)) {
+            writer.write(0b1110, 4);
+            writer.write(dod, 12);
+        } else {
+            writer.write(0b1111, 4);
+            writer.write(dod, 64);
+        }
+        writeField(writer, fields[0], sample.pressure);
+        writeField(writer, fields[1], sample.temperature);
+        writeField(writer, fields[2], sample.velocity);
+    }
+    return out;
+}
+
+Decoder::Decoder(const uint8_t* data, size_t size) : data_(data), size_(size) {
+    size_t pos = 0;
+    uint64_t count, timestamp;
+    if (!readVarint(data_, size_, pos, count)) return;
+    count_ = static_cast<size_t>(count);
+    if (count_ == 0) {
+        valid_ = true;
+        return;
+    }
+    if (!readVarint(data_, size_, pos, timestamp) || pos + 6 > size_) {
+        count_ = 0;
+        return;
+    }
+    timestamp_ = unzigzag(timestamp);
+    for (Field& field : fields_) {
+        field.value = static_cast<uint16_t>(data_[pos] | (data_[pos + 1] << 8));
+        pos += 2;
+    }
+    if (count_ - 1 > (size_ - pos) * 2) {
+        count_ = 0;                               // Every further sample takes at least 4 bits
+        return;
+    }
+    bit_pos_ = pos * 8;
+    valid_ = true;
+}
+
+size_t Decoder::count() const { return count_; }
+
+bool Decoder::readBits(int bits, uint64_t& value) {
+    if (bit_pos_ + static_cast<size_t>(bits) > size_ * 8) return false;
+    value = 0;
+    while (bits > 0) {
+        int offset = static_cast<int>(bit_pos_ % 8);
+        int take = std::min(bits, 8 - offset);
+        uint8_t byte = data_[bit_pos_ / 8];
+        value = (value << take) | ((byte >> (8 - offset - take)) & ((1u << take) - 1));
+        bit_pos_ += take;
+        bits -= take;
+    }
+    return true;
+}
+
+bool Decoder::readField(Field& field) {
+    uint64_t control, bits;
+    if (!readBits(1, control)) return false;
+    if (control == 0) return true;                // Same value
+    if (!readBits(1, control)) return false;
+    if (control == 1) {
+        uint64_t leading, length;
+        if (!readBits(4, leading) || !readBits(4, length)) return false;
+        if (leading + length + 1 > 16) return false;
+        field.leading = static_cast<int>(leading);
+        field.trailing = 16 - static_cast<int>(leading) - static_cast<int>(length + 1);
+    } else if (field.leading < 0) {
+        return false;                             // Reuse of a window that doesn't exist
+    }
+    if (!readBits(16 - field.leading - field.trailing, bits)) return false;
+    field.value ^= static_cast<uint16_t>(bits << field.trailing);
+    return true;
+}
+
+bool Decoder::next(Sample& sample) {
+    if (!valid_ || index_ >= count_) return false;
+    if (index_ > 0) {
+        // Delta of delta: '0', '10' + 7, '110' + 9, '1110' + 12, '1111' + 64 bits
+        static const int widths[] = {7, 9, 12, 64};
+        uint64_t bit, dod = 0;
+        int prefix = 0;
+        while (prefix < 4) {
+            if (!readBits(1, bit)) return valid_ = false;
+            if (bit == 0) break;
+            prefix++;
+        }
+        if (prefix > 0 && !readBits(widths[prefix - 1], dod)) return valid_ = false;
+        delta_ += unzigzag(dod);
+        timestamp_ += delta_;
+        for (Field& field : fields_) {
+            if (!readField(field)) return valid_ = false;
+        }
+    }
+    index_++;
+    sample.timestamp = timestamp_;
+    sample.pressure = fields_[0].value;
+    sample.temperature = fields_[1].value;
+    sample.velocity = fields_[2].value;
+    return true;
+}
+
+size_t decode(const uint8_t* data, size_t size, std::vector<Sample>& out) {
+    Decoder decoder(data, size);
+    size_t decoded = 0;
+    out.reserve(out.size() + decoder.count());
+    Sample sample;
+    while (decoder.next(sample)) {
+        out.push_back(sample);
+        decoded++;
+    }
+    return decoded;
+}
+
+} // namespace chunk
@@ -0,0 +1,59 @@
+#ifndef CHUNK_CODEC_HPP
+#define CHUNK_CODEC_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Compressed encoding of a run of samples of one series, in the style of Gorilla (Pelkonen et al.):
+//   header     - sample count and first timestamp as varints, the first three values as 16 bits each
+//   timestamps - delta of delta: '0' if the spacing didn't change, otherwise a prefix and 7, 9, 12
+//                or 64 bits (zigzag)
+//   values     - per field, XOR with the previous fp16 value: '0' if equal, '10' + the meaningful bits
+//                if they fit the previous window, '11' + 4 bits leading zeros + 4 bits length + bits
+// Timestamps are whole seconds and the device sends many samples per second, so most delta of deltas
+// are 0 and cost a single bit; slowly changing values only flip low mantissa bits.
+namespace chunk {
+
+struct Sample {
+    int64_t timestamp;
+    uint16_t pressure;     // fp16 bit patterns, see fp16.hpp
+    uint16_t temperature;
+    uint16_t velocity;
+};
+
+std::vector<uint8_t> encode(const Sample* samples, size_t count);
+
+// Decodes one sample at a time, so a query can stop in the middle of a chunk
+class Decoder {
+public:
+    Decoder(const uint8_t* data, size_t size);    // data has to outlive the decoder
+    size_t count() const;                         // Samples in the chunk, from the header
+    bool next(Sample& sample);                    // False at the end, or if the chunk is corrupt
+
+private:
+    struct Field {
+        uint16_t value = 0;
+        int leading = -1;                         // Window of the last XOR, -1 = none yet
+        int trailing = 0;
+    };
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t bit_pos_ = 0;
+    size_t count_ = 0;
+    size_t index_ = 0;
+    int64_t timestamp_ = 0;
+    int64_t delta_ = 0;
+    Field fields_[3];
+    bool valid_ = false;
+
+    bool readBits(int bits, uint64_t& value);
+    bool readField(Field& field);
+};
+
+size_t decode(const uint8_t* data, size_t size, std::vector<Sample>& out);  // Appends, returns samples decoded
+
+} // namespace chunk
+
+#endif // CHUNK_CODEC_HPP
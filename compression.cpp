@@ -0,0 +1,146 @@
+#include "compression.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace compression {
+
+// 'gzip;q=0' refuses gzip even if '*' allows everything else
+bool acceptsGzip(const std::string& accept_encoding) {
+    double gzip_q = -1, any_q = -1;
+    std::stringstream list(accept_encoding);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        std::string coding;
+        double q = 1;
+        std::stringstream parts(item);
+        std::string part;
+        for (bool first = true; std::getline(parts, part, ';'); first = false) {
+            part.erase(std::remove_if(part.begin(), part.end(), [](unsigned char c) { return std::isspace(c); }),
+                       part.end());
+            std::transform(part.begin(), part.end(), part.begin(), [](unsigned char c) { return std::tolower(c); });
+            if (first) {
+                coding = part;
+            } else if (part.rfind("q=", 0) == 0) {
+                q = std::strtod(part.c_str() + 2, nullptr);
+            }
+        }
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzip_q = q;
+        } else if (coding == "*") {
+            any_q = q;
+        }
+    }
+    return gzip_q >= 0 ? gzip_q > 0 : any_q > 0;
+}
+
+GzipStream::GzipStream(int level, size_t chunk_bytes, size_t threads)
+    : level_(level), chunk_bytes_(std::max<size_t>(chunk_bytes, 1)), threads_(std::max<size_t>(threads, 1)) {
+    crc_ = crc32(0, Z_NULL, 0);
+}
+
+GzipStream::~GzipStream() = default;                    // Waits for chunks still being compressed
+
+// Raw deflate (no zlib / gzip wrapper) of one chunk. Not the last one: ends with a sync flush - an
+// empty stored block that byte aligns the output, so the next chunk's blocks can follow right away
+GzipStream::Chunk GzipStream::deflateChunk(std::string input, int level, bool last) {
+    Chunk chunk;
+    chunk.size = input.size();
+    chunk.crc = crc32(0, reinterpret_cast<const Bytef*>(input.data()), static_cast<uInt>(input.size()));
+
+    z_stream strm{};
+    if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed for level " + std::to_string(level));
+    }
+    strm.next_in = reinterpret_cast<Bytef*>(input.data());
+    strm.avail_in = static_cast<uInt>(input.size());
+    // deflateBound() holds for the whole input in one call, +16 covers the sync flush - so the output
+    // buffer is sized once and a single deflate() call fills it
+    const size_t bound = deflateBound(&strm, strm.avail_in) + 16;
+    chunk.deflated.resize(bound);
+    strm.next_out = reinterpret_cast<Bytef*>(chunk.deflated.data());
+    strm.avail_out = static_cast<uInt>(bound);
+    const int rc = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+    const size_t unused = strm.avail_out;
+    deflateEnd(&strm);
+    if (rc == Z_STREAM_ERROR || unused == 0) {
+        throw std::runtime_error("deflate failed");
+    }
+    chunk.deflated.erase(bound - unused);
+    return chunk;
+}
+
+bool GzipStream::emit(Chunk chunk, const Callback& out) {
+    if (!header_sent_) {
+        // Magic, deflate, no flags, no mtime, no extra flags, OS unix
+        static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+        if (!out(header, sizeof(header))) return false;
+        header_sent_ = true;
+    }
+    crc_ = crc32_combine(crc_, chunk.crc, static_cast<z_off_t>(chunk.size));
+    total_ += chunk.size;
+    return chunk.deflated.empty() || out(chunk.deflated.data(), chunk.deflated.size());
+}
+
+bool GzipStream::write(const char* data, size_t size, const Callback& out) {
+    while (size > 0) {
+        size_t take = std::min(size, chunk_bytes_ - pending_.size());
+        pending_.append(data, take);
+        data += take;
+        size -= take;
+        if (pending_.size() < chunk_bytes_) break;
+
+        // Enough chunks in flight: the oldest has to go out before another one starts
+        if (in_flight_.size() >= threads_) {
+            Chunk oldest = in_flight_.front().get();
+            in_flight_.pop_front();
+            if (!emit(std::move(oldest), out)) return false;
+        }
+        in_flight_.push_back(std::async(std::launch::async, deflateChunk, std::move(pending_), level_, false));
+        pending_.clear();
+    }
+    // Whatever is done already goes out now, in order
+    while (!in_flight_.empty() && in_flight_.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        Chunk done = in_flight_.front().get();
+        in_flight_.pop_front();
+        if (!emit(std::move(done), out)) return false;
+    }
+    return true;
+}
+
+bool GzipStream::finish(const Callback& out) {
+    while (!in_flight_.empty()) {
+        Chunk done = in_flight_.front().get();
+        in_flight_.pop_front();
+        if (!emit(std::move(done), out)) return false;
+    }
+    // The last chunk on this thread - for small bodies it's the only one
+    if (!emit(deflateChunk(std::move(pending_), level_, true), out)) return false;
+    pending_.clear();
+
+    char trailer[8];
+    uint32_t size = static_cast<uint32_t>(total_);     // ISIZE is the length modulo 2^32
+    for (int i = 0; i < 4; i++) {
+        trailer[i] = static_cast<char>(crc_ >> (8 * i));
+        trailer[4 + i] = static_cast<char>(size >> (8 * i));
+    }
+    return out(trailer, sizeof(trailer));
+}
+
+std::string gzip(const char* data, size_t size, int level, size_t chunk_bytes, size_t threads) {
+    std::string result;
+    auto append = [&result](const char* d, size_t n) {
+        result.append(d, n);
+        return true;
+    };
+    GzipStream stream(level, chunk_bytes, threads);
+    stream.write(data, size, append);
+    stream.finish(append);
+    return result;
+}
+
+} // namespace compression
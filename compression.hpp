@@ -0,0 +1,60 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+
+// gzip Content-Encoding for HTTP responses (zlib).
+//
+// Large bodies are cut into chunks that are deflated independently, several at a time, and
+// concatenated into one gzip member: every chunk but the last ends with a sync flush (byte
+// aligned, no final block) and the CRCs are joined with crc32_combine(). Like pigz -i - a chunk
+// doesn't see the history of the one before, which costs ~1% in size for 256 KiB chunks, but any
+// client that reads gzip reads the result.
+namespace compression {
+
+// Accept-Encoding allows gzip: listed (or '*') without q=0
+bool acceptsGzip(const std::string& accept_encoding);
+
+class GzipStream {
+public:
+    using Callback = std::function<bool(const char* data, size_t size)>;
+
+    // level 1-9; up to `threads` chunks of chunk_bytes are compressed at the same time
+    GzipStream(int level, size_t chunk_bytes, size_t threads);
+    ~GzipStream();
+
+    // Compressed output goes to `out`, in order, as soon as it's ready. False if `out` failed
+    bool write(const char* data, size_t size, const Callback& out);
+    bool finish(const Callback& out);                  // Last chunk and the gzip trailer
+
+private:
+    struct Chunk {
+        std::string deflated;
+        uint32_t crc = 0;
+        size_t size = 0;
+    };
+
+    int level_;
+    size_t chunk_bytes_;
+    size_t threads_;
+    std::string pending_;                              // Input of the next chunk
+    std::deque<std::future<Chunk>> in_flight_;
+    bool header_sent_ = false;
+    uint32_t crc_ = 0;
+    uint64_t total_ = 0;
+
+    static Chunk deflateChunk(std::string input, int level, bool last);
+    bool emit(Chunk chunk, const Callback& out);
+};
+
+// Whole body at once - small bodies stay on the calling thread
+std::string gzip(const char* data, size_t size, int level, size_t chunk_bytes, size_t threads);
+
+} // namespace compression
+
+#endif // COMPRESSION_HPP
@@ -0,0 +1,233 @@
+#include "device_simulator.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+
+DeviceSimulator::DeviceSimulator(int fd, const Settings& settings)
+    : fd_(fd), settings_(settings), rng_(settings.seed) {
+    int flags = fcntl(fd_, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::runtime_error("DeviceSimulator: Failed to make descriptor non-blocking: " +
+                                 std::string(strerror(errno)));
+    }
+}
+
+DeviceSimulator::~DeviceSimulator() {
+    stop();
+    close(fd_);
+}
+
+int DeviceSimulator::openPort(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        throw std::runtime_error("DeviceSimulator: Failed to open " + path + ": " + strerror(errno));
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+void DeviceSimulator::start() {
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread(&DeviceSimulator::run, this);
+}
+
+void DeviceSimulator::stop() {
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+DeviceSimulator::Stats DeviceSimulator::getStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void DeviceSimulator::run() {
+    using clock = std::chrono::steady_clock;
+    const auto period = settings_.rate_hz > 0
+        ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / settings_.rate_hz))
+        : clock::duration::max();
+    auto next_frame = clock::now();
+    char buffer[256];
+
+    while (!stop_.load()) {
+        auto now = clock::now();
+        while (!responses_.empty() && responses_.front().due <= now) {
+            sendResponse(responses_.front());
+            responses_.pop_front();
+        }
+
+        bool streaming;
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            streaming = stats_.streaming;
+        }
+        // Paused while a command is being answered
+        if (streaming && responses_.empty() && settings_.rate_hz > 0) {
+            if (now - next_frame > std::chrono::seconds(1)) {
+                next_frame = now;     // Don't burst out a second of backlog after a stall
+            }
+            while (next_frame <= now) {
+                sendFrame();
+                next_frame += period;
+            }
+        } else {
+            next_frame = now;
+        }
+
+        // Sleep until the next frame / response is due, or input arrives
+        auto wake = now + std::chrono::milliseconds(100);
+        if (streaming && responses_.empty() && settings_.rate_hz > 0) wake = std::min(wake, next_frame);
+        if (!responses_.empty()) wake = std::min(wake, responses_.front().due);
+        auto wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake - clock::now()).count();
+        if (wait_ns < 0) wait_ns = 0;
+        struct timespec timeout = {static_cast<time_t>(wait_ns / 1000000000), static_cast<long>(wait_ns % 1000000000)};
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        int ready = ppoll(&pfd, 1, &timeout, nullptr);
+        if (ready <= 0) continue;
+        if (pfd.revents & (POLLHUP | POLLERR)) {
+            // Nobody on the other end (yet) - don't spin
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (!(pfd.revents & POLLIN)) continue;
+
+        ssize_t n = read(fd_, buffer, sizeof(buffer));
+        if (n <= 0) continue;
+        input_.append(buffer, static_cast<size_t>(n));
+        size_t end;
+        while ((end = input_.find('\n')) != std::string::npos) {
+            std::string line = input_.substr(0, end);
+            input_.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) handleCommand(line);
+        }
+    }
+}
+
+void DeviceSimulator::handleCommand(const std::string& line) {
+    PendingResponse response;
+    response.due = std::chrono::steady_clock::now() + settings_.response_delay;
+    std::string command = line.substr(0, line.find(','));
+    bool valid = true;
+
+    if (command == "$0") {
+        response.effect = Effect::Start;
+    } else if (command == "$1") {
+        // Stops right away - no frames after the stop command
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.streaming = false;
+    } else if (command == "$2") {
+        // '$2,frequency,debug'
+        int frequency = 0, debug = -1;
+        char tail = 0;
+        if (sscanf(line.c_str(), "$2,%d,%d%c", &frequency, &debug, &tail) == 2 &&
+            frequency > 0 && frequency <= 255 && (debug == 0 || debug == 1)) {
+            response.effect = Effect::Configure;
+            response.frequency = frequency;
+            response.debug = debug == 1;
+        } else {
+            valid = false;
+        }
+    } else {
+        valid = false;
+    }
+
+    bool inject_error = valid && std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < settings_.error_rate;
+    if (!valid || inject_error) {
+        response.effect = Effect::None;
+        response.line = line + ",invalid command";
+    } else {
+        response.line = line + ",ok";
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.commands++;
+    if (inject_error) stats_.errors_injected++;
+    responses_.push_back(std::move(response));
+}
+
+void DeviceSimulator::sendResponse(const PendingResponse& response) {
+    writeLine(response.line, false);
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (response.effect == Effect::Start) {
+        if (!stats_.streaming) {
+            started_at_ = std::chrono::steady_clock::now();
+        }
+        stats_.streaming = true;       // First frame only after the answer
+    } else if (response.effect == Effect::Configure) {
+        stats_.frequency = response.frequency;
+        stats_.debug = response.debug;
+    }
+}
+
+// Pressure breathes slowly around 1013 hPa, temperature drifts over minutes, velocity is a
+// mix of two harmonics - each with a little gaussian noise. Debug mode adds a constant offset
+// to velocity, so configuration changes are visible in the data.
+void DeviceSimulator::sendFrame() {
+    constexpr double two_pi = 6.283185307179586;
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at_).count();
+    std::normal_distribution<double> noise(0.0, 1.0);
+    bool debug;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        debug = stats_.debug;
+    }
+    double pressure = 1013.25 + 2.5 * std::sin(two_pi * 0.2 * t) + 0.05 * noise(rng_);
+    double temperature = 21.5 + 0.8 * std::sin(two_pi * t / 300.0) + 0.02 * noise(rng_);
+    double velocity = 3.0 + 1.5 * std::sin(two_pi * 1.3 * t) + 0.4 * std::sin(two_pi * 7.0 * t)
+                      + 0.1 * noise(rng_) + (debug ? 10.0 : 0.0);
+
+    char frame[96];
+    bool malformed = std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < settings_.malformed_rate;
+    if (malformed) {
+        // One field missing - the most common corruption of a torn frame
+        snprintf(frame, sizeof(frame), "$%.2f,%.2f", pressure, temperature);
+    } else {
+        snprintf(frame, sizeof(frame), "$%.2f,%.2f,%.2f", pressure, temperature, velocity);
+    }
+    bool sent = writeLine(frame, true);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (sent) {
+        stats_.frames_sent++;
+        if (malformed) stats_.frames_malformed++;
+    } else {
+        stats_.frames_dropped++;
+    }
+}
+
+// Frames may be dropped if nothing fits. Once a line is partially written, the rest is always
+// written, otherwise the stream would be corrupted
+bool DeviceSimulator::writeLine(const std::string& line, bool may_drop) {
+    std::string data = line + "\n";
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd_, data.data() + written, data.size() - written);
+        if (n > 0) {
+            written += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN) {
+            std::cerr << "DeviceSimulator: Write failed: " << strerror(errno) << "\n";
+            return false;
+        }
+        if (may_drop && written == 0) return false;
+        if (stop_.load()) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef DEVICE_SIMULATOR_HPP
+#define DEVICE_SIMULATOR_HPP
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+// How the simulated device behaves
+struct DeviceSimulatorSettings {
+    double rate_hz = 1000.0;                      // Sensor frames per second while started, 0 = none
+    std::chrono::microseconds response_delay{0};  // Between receiving a command and answering it
+    double error_rate = 0.0;                      // Share of commands answered with 'invalid command'
+    double malformed_rate = 0.0;                  // Share of sensor frames that don't parse
+    uint32_t seed = 1;                            // Noise and error injection are reproducible per seed
+};
+
+// Plays the sensor device on the device end of a serial line (a PTY master or the other end of
+// a socat pair): answers $0 (start), $1 (stop) and $2,frequency,debug (configure) and, while
+// started, streams '$pressure,temperature,velocity\n' frames with realistic waveforms.
+//
+// Streaming pauses from receiving a command until its answer is written, like the real device,
+// so the server never sees a sensor frame where it expects a command response. On a full
+// output buffer, frames are dropped (counted) instead of blocking - a UART doesn't wait either.
+class DeviceSimulator {
+public:
+    using Settings = DeviceSimulatorSettings;
+
+    struct Stats {
+        uint64_t commands = 0;
+        uint64_t errors_injected = 0;             // Commands answered with 'invalid command' on purpose
+        uint64_t frames_sent = 0;
+        uint64_t frames_malformed = 0;            // Included in frames_sent
+        uint64_t frames_dropped = 0;              // Output buffer full
+        bool streaming = false;
+        int frequency = 115;
+        bool debug = false;
+    };
+
+    // Takes ownership of fd
+    DeviceSimulator(int fd, const Settings& settings = Settings());
+    ~DeviceSimulator();
+
+    // Disable copy / assgin / move constructors
+    DeviceSimulator(const DeviceSimulator&) = delete;
+    DeviceSimulator& operator=(const DeviceSimulator&) = delete;
+    DeviceSimulator(DeviceSimulator&&) = delete;
+    DeviceSimulator& operator=(DeviceSimulator&&) = delete;
+
+    void start();                                 // Runs the device in its own thread
+    void stop();
+    Stats getStats() const;
+
+    // Opens a serial device path (e.g. the socat end /dev/ttyUSB1) in raw mode. Throws on failure
+    static int openPort(const std::string& path);
+
+private:
+    enum class Effect { None, Start, Configure };
+
+    struct PendingResponse {
+        std::chrono::steady_clock::time_point due;
+        std::string line;                         // Without '\n'
+        Effect effect = Effect::None;
+        int frequency = 0;
+        bool debug = false;
+    };
+
+    int fd_;
+    Settings settings_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::mt19937 rng_;
+
+    // Owned by the device thread
+    std::string input_;
+    std::deque<PendingResponse> responses_;
+    std::chrono::steady_clock::time_point started_at_;
+
+    mutable std::mutex stats_mutex_;
+    Stats stats_;
+
+    void run();
+    void handleCommand(const std::string& line);
+    void sendResponse(const PendingResponse& response);
+    void sendFrame();
+    bool writeLine(const std::string& line, bool may_drop);
+};
+
+#endif // DEVICE_SIMULATOR_HPP
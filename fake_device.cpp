@@ -0,0 +1,96 @@
+// fake_device - simulated sensor device, replaces typing '$0,ok' into the socat end by hand.
+//
+// Usage: ./fake_device [--port=/dev/ttyUSB1 | --link=/tmp/ttyFAKE] [--rate=1000] [--delay-ms=0]
+//                      [--error-rate=0.0] [--malformed=0.0] [--seed=1]
+//   --port        device end of an existing serial line, e.g. the second socat PTY
+//   --link        without --port: creates a PTY pair and links its server end here
+//                 (the name of the server end is printed either way). Replaces a symlink left
+//                 there, refuses to replace anything else
+//   --rate        sensor frames per second while started
+//   --delay-ms    delay before answering a command
+//   --error-rate  share of commands answered with 'invalid command'
+//   --malformed   share of sensor frames that don't parse
+// Runs until SIGINT / SIGTERM and prints what it did.
+
+#include "device_simulator.hpp"
+#include "bench_util.hpp"
+#include <signal.h>
+#include <filesystem>
+
+volatile sig_atomic_t stop_flag = 0;
+void signalHandler(int) {
+    stop_flag = 1;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    auto args = bench::parseArgs(argc, argv);
+
+    DeviceSimulator::Settings settings;
+    std::string port, link;
+    try {
+        port = bench::argOr(args, "port", "");
+        link = bench::argOr(args, "link", "");
+        settings.rate_hz = std::stod(bench::argOr(args, "rate", "1000"));
+        settings.response_delay = std::chrono::microseconds(
+            static_cast<int64_t>(std::stod(bench::argOr(args, "delay-ms", "0")) * 1000));
+        settings.error_rate = std::stod(bench::argOr(args, "error-rate", "0"));
+        settings.malformed_rate = std::stod(bench::argOr(args, "malformed", "0"));
+        settings.seed = static_cast<uint32_t>(std::stoul(bench::argOr(args, "seed", "1")));
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid argument: " << e.what() << "\n";
+        return 1;
+    }
+
+    try {
+        int fd;
+        std::string linked;                              // Server end, if we created `link`
+        if (!port.empty()) {
+            fd = DeviceSimulator::openPort(port);
+            std::cout << "Device on " << port << "\n";
+        } else {
+            bench::PtyPair pty = bench::createPtyPair();
+            fd = pty.master_fd;
+            std::cout << "Server port: " << pty.slave_name << "\n";
+            if (!link.empty()) {
+                // Only ever a link - a mistyped path must not cost a real file
+                auto status = std::filesystem::symlink_status(link);
+                if (std::filesystem::is_symlink(status)) {
+                    std::filesystem::remove(link);
+                } else if (std::filesystem::exists(status)) {
+                    throw std::runtime_error(link + " exists and isn't a symlink");
+                }
+                std::filesystem::create_symlink(pty.slave_name, link);
+                linked = pty.slave_name;
+                std::cout << "Linked as " << link << "\n";
+            }
+        }
+        std::cout << "Rate " << settings.rate_hz << " frames/s, response delay "
+                  << settings.response_delay.count() / 1000.0 << " ms, error rate " << settings.error_rate
+                  << ", malformed " << settings.malformed_rate << std::endl;
+
+        DeviceSimulator device(fd, settings);
+        device.start();
+        while (!stop_flag) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        device.stop();
+
+        auto stats = device.getStats();
+        std::cout << "\nCommands: " << stats.commands << " (" << stats.errors_injected << " answered invalid on purpose)\n"
+                  << "Frames sent: " << stats.frames_sent << " (" << stats.frames_malformed << " malformed), dropped: "
+                  << stats.frames_dropped << "\n"
+                  << "Final configuration: frequency " << stats.frequency << ", debug " << stats.debug << "\n";
+        // Unless something else replaced it in the meantime
+        std::error_code ec;
+        if (!linked.empty() && std::filesystem::is_symlink(std::filesystem::symlink_status(link, ec)) &&
+            std::filesystem::read_symlink(link, ec) == linked) {
+            std::filesystem::remove(link, ec);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "fp16.hpp"
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace fp16 {
+
+// Round to nearest even, like the hardware conversions
+uint16_t fromFloatScalar(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+    uint32_t abs = x & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000) {
+        // Infinity, or NaN - quiet, with the upper payload bits
+        return abs == 0x7F800000 ? (sign | 0x7C00) : (sign | 0x7E00 | ((abs >> 13) & 0x03FF));
+    }
+    if (abs >= 0x477FF000) {
+        return sign | 0x7C00;                         // >= 65520 rounds to infinity
+    }
+    if (abs >= 0x38800000) {
+        // Normal half: rebias the exponent (127 -> 15), round away the low 13 mantissa bits
+        uint32_t rounded = abs + 0x0FFF + ((abs >> 13) & 1);
+        return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+    }
+    if (abs < 0x33000000) {
+        return sign;                                  // Below half of the smallest subnormal
+    }
+    // Subnormal half: mantissa in units of 2^-24
+    uint32_t exponent = abs >> 23;
+    uint32_t mantissa = (abs & 0x007FFFFF) | 0x00800000;
+    uint32_t shift = 126 - exponent;                  // 14..24
+    uint32_t result = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (result & 1))) {
+        result++;                                     // May carry into the smallest normal - still right
+    }
+    return sign | static_cast<uint16_t>(result);
+}
+
+float toFloatScalar(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x03FF;
+    uint32_t bits;
+
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa ? (0x00400000 | (mantissa << 13)) : 0);  // NaNs come out quiet
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal half - normalise
+        uint32_t e = 113;
+        while (!(mantissa & 0x0400)) {
+            mantissa <<= 1;
+            e--;
+        }
+        bits = sign | (e << 23) | ((mantissa & 0x03FF) << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#if defined(__aarch64__)
+
+uint16_t fromFloat(float value) {
+    __fp16 half = static_cast<__fp16>(value);
+    uint16_t bits;
+    std::memcpy(&bits, &half, sizeof(bits));
+    return bits;
+}
+
+float toFloat(uint16_t half) {
+    __fp16 value;
+    std::memcpy(&value, &half, sizeof(half));
+    return static_cast<float>(value);
+}
+
+void fromFloat(const float* in, uint16_t* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x4_t low = vcvt_f16_f32(vld1q_f32(in + i));
+        float16x4_t high = vcvt_f16_f32(vld1q_f32(in + i + 4));
+        vst1q_u16(out + i, vreinterpretq_u16_f16(vcombine_f16(low, high)));
+    }
+    for (; i < count; i++) {
+        out[i] = fromFloat(in[i]);
+    }
+}
+
+void toFloat(const uint16_t* in, float* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x8_t halves = vreinterpretq_f16_u16(vld1q_u16(in + i));
+        vst1q_f32(out + i, vcvt_f32_f16(vget_low_f16(halves)));
+        vst1q_f32(out + i + 4, vcvt_high_f32_f16(halves));
+    }
+    for (; i < count; i++) {
+        out[i] = toFloat(in[i]);
+    }
+}
+
+const char* implementation() { return "neon"; }
+
+#elif defined(__x86_64__)
+
+// F16C is compiled in per function and only called after checking the CPU
+static const bool has_f16c = [] {
+    __builtin_cpu_init();  // Runs before main()
+    return __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+}();
+
+__attribute__((target("avx,f16c")))
+static uint16_t fromFloatF16C(float value) {
+    return static_cast<uint16_t>(_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT));
+}
+
+__attribute__((target("avx,f16c")))
+static float toFloatF16C(uint16_t half) {
+    return _cvtsh_ss(half);
+}
+
+__attribute__((target("avx,f16c")))
+static void fromFloatF16C(const float* in, uint16_t* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), halves);
+    }
+    for (; i < count; i++) {
+        out[i] = fromFloatF16C(in[i]);
+    }
+}
+
+__attribute__((target("avx,f16c")))
+static void toFloatF16C(const uint16_t* in, float* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(halves));
+    }
+    for (; i < count; i++) {
+        out[i] = toFloatF16C(in[i]);
+    }
+}
+
+uint16_t fromFloat(float value) {
+    return has_f16c ? fromFloatF16C(value) : fromFloatScalar(value);
+}
+
+float toFloat(uint16_t half) {
+    return has_f16c ? toFloatF16C(half) : toFloatScalar(half);
+}
+
+void fromFloat(const float* in, uint16_t* out, size_t count) {
+    if (has_f16c) {
+        fromFloatF16C(in, out, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = fromFloatScalar(in[i]);
+    }
+}
+
+void toFloat(const uint16_t* in, float* out, size_t count) {
+    if (has_f16c) {
+        toFloatF16C(in, out, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = toFloatScalar(in[i]);
+    }
+}
+
+const char* implementation() { return has_f16c ? "f16c" : "scalar"; }
+
+#else
+
+uint16_t fromFloat(float value) { return fromFloatScalar(value); }
+float toFloat(uint16_t half) { return toFloatScalar(half); }
+
+void fromFloat(const float* in, uint16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = fromFloatScalar(in[i]);
+    }
+}
+
+void toFloat(const uint16_t* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = toFloatScalar(in[i]);
+    }
+}
+
+const char* implementation() { return "scalar"; }
+
+#endif
+
+} // namespace fp16
@@ -0,0 +1,30 @@
+#ifndef FP16_HPP
+#define FP16_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+// IEEE 754 half precision <-> float conversion on uint16_t bit patterns, so the storage format
+// doesn't depend on the ARM-only __fp16 type.
+//
+// The batch functions use the widest conversion the CPU has - NEON (vcvt) on AArch64, F16C on
+// x86-64 (checked at runtime, the binary still runs without it) - and a scalar fallback otherwise.
+// All paths round to nearest even and give the same bits, including subnormals, infinities and
+// NaNs (quiet, upper payload bits kept).
+namespace fp16 {
+
+uint16_t fromFloat(float value);
+float toFloat(uint16_t half);
+
+void fromFloat(const float* in, uint16_t* out, size_t count);
+void toFloat(const uint16_t* in, float* out, size_t count);
+
+// Bit-exact software conversion - the reference the vector paths are checked against
+uint16_t fromFloatScalar(float value);
+float toFloatScalar(uint16_t half);
+
+const char* implementation();   // "neon", "f16c" or "scalar"
+
+} // namespace fp16
+
+#endif // FP16_HPP
@@ -0,0 +1,450 @@
+#include "frame_journal.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+int64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+}
+
+FrameJournal::FrameJournal(const std::string& dir, size_t segment_bytes)
+    : dir_(dir), dir_name_(dir), segment_bytes_(segment_bytes) {
+    if (segment_bytes_ < 64 * 1024) {
+        throw std::runtime_error("Journal segment size must be at least 64 KiB");
+    }
+    fs::create_directories(dir_);
+    openExisting();
+    std::cout << "FrameJournal: Opened '" << dir_name_ << "' with " << segments_.size()
+              << " segment(-s), last sequence " << last_seq_.load() << "\n";
+}
+
+FrameJournal::~FrameJournal() {
+    sync();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [first_seq, segment] : segments_) {
+        closeSegment(segment);
+    }
+}
+
+std::string FrameJournal::segmentName(uint64_t first_seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(first_seq));
+    return name;
+}
+
+// Finds the segments of a previous run. Only the newest one can have a torn tail,
+// older ones end where the next one starts.
+// A segment without a valid header (e.g. a crash between allocating it and writing the header) is
+// renamed to '*.seg.corrupt' - left in place, it would block the segment the journal starts next
+// under the same name.
+void FrameJournal::openExisting() {
+    std::vector<fs::path> entries;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".seg") entries.push_back(entry.path());
+    }
+    for (const auto& path : entries) {
+        Segment segment;
+        segment.path = path;
+        try {
+            segment.first_seq = std::stoull(path.stem().string());
+            mapSegment(segment, false);
+        } catch (const std::exception& e) {
+            closeSegment(segment);
+            fs::path aside = path;
+            aside += ".corrupt";
+            std::error_code ec;
+            fs::rename(path, aside, ec);
+            std::cerr << "FrameJournal: Skipping '" << path.string() << "': " << e.what()
+                      << (ec ? "" : ", renamed to '" + aside.filename().string() + "'") << "\n";
+            continue;
+        }
+        segments_.emplace(segment.first_seq, std::move(segment));
+    }
+    if (segments_.empty()) return;
+
+    for (auto it = segments_.begin(); it != segments_.end(); ++it) {
+        auto next = std::next(it);
+        if (next != segments_.end()) {
+            it->second.last_seq = next->first - 1;
+            it->second.write_pos = it->second.size;  // Sealed - never appended to again
+            it->second.synced_pos = it->second.size;
+        }
+    }
+    Segment& newest = segments_.rbegin()->second;
+    recoverTail(newest);
+    last_seq_.store(newest.last_seq);
+    stats_.last_seq = stats_.synced_seq = newest.last_seq;
+}
+
+void FrameJournal::mapSegment(Segment& segment, bool create) {
+    segment.fd = open(segment.path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (segment.fd < 0) {
+        throw std::runtime_error("Failed to open segment: " + std::string(strerror(errno)));
+    }
+    if (create) {
+        // Reserve the blocks up front - a full disk must fail here, not as SIGBUS on a mapped write
+        int err = posix_fallocate(segment.fd, 0, static_cast<off_t>(segment_bytes_));
+        if (err == EOPNOTSUPP || err == EINVAL) {
+            err = ftruncate(segment.fd, static_cast<off_t>(segment_bytes_)) == 0 ? 0 : errno;
+        }
+        if (err != 0) {
+            throw std::runtime_error("Failed to allocate segment: " + std::string(strerror(err)));
+        }
+        segment.size = segment_bytes_;
+    } else {
+        struct stat st;
+        if (fstat(segment.fd, &st) < 0) {
+            throw std::runtime_error("Failed to stat segment: " + std::string(strerror(errno)));
+        }
+        segment.size = static_cast<size_t>(st.st_size);
+        if (segment.size < sizeof(SegmentHeader)) {
+            throw std::runtime_error("Segment is truncated");
+        }
+    }
+
+    void* base = mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("Failed to map segment: " + std::string(strerror(errno)));
+    }
+    segment.base = static_cast<char*>(base);
+
+    if (!create) {
+        SegmentHeader header;
+        std::memcpy(&header, segment.base, sizeof(header));
+        if (std::memcmp(header.magic, segment_magic, sizeof(segment_magic)) != 0 ||
+            header.version != format_version || header.first_seq != segment.first_seq) {
+            throw std::runtime_error("Not a journal segment or wrong version");
+        }
+        segment.last_seq = segment.first_seq - 1;
+        segment.write_pos = align8(sizeof(SegmentHeader));
+    }
+}
+
+// Walks the newest segment up to the first record that is incomplete or corrupted and cuts
+// the log there. Anything behind the cut is zeroed, so a later, shorter record can't make an
+// old record behind it look valid again.
+void FrameJournal::recoverTail(Segment& segment) {
+    size_t pos = align8(sizeof(SegmentHeader));
+    uint64_t seq = segment.first_seq;
+    RecordHeader header;
+    while (parseRecord(segment, pos, seq, header)) {
+        pos += header.length;
+        seq++;
+    }
+    segment.write_pos = pos;
+    segment.synced_pos = pos;
+    segment.last_seq = seq - 1;
+
+    size_t dirty_end = pos;
+    for (size_t i = pos; i < segment.size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, segment.base + i, std::min(sizeof(word), segment.size - i));
+        if (word != 0) dirty_end = std::min(i + sizeof(word), segment.size);
+    }
+    if (dirty_end > pos) {
+        std::cerr << "FrameJournal: Discarding " << dirty_end - pos << " byte(-s) of torn tail in '"
+                  << segment.path.string() << "'\n";
+        std::memset(segment.base + pos, 0, dirty_end - pos);
+        msync(segment.base, segment.size, MS_SYNC);
+    }
+}
+
+bool FrameJournal::parseRecord(const Segment& segment, size_t pos, uint64_t expected_seq,
+                               RecordHeader& header) const {
+    if (pos + sizeof(RecordHeader) > segment.size) return false;
+    std::memcpy(&header, segment.base + pos, sizeof(header));
+    if (header.length < sizeof(RecordHeader) || pos + header.length > segment.size ||
+        header.length < sizeof(RecordHeader) + header.frame_len || header.seq != expected_seq) {
+        return false;
+    }
+    const auto* bytes = reinterpret_cast<const unsigned char*>(segment.base + pos);
+    size_t covered = sizeof(RecordHeader) + header.frame_len - offsetof(RecordHeader, seq);
+    return crc32(bytes + offsetof(RecordHeader, seq), covered) == header.crc;
+}
+
+FrameJournal::Segment& FrameJournal::startSegment(uint64_t first_seq) {
+    Segment segment;
+    segment.first_seq = first_seq;
+    segment.last_seq = first_seq - 1;
+    segment.path = dir_ / segmentName(first_seq);
+    try {
+        mapSegment(segment, true);
+    } catch (...) {
+        bool created = segment.fd >= 0; // O_EXCL failed otherwise - file isn't ours
+        closeSegment(segment);
+        if (created) fs::remove(segment.path);
+        throw;
+    }
+
+    SegmentHeader header{};
+    std::memcpy(header.magic, segment_magic, sizeof(segment_magic));
+    header.version = format_version;
+    header.header_size = sizeof(SegmentHeader);
+    header.first_seq = first_seq;
+    header.created_s = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::memcpy(segment.base, &header, sizeof(header));
+    segment.write_pos = align8(sizeof(SegmentHeader));
+    msync(segment.base, segment.write_pos, MS_SYNC);
+
+    // Make the new directory entry durable too
+    int dir_fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return segments_.emplace(first_seq, std::move(segment)).first->second;
+}
+
+void FrameJournal::closeSegment(Segment& segment) {
+    if (segment.base) munmap(segment.base, segment.size);
+    if (segment.fd >= 0) close(segment.fd);
+    segment.base = nullptr;
+    segment.fd = -1;
+}
+
+uint64_t FrameJournal::append(Record record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t frame_len = std::min<size_t>(record.frame.size(), UINT16_MAX);
+    const size_t length = align8(sizeof(RecordHeader) + frame_len);
+    if (length > segment_bytes_ - align8(sizeof(SegmentHeader))) {
+        throw std::runtime_error("Frame too large for journal segment");
+    }
+    const uint64_t seq = last_seq_.load() + 1;
+
+    Segment* segment = segments_.empty() ? nullptr : &segments_.rbegin()->second;
+    if (!segment || segment->write_pos + length > segment->size) {
+        if (segment) {
+            // Seal the full segment - from now on only the new one needs periodic syncs
+            msync(segment->base, segment->size, MS_SYNC);
+            segment->synced_pos = segment->size;
+        }
+        segment = &startSegment(seq);
+    }
+
+    RecordHeader header{};
+    header.length = static_cast<uint32_t>(length);
+    header.seq = seq;
+    header.mono_ns = record.mono_ns;
+    header.wall_s = record.wall_s;
+    header.pressure = record.pressure;
+    header.temperature = record.temperature;
+    header.velocity = record.velocity;
+    header.frequency = record.frequency;
+    header.flags = record.debug ? 1 : 0;
+    header.frame_len = static_cast<uint16_t>(frame_len);
+
+    char* dest = segment->base + segment->write_pos;
+    std::memcpy(dest + sizeof(RecordHeader), record.frame.data(), frame_len);
+    std::memcpy(dest, &header, sizeof(header));
+    size_t covered = sizeof(RecordHeader) + frame_len - offsetof(RecordHeader, seq);
+    header.crc = crc32(reinterpret_cast<const unsigned char*>(dest) + offsetof(RecordHeader, seq), covered);
+    std::memcpy(dest + offsetof(RecordHeader, crc), &header.crc, sizeof(header.crc));
+
+    segment->write_pos += length;
+    segment->last_seq = seq;
+    last_seq_.store(seq, std::memory_order_release);
+    stats_.appended++;
+    if (waiting_) {
+        records_cv_.notify_one();
+    }
+    return seq;
+}
+
+size_t FrameJournal::readAfter(uint64_t after_seq, size_t max, std::vector<Record>& out) {
+    out.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t seq = after_seq + 1;
+    if (segments_.empty() || seq > last_seq_.load()) return 0;
+
+    // Continue from the cursor if the caller reads sequentially, otherwise find the segment
+    auto it = segments_.end();
+    size_t pos = 0;
+    if (cursor_.next_seq == seq && segments_.count(cursor_.segment_first_seq)) {
+        it = segments_.find(cursor_.segment_first_seq);
+        pos = cursor_.pos;
+    } else {
+        it = segments_.upper_bound(seq);
+        if (it != segments_.begin()) --it;
+        seq = std::max(seq, it->second.first_seq); // Older records are gone already
+        pos = align8(sizeof(SegmentHeader));
+        RecordHeader header;
+        for (uint64_t s = it->second.first_seq; s < seq; s++) {
+            if (!parseRecord(it->second, pos, s, header)) return 0;
+            pos += header.length;
+        }
+    }
+
+    RecordHeader header;
+    while (out.size() < max && seq <= last_seq_.load()) {
+        if (!parseRecord(it->second, pos, seq, header)) {
+            auto next = std::next(it);
+            if (next == segments_.end() || next->first != seq) {
+                std::cerr << "FrameJournal: Record " << seq << " is unreadable\n";
+                break;
+            }
+            it = next;
+            pos = align8(sizeof(SegmentHeader));
+            continue;
+        }
+        Record& record = out.emplace_back();
+        record.seq = header.seq;
+        record.mono_ns = header.mono_ns;
+        record.wall_s = header.wall_s;
+        record.frequency = header.frequency;
+        record.debug = (header.flags & 1) != 0;
+        record.pressure = header.pressure;
+        record.temperature = header.temperature;
+        record.velocity = header.velocity;
+        record.frame.assign(it->second.base + pos + sizeof(RecordHeader), header.frame_len);
+        pos += header.length;
+        seq++;
+    }
+    cursor_ = {it->first, pos, seq};
+    return out.size();
+}
+
+// Used when the journal is behind the database (e.g. journal directory was deleted), so new
+// records can't reuse sequence numbers that are already stored. The current segment is sealed,
+// the next append starts a new one at seq + 1.
+void FrameJournal::skipTo(uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (seq <= last_seq_.load()) return;
+    if (!segments_.empty()) {
+        Segment& segment = segments_.rbegin()->second;
+        msync(segment.base, segment.size, MS_SYNC);
+        segment.write_pos = segment.synced_pos = segment.size;
+    }
+    last_seq_.store(seq, std::memory_order_release);
+    stats_.synced_seq = seq;
+}
+
+bool FrameJournal::waitForRecords(uint64_t after_seq, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting_ = true;
+    records_cv_.wait_for(lock, timeout, [&] {
+        return last_seq_.load() > after_seq || wake_requested_;
+    });
+    waiting_ = false;
+    wake_requested_ = false;
+    return last_seq_.load() > after_seq;
+}
+
+void FrameJournal::wakeWaiters() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_requested_ = true;
+    records_cv_.notify_all();
+}
+
+// Only the newest segment can have unsynced data, full ones are synced when sealed.
+// The msync itself runs without the lock so the serial reader can keep appending.
+void FrameJournal::sync() {
+    char* start;
+    size_t len;
+    uint64_t seq;
+    size_t end_pos;
+    uint64_t segment_first_seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (segments_.empty()) return;
+        Segment& segment = segments_.rbegin()->second;
+        if (segment.synced_pos >= segment.write_pos) return;
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t from = segment.synced_pos / page * page;
+        start = segment.base + from;
+        len = segment.write_pos - from;
+        seq = segment.last_seq;
+        end_pos = segment.write_pos;
+        segment_first_seq = segment.first_seq;
+    }
+
+    auto sync_start = std::chrono::steady_clock::now();
+    if (msync(start, len, MS_SYNC) < 0) {
+        std::cerr << "FrameJournal: msync failed: " << strerror(errno) << "\n";
+        return;
+    }
+    int64_t sync_us = elapsedUs(sync_start);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = segments_.find(segment_first_seq);
+    if (it != segments_.end()) {
+        it->second.synced_pos = std::max(it->second.synced_pos, end_pos);
+    }
+    stats_.synced_seq = std::max(stats_.synced_seq, seq);
+    stats_.syncs++;
+    stats_.last_sync_us = sync_us;
+    stats_.max_sync_us = std::max(stats_.max_sync_us, sync_us);
+}
+
+void FrameJournal::dropSegmentsUpTo(uint64_t seq, size_t keep) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (segments_.size() < 2) return;
+
+    // Candidates: sealed segments whose last record is <= seq. The newest segment is never dropped
+    size_t droppable = 0;
+    for (auto it = segments_.begin(); std::next(it) != segments_.end(); ++it) {
+        if (it->second.last_seq > seq) break;
+        droppable++;
+    }
+    while (droppable > keep) {
+        auto it = segments_.begin();
+        closeSegment(it->second);
+        std::error_code ec;
+        fs::remove(it->second.path, ec);
+        if (ec) {
+            std::cerr << "FrameJournal: Failed to remove '" << it->second.path.string() << "': " << ec.message() << "\n";
+        }
+        if (cursor_.segment_first_seq == it->first) cursor_ = {};
+        segments_.erase(it);
+        droppable--;
+    }
+}
+
+uint64_t FrameJournal::lastSeq() const { return last_seq_.load(std::memory_order_acquire); }
+
+uint64_t FrameJournal::firstSeq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segments_.empty() ? 0 : segments_.begin()->second.first_seq;
+}
+
+FrameJournal::Stats FrameJournal::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.last_seq = last_seq_.load();
+    stats.segments = segments_.size();
+    return stats;
+}
+
+const std::string& FrameJournal::getDirectory() const { return dir_name_; }
+
+// Plain table-driven CRC32 (IEEE 802.3), same result as zlib's crc32()
+uint32_t FrameJournal::crc32(const unsigned char* data, size_t len) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
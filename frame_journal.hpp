@@ -0,0 +1,143 @@
+#ifndef FRAME_JOURNAL_HPP
+#define FRAME_JOURNAL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Append-only log of sensor frames, written at ingest time before anything touches SQLite.
+// The log is a directory of fixed-size, memory-mapped segment files named after the sequence
+// number of their first record. Records are appended by the serial reader only and made durable
+// by periodic msync(), the database is filled from the log by a separate writer thread.
+//
+// Record layout (little endian, 8-byte aligned):
+//   RecordHeader | frame bytes | zero padding
+// A zero length marks the end of the written part of a segment. Each record carries a CRC32,
+// so a record torn by a crash is detected and the log is cut off in front of it on the next open.
+class FrameJournal {
+public:
+    struct Record {
+        uint64_t seq = 0;              // Starts at 1, increases by one per record, never reused
+        int64_t mono_ns = 0;           // steady_clock at ingest - for latency / gap analysis
+        int64_t wall_s = 0;            // UNIX timestamp at ingest - becomes the Timestamp column
+        uint8_t frequency = 0;         // Device configuration the frame was received with
+        bool debug = false;
+        uint16_t pressure = 0;         // fp16 bit patterns as parsed at ingest
+        uint16_t temperature = 0;
+        uint16_t velocity = 0;
+        std::string frame;             // Raw frame without '$' and '\n'
+    };
+
+    struct Stats {
+        uint64_t last_seq = 0;
+        uint64_t synced_seq = 0;       // Records up to here are on disk
+        size_t segments = 0;
+        uint64_t appended = 0;         // Since open
+        uint64_t syncs = 0;
+        int64_t last_sync_us = 0;
+        int64_t max_sync_us = 0;
+    };
+
+    FrameJournal(const std::string& dir, size_t segment_bytes = 8 * 1024 * 1024);
+    ~FrameJournal();
+
+    // Disable copy / assgin / move constructors
+    FrameJournal(const FrameJournal&) = delete;
+    FrameJournal& operator=(const FrameJournal&) = delete;
+    FrameJournal(FrameJournal&&) = delete;
+    FrameJournal& operator=(FrameJournal&&) = delete;
+
+    // Assigns the next sequence number to the record and returns it. Throws if it can't be written
+    uint64_t append(Record record);
+
+    // Copies up to max records with seq > after_seq into out (cleared first). Returns count
+    size_t readAfter(uint64_t after_seq, size_t max, std::vector<Record>& out);
+
+    // Blocks until a record with seq > after_seq exists or the timeout expires
+    bool waitForRecords(uint64_t after_seq, std::chrono::milliseconds timeout);
+    void wakeWaiters();
+
+    void skipTo(uint64_t seq);                      // Next append gets seq + 1 - if the log is behind seq
+    void sync();                                    // msync() everything appended so far
+    void dropSegmentsUpTo(uint64_t seq, size_t keep); // Deletes segments fully <= seq, keeps the newest `keep` of them
+
+    uint64_t lastSeq() const;
+    uint64_t firstSeq() const;                      // Oldest record still in the log, 0 if empty
+    Stats getStats() const;
+    const std::string& getDirectory() const;
+
+private:
+    struct RecordHeader {
+        uint32_t length;               // Whole record incl. padding, 0 = end of segment
+        uint32_t crc;                  // CRC32 of everything after this field up to frame end
+        uint64_t seq;
+        int64_t mono_ns;
+        int64_t wall_s;
+        uint16_t pressure;
+        uint16_t temperature;
+        uint16_t velocity;
+        uint8_t frequency;
+        uint8_t flags;                 // Bit 0 - debug
+        uint16_t frame_len;
+    };
+
+    struct SegmentHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t first_seq;
+        int64_t created_s;
+    };
+
+    struct Segment {
+        std::filesystem::path path;
+        uint64_t first_seq = 0;
+        uint64_t last_seq = 0;         // first_seq - 1 while empty
+        int fd = -1;
+        char* base = nullptr;
+        size_t size = 0;
+        size_t write_pos = 0;          // Offset of the next record
+        size_t synced_pos = 0;         // Offset up to which msync() covered the segment
+    };
+
+    std::filesystem::path dir_;
+    std::string dir_name_;
+    size_t segment_bytes_;
+
+    mutable std::mutex mutex_;         // Protects segments_ and everything below
+    std::condition_variable records_cv_;
+    bool waiting_ = false;             // Only notify when the writer actually sleeps
+    bool wake_requested_ = false;
+    std::map<uint64_t, Segment> segments_;          // Keyed by first_seq
+    std::atomic<uint64_t> last_seq_{0};
+    Stats stats_;
+
+    // Position after the last record handed out by readAfter(), so sequential reads don't rescan
+    struct Cursor {
+        uint64_t segment_first_seq = 0;
+        size_t pos = 0;
+        uint64_t next_seq = 0;
+    } cursor_;
+
+    static constexpr char segment_magic[8] = {'F', 'R', 'M', 'J', 'R', 'N', 'L', '1'};
+    static constexpr uint32_t format_version = 1;
+
+    void openExisting();
+    void mapSegment(Segment& segment, bool create);
+    void recoverTail(Segment& segment);
+    Segment& startSegment(uint64_t first_seq);
+    void closeSegment(Segment& segment);
+    bool parseRecord(const Segment& segment, size_t pos, uint64_t expected_seq,
+                     RecordHeader& header) const;
+    static uint32_t crc32(const unsigned char* data, size_t len);
+    static std::string segmentName(uint64_t first_seq);
+};
+
+#endif // FRAME_JOURNAL_HPP
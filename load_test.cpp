@@ -0,0 +1,208 @@
+// load_test - open-loop HTTP load against the real server binary while frames are ingested.
+// Reports latency percentiles and errors per endpoint.
+//
+// Usage: ./load_test [--server=./server] [--rate=500] [--connections=8] [--duration=10]
+//                    [--endpoints=/messages?limit=100,/device] [--ingest-rate=1000]
+//                    [--http-port=7191] [--db=load_test.db] [--json]
+//   --rate         requests per second over all connections, spread evenly between them
+//   --connections  keep-alive connections, one thread each
+//   --endpoints    comma separated GET paths, requested round robin
+//   --ingest-rate  frames per second the device simulator streams meanwhile, 0 = none
+//
+// Open loop: requests are scheduled at fixed times, and the latency of a request is measured
+// from its scheduled time. A slow response delays the following requests of its connection,
+// and that delay counts against them - a stalled server can't hide behind fewer requests.
+// The run ends 1 s after --duration regardless: requests that are still due by then are not sent
+// and reported as missed (and as errors), so an overloaded server doesn't stretch the run.
+
+#include "bench_util.hpp"
+#include "device_simulator.hpp"
+#include "nlohmann/json.hpp"
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+#include <sstream>
+
+struct EndpointResult {
+    std::vector<double> latencies_ms;
+    uint64_t requests = 0;
+    uint64_t errors = 0;          // No response or status >= 400
+    uint64_t timeouts = 0;        // No response in time (connect or read timeout), included in errors
+    uint64_t connection_errors = 0; // Refused or reset while connecting or sending, included in errors
+    uint64_t missed = 0;          // Scheduled but not sent before the end of the run, included in errors
+    uint64_t bytes = 0;
+};
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    auto args = bench::parseArgs(argc, argv);
+    const std::string server_binary = bench::argOr(args, "server", "./server");
+    const double rate = std::stod(bench::argOr(args, "rate", "500"));
+    const int connections = std::max(1, std::stoi(bench::argOr(args, "connections", "8")));
+    const double duration_s = std::stod(bench::argOr(args, "duration", "10"));
+    const std::vector<std::string> endpoints = splitList(bench::argOr(args, "endpoints", "/messages?limit=100,/device"));
+    const double ingest_rate = std::stod(bench::argOr(args, "ingest-rate", "1000"));
+    const int http_port = std::stoi(bench::argOr(args, "http-port", "7191"));
+    // Absolute, the server only accepts database paths with a directory part
+    const std::string db_path = std::filesystem::absolute(bench::argOr(args, "db", "load_test.db")).string();
+    const bool json_output = args.count("json") > 0;
+    if (rate <= 0 || endpoints.empty()) {
+        std::cerr << "--rate has to be positive and --endpoints non-empty\n";
+        return 1;
+    }
+
+    std::filesystem::remove(db_path);
+    std::filesystem::remove_all(db_path + ".frames");
+
+    bench::PtyPair pty = bench::createPtyPair();
+    pid_t pid = bench::spawnServer(server_binary, pty, http_port, db_path);
+    if (!bench::waitForServer("localhost", http_port, std::chrono::seconds(10))) {
+        std::cerr << "Server didn't come up on port " << http_port << "\n";
+        bench::stopServer(pid);
+        return 1;
+    }
+
+    // The simulator answers the '$0' of GET /start and streams frames until it's stopped
+    DeviceSimulator::Settings device_settings;
+    device_settings.rate_hz = ingest_rate;
+    DeviceSimulator device(pty.master_fd, device_settings);
+    device.start();
+    {
+        httplib::Client client("localhost", http_port);
+        auto res = client.Get("/start");
+        if (!res || res->status != 200) {
+            std::cerr << "GET /start failed\n";
+            device.stop();
+            bench::stopServer(pid);
+            return 1;
+        }
+    }
+    // Let some data arrive before the first /messages
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // Connection c sends requests c, c + connections, ... of the global schedule
+    const auto interval = std::chrono::duration<double>(1.0 / rate);
+    const uint64_t total_requests = static_cast<uint64_t>(rate * duration_s);
+    std::vector<std::vector<EndpointResult>> results(connections, std::vector<EndpointResult>(endpoints.size()));
+    auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(duration_s)) + std::chrono::seconds(1);  // Grace for the last ones
+
+    std::vector<std::thread> workers;
+    for (int c = 0; c < connections; c++) {
+        workers.emplace_back([&, c] {
+            httplib::Client client("localhost", http_port);
+            client.set_keep_alive(true);
+            client.set_tcp_nodelay(true);  // Don't let Nagle on our side add to the latency
+            client.set_connection_timeout(std::chrono::seconds(2));
+            client.set_read_timeout(std::chrono::seconds(5));
+            for (uint64_t i = c; i < total_requests; i += connections) {
+                auto scheduled = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * i);
+                std::this_thread::sleep_until(scheduled);
+                size_t e = i % endpoints.size();
+                EndpointResult& result = results[c][e];
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    result.missed++;
+                    result.errors++;
+                    continue;
+                }
+                auto res = client.Get(endpoints[e]);
+                auto done = std::chrono::steady_clock::now();
+                result.requests++;
+                if (!res) {
+                    result.errors++;
+                    if (res.error() == httplib::Error::Read || res.error() == httplib::Error::ConnectionTimeout) {
+                        result.timeouts++;
+                    } else if (res.error() == httplib::Error::Connection || res.error() == httplib::Error::Write) {
+                        result.connection_errors++;
+                    }
+                    continue;
+                }
+                if (res->status >= 400) {
+                    result.errors++;
+                }
+                result.bytes += res->body.size();
+                result.latencies_ms.push_back(std::chrono::duration<double, std::milli>(done - scheduled).count());
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    device.stop();
+
+    httplib::Client client("localhost", http_port);
+    auto metrics_res = client.Get("/metrics");
+    nlohmann::json metrics = metrics_res && metrics_res->status == 200
+                                 ? nlohmann::json::parse(metrics_res->body) : nlohmann::json(nullptr);
+    bench::stopServer(pid);
+
+    const double elapsed_s = std::chrono::duration<double>(end - start).count();
+    nlohmann::json summary = {
+        {"rate_target", rate},
+        {"connections", connections},
+        {"duration_s", elapsed_s},
+        {"ingest_rate_target", ingest_rate},
+        {"frames_sent", device.getStats().frames_sent},
+        {"samples_stored", metrics.is_null() ? nlohmann::json(nullptr) : metrics["storage"]["samples_stored"]},
+        {"endpoints", nlohmann::json::object()}
+    };
+    for (size_t e = 0; e < endpoints.size(); e++) {
+        EndpointResult merged;
+        for (const auto& per_connection : results) {
+            const auto& result = per_connection[e];
+            merged.requests += result.requests;
+            merged.errors += result.errors;
+            merged.timeouts += result.timeouts;
+            merged.connection_errors += result.connection_errors;
+            merged.missed += result.missed;
+            merged.bytes += result.bytes;
+            merged.latencies_ms.insert(merged.latencies_ms.end(), result.latencies_ms.begin(), result.latencies_ms.end());
+        }
+        std::sort(merged.latencies_ms.begin(), merged.latencies_ms.end());
+        summary["endpoints"][endpoints[e]] = {
+            {"requests", merged.requests},
+            {"rate", merged.requests / elapsed_s},
+            {"errors", merged.errors},
+            {"timeouts", merged.timeouts},
+            {"connection_errors", merged.connection_errors},
+            {"missed", merged.missed},
+            {"avg_bytes", merged.requests ? merged.bytes / merged.requests : 0},
+            {"latency_ms", {
+                {"p50", bench::percentile(merged.latencies_ms, 50)},
+                {"p99", bench::percentile(merged.latencies_ms, 99)},
+                {"p999", bench::percentile(merged.latencies_ms, 99.9)},
+                {"max", merged.latencies_ms.empty() ? 0.0 : merged.latencies_ms.back()}
+            }}
+        };
+    }
+
+    uint64_t errors = 0;
+    if (json_output) {
+        std::cout << summary.dump() << "\n";
+        for (const auto& [endpoint, result] : summary["endpoints"].items()) errors += result["errors"].get<uint64_t>();
+    } else {
+        std::cout << rate << " req/s over " << connections << " connection(-s) for " << elapsed_s << " s, ingest "
+                  << ingest_rate << " frames/s, " << summary["samples_stored"] << " samples stored\n";
+        for (const auto& [endpoint, result] : summary["endpoints"].items()) {
+            errors += result["errors"].get<uint64_t>();
+            std::cout << endpoint << ": " << result["requests"] << " requests (" << result["rate"].get<double>()
+                      << "/s), " << result["errors"] << " errors (" << result["missed"] << " missed, "
+                      << result["timeouts"] << " timeouts, " << result["connection_errors"] << " connection errors), "
+                      << result["avg_bytes"] << " bytes avg\n"
+                      << "    latency (ms): p50 " << result["latency_ms"]["p50"] << ", p99 " << result["latency_ms"]["p99"]
+                      << ", p99.9 " << result["latency_ms"]["p999"] << ", max " << result["latency_ms"]["max"] << "\n";
+        }
+    }
+    return errors == 0 ? 0 : 2;
+}
@@ -1,4 +1,5 @@
 #include "serial_interface.hpp"
+#include <linux/serial.h>
 
 // termios2 structure definition
 struct termios2 {
@@ -23,8 +24,9 @@ struct termios2 {
 #define BOTHER 0x1000
 #endif
 
-SerialInterface::SerialInterface(const std::string& port, int baud) 
-    : port_name(port), baud_rate(baud), is_virtual(false), fd(-1), master_fd(-1) 
+SerialInterface::SerialInterface(const std::string& port, int baud, const LineSettings& settings) 
+    : port_name(port), baud_rate(baud), is_virtual(false), fd(-1), master_fd(-1), wakeup_fd(-1),
+      line_settings(settings), queued_bytes(0)
 {
     const std::string default_port = "/dev/ttyUSB0"; 
     struct stat buffer;
@@ -32,11 +34,11 @@ SerialInterface::SerialInterface(const std::string& port, int baud)
     // First check if the user-provided port exists
     if (stat(port.c_str(), &buffer) == 0) {
         // Try to open user-provided port
-        fd = open(port.c_str(), O_RDWR | O_NOCTTY);
+        fd = open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
         if (fd < 0) {
             std::cerr << "Error opening port '" << port << "'. Trying default port '" << default_port << "'\n";
             port_name = default_port;
-            fd = open(default_port.c_str(), O_RDWR | O_NOCTTY);
+            fd = open(default_port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
             if (fd < 0) {
                 throw std::runtime_error("Failed to open default port: " + std::string(strerror(errno)));
             }
@@ -45,7 +47,7 @@ SerialInterface::SerialInterface(const std::string& port, int baud)
         // User-provided port doesn't exist, try default
         std::cerr << "Port '" << port << "' does not exist. Trying default port '" << default_port << "'\n";
         port_name = default_port;
-        fd = open(default_port.c_str(), O_RDWR | O_NOCTTY);
+        fd = open(default_port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
         if (fd < 0) {
             throw std::runtime_error("Failed to open default port: " + std::string(strerror(errno)));
         }
@@ -54,28 +56,109 @@ SerialInterface::SerialInterface(const std::string& port, int baud)
     // After successful open, check if virtual
     is_virtual = isPTY(fd);
 
-    // Set baud rate if physical port
+    // Raw mode for both kinds of ports. Baud rate, flow control and low latency are physical only
     if (!is_virtual) {
-        setCustomBaudRate();
+        configurePhysicalLine();
+        if (line_settings.low_latency) {
+            setLowLatency();
+        }
+    } else {
+        configureVirtualLine();
+    }
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd < 0) {
+        throw std::runtime_error("Failed to create wakeup eventfd: " + std::string(strerror(errno)));
     }
 }
 
 SerialInterface::~SerialInterface() {
     if(fd >= 0) close(fd);
     if(master_fd >= 0) close(master_fd);
+    if(wakeup_fd >= 0) close(wakeup_fd);
 }
 
-// Tries to send data - in case it didn't succeed, throws an error.
+// Queues data and tries to write it right away. Whatever the port doesn't accept
+// (full tty buffer, partial write) stays queued and is finished by the event loop on POLLOUT,
+// so the calling HTTP thread never blocks on the port. Throws if the port is closed,
+// the queue is full or the write fails.
 void SerialInterface::sendData(const std::string& data){
     if (fd < 0) {
         throw std::runtime_error("Serial port not open");
     }
-    ssize_t bytes_written = write(fd, data.c_str(), data.size());
-    if (bytes_written < 0) {
-        throw std::runtime_error("Failed to write to serial port: " + std::string(strerror(errno)));
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (queued_bytes + data.size() > max_queued_bytes) {
+        throw std::runtime_error("Serial write queue full (" + std::to_string(queued_bytes) + " bytes pending)");
     }
-    if (static_cast<size_t>(bytes_written) != data.size()) {
-        std::cerr << "Warning: Not all bytes were written to serial port\n";
+    write_queue.push_back({data, 0, std::chrono::steady_clock::now()});
+    queued_bytes += data.size();
+
+    drainWriteQueue();
+
+    // Leftovers - ask the event loop to wait for POLLOUT
+    if (!write_queue.empty()) {
+        uint64_t one = 1;
+        if (::write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            std::cerr << "Warning: Failed to wake serial event loop: " << strerror(errno) << "\n";
+        }
+    }
+}
+
+bool SerialInterface::flushWrites() {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    drainWriteQueue();
+    return !write_queue.empty();
+}
+
+bool SerialInterface::hasPendingWrites() const {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    return !write_queue.empty();
+}
+
+void SerialInterface::acknowledgeWakeup() {
+    uint64_t value;
+    while (::read(wakeup_fd, &value, sizeof(value)) > 0) {}
+}
+
+// Writes queued commands in order until the port stops accepting data.
+// A command that fails with a hard error is dropped so the queue doesn't get stuck on it.
+void SerialInterface::drainWriteQueue() {
+    while (!write_queue.empty()) {
+        PendingWrite& front = write_queue.front();
+        size_t remaining = front.data.size() - front.offset;
+        ssize_t bytes_written = ::write(fd, front.data.data() + front.offset, remaining);
+        if (bytes_written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                write_stats.would_block++;
+                return;
+            }
+            std::string error = strerror(errno);
+            queued_bytes -= remaining;
+            write_queue.pop_front();
+            throw std::runtime_error("Failed to write to serial port: " + error);
+        }
+
+        front.offset += static_cast<size_t>(bytes_written);
+        queued_bytes -= static_cast<size_t>(bytes_written);
+        if (static_cast<size_t>(bytes_written) < remaining) {
+            write_stats.partial_writes++;
+            continue; // Next write() either takes the rest or reports EAGAIN
+        }
+
+        // Whole command is with the driver now
+        int64_t time_to_wire_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - front.enqueued).count();
+        write_stats.commands_sent++;
+        write_stats.last_time_to_wire_us = time_to_wire_us;
+        write_stats.max_time_to_wire_us = std::max(write_stats.max_time_to_wire_us, time_to_wire_us);
+        if (write_stats.recent.size() == max_recent_writes) {
+            write_stats.recent.erase(write_stats.recent.begin());
+        }
+        std::string command = front.data;
+        while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) command.pop_back();
+        write_stats.recent.push_back({command, front.data.size(), time_to_wire_us});
+        write_queue.pop_front();
     }
 }
 
@@ -95,17 +178,108 @@ void SerialInterface::setCustomBaudRate() {
     }
 }
 
+// Raw 8N1 with custom baud, VMIN/VTIME and optional RTS/CTS in one TCSETS2 call.
+// Used for physical ports only
+void SerialInterface::configurePhysicalLine() {
+    struct termios2 tio;
+    if(ioctl(fd, TCGETS2, &tio) < 0) {
+        throw std::runtime_error("TCGETS2 failed: " + std::string(strerror(errno)));
+    }
+
+    // Same flags as cfmakeraw(), plus no software flow control
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CS8 | CREAD | CLOCAL;
+    if (line_settings.rtscts) {
+        tio.c_cflag |= CRTSCTS;
+    }
+    tio.c_cc[VMIN] = line_settings.vmin;
+    tio.c_cc[VTIME] = line_settings.vtime;
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = tio.c_ospeed = static_cast<speed_t>(baud_rate);
+
+    if(ioctl(fd, TCSETS2, &tio) < 0) {
+        throw std::runtime_error("TCSETS2 failed: " + std::string(strerror(errno)));
+    }
+}
+
+// PTYs have no baud rate or modem lines, only the line discipline matters
+void SerialInterface::configureVirtualLine() {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) < 0) {
+        throw std::runtime_error("tcgetattr failed: " + std::string(strerror(errno)));
+    }
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = line_settings.vmin;
+    tio.c_cc[VTIME] = line_settings.vtime;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+        throw std::runtime_error("tcsetattr failed: " + std::string(strerror(errno)));
+    }
+}
+
+// Asks the driver to push received bytes to the tty layer right away instead of batching them
+// (e.g. 16 ms latency timer of FTDI adapters). Not all drivers support it - only warns then.
+void SerialInterface::setLowLatency() {
+    struct serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+        std::cerr << "Warning: Low latency mode not supported by '" << port_name << "': " << strerror(errno) << "\n";
+        return;
+    }
+    serial.flags |= ASYNC_LOW_LATENCY;
+    if (ioctl(fd, TIOCSSERIAL, &serial) < 0) {
+        std::cerr << "Warning: Failed to enable low latency mode on '" << port_name << "': " << strerror(errno) << "\n";
+    }
+}
+
 bool SerialInterface::isPTY(int fd) {
     struct stat st;
     if(fstat(fd, &st) < 0) return false;
     return major(st.st_rdev) == 136; // PTY major number
 }
 
+// Both ioctls are cheap, so the driver is asked each time instead of caching the values
+SerialInterface::LineStats SerialInterface::getLineStats() const {
+    LineStats stats;
+    struct serial_icounter_struct icount;
+    if (fd >= 0 && ioctl(fd, TIOCGICOUNT, &icount) == 0) {
+        stats.icount_supported = true;
+        stats.rx = icount.rx;
+        stats.tx = icount.tx;
+        stats.overrun = icount.overrun;
+        stats.buf_overrun = icount.buf_overrun;
+        stats.frame = icount.frame;
+        stats.parity = icount.parity;
+        stats.brk = icount.brk;
+    }
+    int pending = 0;
+    if (fd >= 0 && ioctl(fd, TIOCINQ, &pending) == 0) {
+        stats.queue_supported = true;
+        stats.input_pending = pending;
+        if (ioctl(fd, TIOCOUTQ, &pending) == 0) {
+            stats.output_pending = pending;
+        }
+    }
+    return stats;
+}
+
 // Getters
 int SerialInterface::getFileDescriptor() const { return fd; }
+int SerialInterface::getWakeupDescriptor() const { return wakeup_fd; }
+SerialInterface::WriteStats SerialInterface::getWriteStats() const {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    WriteStats stats = write_stats;
+    stats.queue_depth = write_queue.size();
+    stats.queued_bytes = queued_bytes;
+    return stats;
+}
 const std::string& SerialInterface::getPortName() const { return port_name; }
 bool SerialInterface::isVirtual() const { return is_virtual; }
 int SerialInterface::getBaudRate() const { return baud_rate; }
+const SerialInterface::LineSettings& SerialInterface::getLineSettings() const { return line_settings; }
 
 // Setter
 void SerialInterface::updBaudRate(const int& baud) {
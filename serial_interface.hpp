@@ -11,32 +11,112 @@
 #include <cstring>
 #include <sys/stat.h>
 #include <sys/sysmacros.h> 
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <chrono>
 
 // Forward declaration for termios2
 struct termios2;
 
+// Line discipline of the port. Applied at open - the port is always put in raw mode
+// (no canonical line buffering, echo or CR/LF translation).
+struct SerialLineSettings {
+    uint8_t vmin = 1;            // Bytes buffered before the port reports readable. Set to frame size to batch wakeups
+    uint8_t vtime = 0;           // Inter-byte timeout in 1/10 s. Leave 0 for lowest latency
+    bool low_latency = true;     // ASYNC_LOW_LATENCY - physical ports only, ignored if driver doesn't support it
+    bool rtscts = false;         // RTS/CTS hardware flow control - physical ports only
+};
+
 class SerialInterface {
+public:
+    // Time it took for one sendData() call to be fully accepted by the driver
+    struct WireRecord {
+        std::string command;
+        size_t bytes;
+        int64_t time_to_wire_us;
+    };
+
+    using LineSettings = SerialLineSettings;
+
+    struct WriteStats {
+        size_t queue_depth = 0;              // Commands not yet fully written
+        size_t queued_bytes = 0;             // Bytes not yet fully written
+        uint64_t commands_sent = 0;          // Commands fully handed to the driver
+        uint64_t partial_writes = 0;         // write() calls that accepted only part of the data
+        uint64_t would_block = 0;            // write() calls that returned EAGAIN
+        int64_t last_time_to_wire_us = 0;
+        int64_t max_time_to_wire_us = 0;
+        std::vector<WireRecord> recent;      // Last few commands, oldest first
+    };
+
+    // Driver-side counters. Fields stay 0 when the matching *_supported flag is false
+    // (e.g. PTYs and most USB CDC adapters don't implement TIOCGICOUNT)
+    struct LineStats {
+        bool icount_supported = false;       // TIOCGICOUNT
+        uint64_t rx = 0;
+        uint64_t tx = 0;
+        uint64_t overrun = 0;                // UART FIFO overruns - bytes lost in hardware
+        uint64_t buf_overrun = 0;            // tty flip buffer overruns - bytes lost in the kernel
+        uint64_t frame = 0;
+        uint64_t parity = 0;
+        uint64_t brk = 0;
+        bool queue_supported = false;        // TIOCINQ / TIOCOUTQ
+        int input_pending = 0;               // Bytes received but not read yet
+        int output_pending = 0;              // Bytes written but not sent yet
+    };
+
 private:
+    struct PendingWrite {
+        std::string data;
+        size_t offset;                       // Bytes of data already written
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
     std::string port_name;
     int baud_rate;
     bool is_virtual;
     int fd;
     int master_fd;
+    int wakeup_fd;                           // eventfd - wakes the event loop when writes are queued
+    LineSettings line_settings;
+
+    // Outbound queue - filled by HTTP threads, drained by sendData() and the event loop on POLLOUT
+    mutable std::mutex write_mutex;
+    std::deque<PendingWrite> write_queue;
+    size_t queued_bytes;
+    WriteStats write_stats;
+    static constexpr size_t max_queued_bytes = 64 * 1024;
+    static constexpr size_t max_recent_writes = 16;
 
     void setCustomBaudRate();
+    void configurePhysicalLine();
+    void configureVirtualLine();
+    void setLowLatency();
+    void drainWriteQueue();                  // Expects write_mutex to be held
     static bool isPTY(int fd);
 
 public:
-    SerialInterface(const std::string& port = "/dev/ttyUSB0", int baud = 115000);
+    SerialInterface(const std::string& port = "/dev/ttyUSB0", int baud = 115000,
+                    const LineSettings& settings = LineSettings());
     ~SerialInterface();
 
-    void sendData(const std::string& data); 
+    void sendData(const std::string& data);  // Queues data and writes as much as the port accepts
+    bool flushWrites();                      // Called on POLLOUT. True if data is still pending
+    bool hasPendingWrites() const;
+    void acknowledgeWakeup();                // Clears the wakeup eventfd
 
     // Getters
     int getFileDescriptor() const;
+    int getWakeupDescriptor() const;
+    WriteStats getWriteStats() const;
+    LineStats getLineStats() const;          // Queries the driver on every call
     const std::string& getPortName() const;
     bool isVirtual() const;
     int getBaudRate() const;
+    const LineSettings& getLineSettings() const;
     
     // Setter
     void updBaudRate(const int& baud);
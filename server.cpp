@@ -6,13 +6,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <cstdlib> 
-
-// Function to parse the received message - simplified
-bool parseMessage(const std::string& message, float& pressure, float& temperature, float& velocity) {
-    std::istringstream iss(message);
-    char comma;
-    return (iss >> pressure >> comma >> temperature >> comma >> velocity) && (comma == ',');
-}
+#include <poll.h>
 
 // Signal handler for graceful shutdown
 // Can shutdown using: pgrep -f server 
@@ -44,6 +38,19 @@ int main(int argc, char* argv[]) {
     std::string host_name = default_host_name;
     std::string db_path = default_db_path;
     int server_port = default_server_port;
+    SerialInterface::LineSettings line_settings; // Raw mode, VMIN = 1, VTIME = 0, low latency on, no RTS/CTS
+    std::string journal_dir;                     // Default: next to the database, '<DB_PATH>.frames'
+    int journal_segment_mb = 8;
+    JournalWriterSettings writer_settings;
+    DatabaseProfile db_profile;                  // Default: balanced
+    PartitionSettings partition_settings;        // Default: no partitions, keep everything
+    CompressionSettings compression_settings;    // Default: gzip level 6 from 1 KiB on
+    HttpPoolSettings pool_settings;              // Default: httplib's worker count, 64 queued connections
+    QuerySettings query_settings;                // Default: /messages streams above 10000
+    StatsSettings stats_settings;                // Default: a day of minutes, 30 days of hours
+    AlertSettings alert_settings;                // Default: no rules
+    bool trace_enabled = false;                  // Default: spans are not recorded
+    size_t trace_events = 4096;                  // Spans kept per thread
 
     try {
         /*Step 0: Get Environment Variables. Validate them */
@@ -94,7 +101,128 @@ int main(int argc, char* argv[]) {
         // DB_PATH (string)
         if (const char* env_db = std::getenv("DB_PATH")) {
             db_path = env_db;
-        }    
+        }
+
+        // SERIAL_VMIN, SERIAL_VTIME (numeric, 0-255), SERIAL_LOW_LATENCY, SERIAL_RTSCTS (0 or 1)
+        auto readByteEnv = [](const char* name, uint8_t& value) {
+            const char* env = std::getenv(name);
+            if (!env) return;
+            try {
+                int candidate = std::stoi(env);
+                if (candidate < 0 || candidate > 255) throw std::out_of_range("not in [0:255]");
+                value = static_cast<uint8_t>(candidate);
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid " << name << " value (" << env << "); using default "
+                          << static_cast<int>(value) << "\n";
+            }
+        };
+        auto readFlagEnv = [](const char* name, bool& value) {
+            const char* env = std::getenv(name);
+            if (!env) return;
+            std::string flag = env;
+            if (flag == "1" || flag == "true") value = true;
+            else if (flag == "0" || flag == "false") value = false;
+            else std::cerr << "Invalid " << name << " value (" << env << "); using default " << value << "\n";
+        };
+        readByteEnv("SERIAL_VMIN", line_settings.vmin);
+        readByteEnv("SERIAL_VTIME", line_settings.vtime);
+        readFlagEnv("SERIAL_LOW_LATENCY", line_settings.low_latency);
+        readFlagEnv("SERIAL_RTSCTS", line_settings.rtscts);
+
+        // JOURNAL_DIR (string), JOURNAL_SEGMENT_MB, JOURNAL_SYNC_MS, JOURNAL_BATCH, JOURNAL_RETAIN_SEGMENTS (numeric)
+        if (const char* env_journal = std::getenv("JOURNAL_DIR")) {
+            journal_dir = env_journal;
+        }
+        auto readPositiveEnv = [](const char* name, int max, auto& value) {
+            const char* env = std::getenv(name);
+            if (!env) return;
+            try {
+                int candidate = std::stoi(env);
+                if (candidate <= 0 || candidate > max) throw std::out_of_range("not in [1:" + std::to_string(max) + "]");
+                value = candidate;
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid " << name << " value (" << env << "); using default\n";
+            }
+        };
+        int sync_ms = static_cast<int>(writer_settings.sync_interval.count());
+        readPositiveEnv("JOURNAL_SEGMENT_MB", 1024, journal_segment_mb);
+        readPositiveEnv("JOURNAL_SYNC_MS", 60000, sync_ms);
+        readPositiveEnv("JOURNAL_BATCH", 100000, writer_settings.batch_size);
+        readPositiveEnv("JOURNAL_RETAIN_SEGMENTS", 100000, writer_settings.retain_segments);
+        writer_settings.sync_interval = std::chrono::milliseconds(sync_ms);
+
+        // DB_PROFILE (durable, balanced or throughput)
+        if (const char* env_profile = std::getenv("DB_PROFILE")) {
+            try {
+                db_profile = DatabaseProfile::byName(env_profile);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << "; using default " << db_profile.name << "\n";
+            }
+        }
+
+        // DB_PARTITION (none, day or week), DB_RETENTION_DAYS (numeric)
+        if (const char* env_partition = std::getenv("DB_PARTITION")) {
+            try {
+                partition_settings.period = PartitionSettings::periodByName(env_partition);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << "; using default none\n";
+            }
+        }
+        readPositiveEnv("DB_RETENTION_DAYS", 36500, partition_settings.retention_days);
+
+        // DB_SEAL_AFTER_S (numeric, 0 = never), DB_CHUNK_SAMPLES (numeric)
+        if (const char* env_seal = std::getenv("DB_SEAL_AFTER_S")) {
+            try {
+                long long candidate = std::stoll(env_seal);
+                if (candidate < 0) throw std::out_of_range("negative");
+                writer_settings.seal_after = std::chrono::seconds(candidate);
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid DB_SEAL_AFTER_S value (" << env_seal << "); using default "
+                          << writer_settings.seal_after.count() << "\n";
+            }
+        }
+        readPositiveEnv("DB_CHUNK_SAMPLES", 65535, writer_settings.chunk_samples);
+
+        // HTTP_GZIP_LEVEL (numeric, [0:9], 0 = off), HTTP_GZIP_MIN_BYTES (numeric)
+        if (const char* env_level = std::getenv("HTTP_GZIP_LEVEL")) {
+            try {
+                int candidate = std::stoi(env_level);
+                if (candidate < 0 || candidate > 9) throw std::out_of_range("not in [0:9]");
+                compression_settings.level = candidate;
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid HTTP_GZIP_LEVEL value (" << env_level << "); using default "
+                          << compression_settings.level << "\n";
+            }
+        }
+        readPositiveEnv("HTTP_GZIP_MIN_BYTES", 1 << 30, compression_settings.min_bytes);
+
+        // HTTP_THREADS (numeric), HTTP_QUEUE_DEPTH (numeric)
+        readPositiveEnv("HTTP_THREADS", 1024, pool_settings.threads);
+        readPositiveEnv("HTTP_QUEUE_DEPTH", 100000, pool_settings.max_queued);
+
+        // HTTP_MAX_LIMIT (numeric)
+        readPositiveEnv("HTTP_MAX_LIMIT", 10000000, query_settings.max_limit);
+
+        // STATS_MINUTES (numeric), STATS_HOURS (numeric)
+        readPositiveEnv("STATS_MINUTES", 525600, stats_settings.minutes);
+        readPositiveEnv("STATS_HOURS", 87600, stats_settings.hours);
+
+        // ALERT_RULES (JSON array), ALERT_RING (numeric)
+        if (const char* env_rules = std::getenv("ALERT_RULES")) {
+            try {
+                alert_settings.rules = parseAlertRules(nlohmann::json::parse(env_rules));
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid ALERT_RULES value (" << e.what() << "); no alert rules\n";
+            }
+        }
+        readPositiveEnv("ALERT_RING", 1 << 20, alert_settings.ring_size);
+
+        // TRACE (0 or 1), TRACE_EVENTS (numeric)
+        readFlagEnv("TRACE", trace_enabled);
+        readPositiveEnv("TRACE_EVENTS", 1 << 20, trace_events);
+        trace::setCapacity(trace_events);
+        trace::setEnabled(trace_enabled);
+
         /* Step 0.5: Get CLI aguments. If valid, should overwrite Environment variables */
         // Expected order: [Port-Name] [Baud-Rate] [HTTP-Host-Name] [HTTP-Port] [Database-Path]
         if (argc > 1) {
@@ -138,17 +266,54 @@ int main(int argc, char* argv[]) {
         std::cout << "HTTP Host Name: " << host_name << std::endl;
         std::cout << "HTTP Port: " << server_port << std::endl;
         std::cout << "Database Path: " << db_path << std::endl;
+        std::cout << "Database Profile: " << db_profile.name << std::endl;
+        std::cout << "Database Partitions: " << PartitionSettings::periodName(partition_settings.period)
+                  << ", retention " << partition_settings.retention_days << " days (0 = keep all)" << std::endl;
+        std::cout << "Serial VMIN/VTIME: " << static_cast<int>(line_settings.vmin) << "/"
+                  << static_cast<int>(line_settings.vtime) << std::endl;
+        std::cout << "Serial Low Latency: " << line_settings.low_latency
+                  << ", RTS/CTS: " << line_settings.rtscts << std::endl;
+        std::cout << "HTTP Workers: " << (pool_settings.threads == 0 ? "default" : std::to_string(pool_settings.threads))
+                  << ", queue " << pool_settings.max_queued << std::endl;
+        std::cout << "Alert Rules: " << alert_settings.rules.size() << ", ring " << alert_settings.ring_size << std::endl;
+        std::cout << "Tracing: " << (trace_enabled ? "on" : "off") << ", " << trace_events << " span(-s) per thread"
+                  << std::endl;
+        std::cout << "Statistics: " << stats_settings.minutes << " minute(-s), " << stats_settings.hours
+                  << " hour(-s)" << std::endl;
 
         /* Step 1: Initialize SerialInterface */
-        SerialInterface serial(port_name, baud_rate);
+        SerialInterface serial(port_name, baud_rate, line_settings);
         std::cout << "Serial port initialized: " << serial.getPortName() 
                   << (serial.isVirtual() ? " (virtual)" : " (physical)") << "\n";
 
-        /* Step 2: Initialize DatabaseManager */
-        DatabaseManager db_manager(db_path, serial.getPortName(), frequency, debug);
+        /* Step 2: Initialize DatabaseManager and the frame journal in front of it */
+        // Device configuration shared by the reader loop, the database manager and PUT /configure
+        ConfigStore config(DeviceConfig{frequency, debug});
+        std::unique_ptr<FrameJournal> journal;  // Declared first - has to outlive the writer thread of db_manager
+        DatabaseManager db_manager(db_path, serial.getPortName(), config, db_profile, partition_settings,
+                                   stats_settings);
+        if (journal_dir.empty()) {
+            journal_dir = db_manager.getPath() + ".frames";
+        }
+        journal = std::make_unique<FrameJournal>(journal_dir, static_cast<size_t>(journal_segment_mb) * 1024 * 1024);
+
+        // Store whatever the previous run journaled but didn't get into the database
+        auto replay = db_manager.replayJournal(*journal, 16384);
+        if (replay.samples > 0) {
+            std::cout << "Journal replay: " << replay.samples << " sample(-s) after record " << replay.from_seq
+                      << " in " << replay.duration_ms << " ms (" << static_cast<uint64_t>(replay.rate_per_s)
+                      << " samples/s)\n";
+        }
+        db_manager.startJournalWriter(*journal, replay.to_seq, writer_settings);
+        std::cout << "Frame journal: " << journal_dir << ", sync every " << writer_settings.sync_interval.count() << " ms\n";
+        if (writer_settings.seal_after.count() > 0) {
+            std::cout << "Samples older than " << writer_settings.seal_after.count() << " s are packed into chunks of "
+                      << writer_settings.chunk_samples << "\n";
+        }
 
         /* Step 3: Initialize HTTPServer */
-        HTTPServer server(host_name, server_port, db_manager, frequency, debug, serial);
+        HTTPServer server(host_name, server_port, db_manager, config, serial, compression_settings, pool_settings,
+                          query_settings, alert_settings);
 
         /* Step 4: Start the HTTP Server */
         server.start();
@@ -156,108 +321,185 @@ int main(int argc, char* argv[]) {
 
 
         /* Step 5: Serial Port Reading - Answers to requests from device and Messages */
+        // Port is non-blocking: poll for incoming data, and for POLLOUT while commands are queued.
+        // The wakeup eventfd lets HTTP threads interrupt the poll when they queue a command.
         char buffer[256];
         std::string data;
+        std::vector<std::string> frames;    // Complete frames of the last read
+        IngestStats& stats = server.ingest_stats_;
+        trace::setThreadName("serial reader");
+        SerialInterface::LineStats last_line_stats = serial.getLineStats();
+        auto next_line_check = std::chrono::steady_clock::now() + std::chrono::seconds(1);
         while (!stop_flag) {
+            // Once a second, report data the driver lost before we could read it
+            if (std::chrono::steady_clock::now() >= next_line_check) {
+                next_line_check += std::chrono::seconds(1);
+                auto line_stats = serial.getLineStats();
+                if (line_stats.icount_supported &&
+                    (line_stats.overrun != last_line_stats.overrun ||
+                     line_stats.buf_overrun != last_line_stats.buf_overrun ||
+                     line_stats.frame != last_line_stats.frame ||
+                     line_stats.parity != last_line_stats.parity)) {
+                    std::cerr << "Warning: UART errors in the last second - overrun: "
+                              << line_stats.overrun - last_line_stats.overrun
+                              << ", buffer overrun: " << line_stats.buf_overrun - last_line_stats.buf_overrun
+                              << ", frame: " << line_stats.frame - last_line_stats.frame
+                              << ", parity: " << line_stats.parity - last_line_stats.parity << "\n";
+                }
+                last_line_stats = line_stats;
+            }
+
+            struct pollfd fds[2];
+            fds[0].fd = serial.getFileDescriptor();
+            fds[0].events = POLLIN | (serial.hasPendingWrites() ? POLLOUT : 0);
+            fds[1].fd = serial.getWakeupDescriptor();
+            fds[1].events = POLLIN;
+            fds[0].revents = fds[1].revents = 0;
+
+            int ready = poll(fds, 2, 100);
+            if (ready < 0) {
+                if (errno != EINTR) {
+                    std::cerr << "Poll error: " << strerror(errno) << "\n";
+                }
+                continue;
+            }
+            if (fds[1].revents & POLLIN) {
+                serial.acknowledgeWakeup();
+            }
+            if (fds[0].revents & POLLOUT) {
+                trace::Span span("flush writes", "serial");
+                try {
+                    serial.flushWrites();
+                } catch (const std::exception& e) {
+                    std::cerr << "Serial write error: " << e.what() << "\n";
+                }
+            }
+            if (fds[0].revents & (POLLHUP | POLLERR)) {
+                // Other end of the port is gone (e.g. socat stopped) - don't spin on it
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            // On timeout read anyway: with VMIN > 1 the tail of a burst is only reported
+            // readable once VMIN bytes are buffered, this bounds its delay to one poll period
+            if (!(fds[0].revents & POLLIN) && ready != 0) {
+                continue;
+            }
+
             int bytesRead = read(serial.getFileDescriptor(), buffer, sizeof(buffer) - 1);
             if (bytesRead > 0) {
-                buffer[bytesRead] = '\0';
-                data += buffer;
-
-                size_t startPos = data.find('$');
-                while (startPos != std::string::npos) {
-                    data = data.substr(startPos);
-                    startPos = 0;
-
-                    size_t endPos = data.find('\n', startPos);
-                    if (endPos != std::string::npos) {
-                        std::string message = data.substr(startPos, endPos - startPos);
-                        data.erase(0, endPos + 1);
-
-                        if (message[0] == '$') {
-                            std::lock_guard<std::mutex> lock(server.cmd_mutex_); // Access server's cmd variables
-                            if (!server.pending_cmd_.empty()) {
-                                // Process as command response
-                                size_t first_comma = message.find(',');
-                                std::string received_prefix = message.substr(0, first_comma);
-                                std::string status;
-
-                                // Base case - we got invalid response to our prompt
-                                if (received_prefix != server.pending_cmd_){
-                                    server.cmd_response_ = "invalid_response - commands don't match";
-                                    server.cmd_response_received_ = true;
-                                    server.cmd_cv_.notify_one();
-                                    server.pending_cmd_.clear(); // Reset pending command
-                                    continue;
-                                }
-                                // CMD matches, get the status of the request
-                                if (received_prefix == "$2") {
-                                    size_t last_comma = message.find_last_of(',');
-                                    if (last_comma != std::string::npos && last_comma > first_comma) {
-                                        received_prefix = message.substr(0, last_comma);
-                                        status = message.substr(last_comma + 1);
-                                    }
-                                } else if (received_prefix == "$0" || received_prefix == "$1") {
-                                    if (first_comma != std::string::npos) {
-                                        status = message.substr(first_comma + 1);
-                                    }
-                                }
-
-                                status = trim(status);
-                                std::transform(status.begin(), status.end(), status.begin(), ::tolower);
+                trace::Span span("ingest", "serial");
+                data.append(buffer, bytesRead);
+                stats.bytes_read += bytesRead;
+
+                frames.clear();
+                stats.discarded_bytes += extractFrames(data, frames);
+                span.arg("frames", static_cast<int64_t>(frames.size()));
+                for (const std::string& message : frames) {
+                    stats.frames++;
+                    // Sensor frames still in flight when a command was sent are not its response
+                    size_t first_comma = message.find(',');
+                    std::string received_prefix = message.substr(0, first_comma);
+                    bool is_response = received_prefix == "$0" || received_prefix == "$1" || received_prefix == "$2";
+
+                    std::lock_guard<std::mutex> lock(server.cmd_mutex_); // Access server's cmd variables
+                    if (!server.pending_cmd_.empty() && is_response) {
+                        // Process as command response
+                        std::string status;
+
+                        // Base case - we got invalid response to our prompt ('$2,...' is compared by its '$2')
+                        if (received_prefix != server.pending_cmd_.substr(0, server.pending_cmd_.find(','))) {
+                            server.cmd_response_ = "invalid_response - commands don't match";
+                            server.cmd_response_received_ = true;
+                            server.recordCommandResponse(std::chrono::steady_clock::now());
+                            server.cmd_cv_.notify_one();
+                            server.pending_cmd_.clear(); // Reset pending command
+                            continue;
+                        }
+                        // CMD matches, get the status of the request
+                        if (received_prefix == "$2") {
+                            size_t last_comma = message.find_last_of(',');
+                            if (last_comma != std::string::npos && last_comma > first_comma) {
+                                received_prefix = message.substr(0, last_comma);
+                                status = message.substr(last_comma + 1);
+                            }
+                        } else if (received_prefix == "$0" || received_prefix == "$1") {
+                            if (first_comma != std::string::npos) {
+                                status = message.substr(first_comma + 1);
+                            }
+                        }
+
+                        status = trim(status);
+                        std::transform(status.begin(), status.end(), status.begin(), ::tolower);
                                 
-                                if (received_prefix == server.pending_cmd_) {
-                                    if (status == "ok") {
-                                        server.cmd_response_ = "ok";
-                                    } else if (status == "invalid command") {
-                                        server.cmd_response_ = "invalid command";
-                                    } else {
-                                        server.cmd_response_ = "invalid_response - undefined status";
-                                    }
-                                    server.cmd_response_received_ = true;
-                                    server.cmd_cv_.notify_one();
-                                    server.pending_cmd_.clear(); // Reset pending command
-                                }
-                            } else if (server.isReading()) {
-                                // Process as sensor data
-                                std::string sensor_message = message.substr(1); // Remove '$'
-                                float pressure, temperature, velocity;
-                                if (parseMessage(sensor_message, pressure, temperature, velocity)) {
-                                    __fp16 h_pressure = static_cast<__fp16>(pressure);
-                                    __fp16 h_temperature = static_cast<__fp16>(temperature);
-                                    __fp16 h_velocity = static_cast<__fp16>(velocity);
-
-                                    auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
-                                        std::chrono::system_clock::now().time_since_epoch()).count();
-
-                                    DatabaseManager::SensorData sensorData = {
-                                        h_pressure, h_temperature, h_velocity, timestamp
-                                    };
-                                    if (db_manager.storeSensorData(sensorData)) {
-                                        std::cout << "Data stored: P=" << pressure 
-                                                  << ", T=" << temperature 
-                                                  << ", V=" << velocity << "\n";
-                                    } else {
-                                        std::cerr << "Failed to store data\n";
-                                    }
-                                } else {
-                                    std::cerr << "Invalid message format: " << sensor_message << "\n";
-                                }
+                        if (received_prefix != server.pending_cmd_) {
+                            // '$2' echoed with other values than we sent
+                            server.cmd_response_ = "invalid_response - commands don't match";
+                        } else if (status == "ok") {
+                            server.cmd_response_ = "ok";
+                        } else if (status == "invalid command") {
+                            server.cmd_response_ = "invalid command";
+                        } else {
+                            server.cmd_response_ = "invalid_response - undefined status";
+                        }
+                        server.cmd_response_received_ = true;
+                        server.recordCommandResponse(std::chrono::steady_clock::now());
+                        server.cmd_cv_.notify_one();
+                        server.pending_cmd_.clear(); // Reset pending command
+                    } else if (server.isReading()) {
+                        // Process as sensor data
+                        std::string sensor_message = message.substr(1); // Remove '$'
+                        float pressure, temperature, velocity;
+                        if (parseMessage(sensor_message, pressure, temperature, velocity)) {
+                            auto now = std::chrono::steady_clock::now();
+                            int64_t mono_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                now.time_since_epoch()).count();
+                            int64_t wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::system_clock::now().time_since_epoch()).count();
+                            // Alerts before anything touches the disk
+                            server.alerts_.evaluate(mono_ns, wall_ms, pressure, temperature, velocity);
+
+                            // Journal first - SQLite is filled from the journal by the writer thread.
+                            // Tagged with the configuration as of this sample
+                            DeviceConfig device_config = config.load();
+                            FrameJournal::Record record;
+                            record.mono_ns = mono_ns;
+                            record.wall_s = wall_ms / 1000;
+                            record.frequency = device_config.frequency;
+                            record.debug = device_config.debug;
+                            record.pressure = fp16::fromFloat(pressure);
+                            record.temperature = fp16::fromFloat(temperature);
+                            record.velocity = fp16::fromFloat(velocity);
+                            record.frame = sensor_message;
+                            try {
+                                journal->append(std::move(record));
+                                stats.samples_journaled++;
+                                std::cout << "Data stored: P=" << pressure 
+                                          << ", T=" << temperature 
+                                          << ", V=" << velocity << "\n";
+                            } catch (const std::exception& e) {
+                                stats.journal_errors++;
+                                std::cerr << "Failed to store data: " << e.what() << "\n";
                             }
+                            int64_t append_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - now).count();
+                            stats.last_append_us = append_us;
+                            if (append_us > stats.max_append_us) stats.max_append_us = append_us;
+                        } else {
+                            stats.parse_errors++;
+                            std::cerr << "Invalid message format: " << sensor_message << "\n";
                         }
-                        startPos = data.find('$');
                     } else {
-                        break; // Incomplete message
+                        stats.ignored_frames++;
                     }
                 }
-            } else if (bytesRead < 0) {
+            } else if (bytesRead < 0 && errno != EAGAIN && errno != EINTR) {
                 std::cerr << "Read error: " << strerror(errno) << "\n";
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
 
         server.stop();
         std::cout << "HTTP server stopped\n";
+        db_manager.stopJournalWriter();
+        std::cout << "Journal writer stopped at record " << db_manager.getWriterStats().committed_seq << "\n";
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
         return 1;
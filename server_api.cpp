@@ -1,10 +1,20 @@
 #include "server_api.hpp"
+#include <cctype>
+#include <ctime>
+#include <limits>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
 
 // DatabaseManager Implementation
 DatabaseManager::DatabaseManager(const std::string& db_path, 
                                 const std::string& port_name,
-                                uint8_t& frequency, bool& debug)
-    : port_name_(port_name), frequency_(frequency), debug_(debug) {
+                                const ConfigStore& config,
+                                const DatabaseProfile& profile,
+                                const PartitionSettings& partitions,
+                                const StatsSettings& stats)
+    : profile_(profile), port_name_(port_name), config_(config), stats_settings_(stats),
+      partitions_(partitions) {
     
         const std::string default_db_path = "database.db";
     std::string final_db_path;
@@ -41,27 +51,122 @@ DatabaseManager::DatabaseManager(const std::string& db_path,
     if (sqlite3_open(final_db_path.c_str(), &db_) != SQLITE_OK) {
         throw std::runtime_error("Database error: " + std::string(sqlite3_errmsg(db_)));
     }
+    db_path_ = final_db_path;
+    std::string requested_journal_mode = profile_.journal_mode;
+    profile_.journal_mode = applyProfile(db_);
+    if (profile_.journal_mode != requested_journal_mode) {
+        std::cerr << "DatabaseManager: journal_mode " << requested_journal_mode << " not available, using "
+                  << profile_.journal_mode << "\n";
+    }
+    std::cout << "DatabaseManager: Profile " << profile_.name << " - journal_mode=" << profile_.journal_mode
+              << ", synchronous=" << profile_.synchronous << ", mmap_size=" << profile_.mmap_size
+              << ", cache_size=" << profile_.cache_size << ", page_size=" << profile_.page_size
+              << ", temp_store=" << profile_.temp_store << "\n";
     createTableIfNotExists();
+    migrateLegacyTable();
     prepareStatements();
 
+    // Step 4: Partitions - the one written to is opened with the first sample
+    if (partitions_.period != PartitionSettings::Period::None) {
+        partition_dir_ = db_path_ + (partitions_.period == PartitionSettings::Period::Day ? ".days" : ".weeks");
+        fs::create_directories(partition_dir_);
+        migrateIntoPartitions();
+        dropExpiredPartitions();
+        std::cout << "DatabaseManager: " << listPartitions().size() << " partition(-s) in " << partition_dir_ << "\n";
+    }
+
     std::cout << "Database initialized at: " << final_db_path << "\n";
 }
 
 DatabaseManager::~DatabaseManager() {
+    stopJournalWriter();
     sqlite3_finalize(insert_stmt_);
+    sqlite3_finalize(hwm_stmt_);
+    sqlite3_finalize(series_insert_stmt_);
+    sqlite3_finalize(series_select_stmt_);
+    if (write_db_ && write_db_ != db_) {
+        sqlite3_close(write_db_);
+    }
+    for (sqlite3* db : read_pool_) {
+        sqlite3_close(db);
+    }
     sqlite3_close(db_);
 }
 
+DatabaseProfile DatabaseProfile::byName(const std::string& name) {
+    DatabaseProfile profile;
+    profile.name = name;
+    if (name == "durable") {
+        profile.journal_mode = "DELETE";
+        profile.synchronous = "FULL";
+        profile.mmap_size = 0;
+        profile.cache_size = -2000;
+        profile.temp_store = "DEFAULT";
+    } else if (name == "throughput") {
+        profile.synchronous = "OFF";
+        profile.mmap_size = 256 * 1024 * 1024;
+        profile.cache_size = -64 * 1024;
+        profile.page_size = 8192;
+    } else if (name != "balanced") {
+        throw std::invalid_argument("Unknown database profile '" + name + "' (durable, balanced, throughput)");
+    }
+    return profile;
+}
+
+PartitionSettings::Period PartitionSettings::periodByName(const std::string& name) {
+    if (name == "none") return Period::None;
+    if (name == "day") return Period::Day;
+    if (name == "week") return Period::Week;
+    throw std::invalid_argument("Unknown partition period '" + name + "' (none, day, week)");
+}
+
+std::string PartitionSettings::periodName(Period period) {
+    switch (period) {
+        case Period::Day: return "day";
+        case Period::Week: return "week";
+        default: return "none";
+    }
+}
+
+// page_size first - it has to be set before anything is written and can't change in WAL mode
+std::string DatabaseManager::applyProfile(sqlite3* db) {
+    const std::string sql =
+        "PRAGMA page_size = " + std::to_string(profile_.page_size) + ";"
+        "PRAGMA synchronous = " + profile_.synchronous + ";"
+        "PRAGMA mmap_size = " + std::to_string(profile_.mmap_size) + ";"
+        "PRAGMA cache_size = " + std::to_string(profile_.cache_size) + ";"
+        "PRAGMA temp_store = " + profile_.temp_store + ";";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::string error = "Failed to apply database profile '" + profile_.name + "': " + std::string(err_msg);
+        sqlite3_free(err_msg);
+        throw std::runtime_error(error);
+    }
+
+    // SQLite answers with the mode it actually uses, e.g. 'delete' if WAL isn't possible here
+    std::string journal_mode = profile_.journal_mode;
+    sqlite3_stmt* stmt;
+    std::string journal_sql = "PRAGMA journal_mode = " + journal_mode + ";";
+    if (sqlite3_prepare_v2(db, journal_sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to set journal_mode: " + std::string(sqlite3_errmsg(db)));
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        journal_mode = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        std::transform(journal_mode.begin(), journal_mode.end(), journal_mode.begin(), ::toupper);
+    }
+    sqlite3_finalize(stmt);
+    return journal_mode;
+}
+
 void DatabaseManager::createTableIfNotExists() {
     const char* sql = 
-        "CREATE TABLE IF NOT EXISTS SensorData ("
+        // One row per (port, frequency, debug) - samples refer to it by Id
+        "CREATE TABLE IF NOT EXISTS Series ("
+        "Id INTEGER PRIMARY KEY, "
         "Port TEXT NOT NULL, "
         "Frequency INTEGER NOT NULL, "
         "Debug INTEGER NOT NULL CHECK (Debug IN (0, 1)), "
-        "Pressure BLOB, "
-        "Temperature BLOB, "
-        "Velocity BLOB, "
-        "Timestamp INTEGER NOT NULL);";
+        "UNIQUE (Port, Frequency, Debug));";
 
     char* err_msg = nullptr;
     if (sqlite3_exec(db_, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
@@ -69,21 +174,153 @@ void DatabaseManager::createTableIfNotExists() {
         sqlite3_free(err_msg);
         throw std::runtime_error(error);
     }
+    createSampleTables(db_);
     std::cout << "DatabaseManager: Table created (or verified) successfully.\n";
 }
 
+// In DB_PATH, and in every partition file
+void DatabaseManager::createSampleTables(sqlite3* db) {
+    const char* sql =
+        "CREATE TABLE IF NOT EXISTS Samples ("
+        "SeriesId INTEGER NOT NULL, "                    // Series.Id in DB_PATH
+        "Timestamp INTEGER NOT NULL, "
+        "Pressure BLOB, "
+        "Temperature BLOB, "
+        "Velocity BLOB);"
+        "CREATE INDEX IF NOT EXISTS SamplesBySeriesTime ON Samples (SeriesId, Timestamp);"
+        // Sealed samples, compressed - see chunk_codec.hpp
+        "CREATE TABLE IF NOT EXISTS Chunks ("
+        "SeriesId INTEGER NOT NULL, "
+        "FirstTimestamp INTEGER NOT NULL, "
+        "LastTimestamp INTEGER NOT NULL, "
+        "Count INTEGER NOT NULL, "
+        "Data BLOB NOT NULL);"
+        "CREATE INDEX IF NOT EXISTS ChunksBySeriesTime ON Chunks (SeriesId, LastTimestamp);"
+        // High-water mark: last frame journal record stored in Samples.
+        // Updated in the same transaction as the samples, so it's never ahead of or behind them.
+        "CREATE TABLE IF NOT EXISTS JournalState ("
+        "Id INTEGER PRIMARY KEY CHECK (Id = 0), "
+        "CommittedSeq INTEGER NOT NULL);";
+
+    char* err_msg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::string error = "SQL error: " + std::string(err_msg);
+        sqlite3_free(err_msg);
+        throw std::runtime_error(error);
+    }
+}
+
+// Databases of older versions have a single SensorData table with Port, Frequency and Debug in
+// every row. Moves its rows into Series / Samples, in one transaction, and drops it
+void DatabaseManager::migrateLegacyTable() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'SensorData';",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+    }
+    bool legacy = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (!legacy) return;
+
+    auto start = std::chrono::steady_clock::now();
+    const char* sql =
+        "BEGIN;"
+        "INSERT OR IGNORE INTO Series (Port, Frequency, Debug) "
+        "SELECT DISTINCT Port, Frequency, Debug FROM SensorData;"
+        "INSERT INTO Samples (SeriesId, Timestamp, Pressure, Temperature, Velocity) "
+        "SELECT Series.Id, SensorData.Timestamp, SensorData.Pressure, SensorData.Temperature, SensorData.Velocity "
+        "FROM SensorData JOIN Series ON Series.Port = SensorData.Port AND Series.Frequency = SensorData.Frequency "
+        "AND Series.Debug = SensorData.Debug ORDER BY SensorData.rowid;"
+        "DROP TABLE SensorData;"
+        "COMMIT;";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::string error = "Migration of SensorData failed: " + std::string(err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw std::runtime_error(error);
+    }
+    std::cout << "DatabaseManager: Migrated " << sqlite3_changes(db_) << " sample(-s) from SensorData in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+              << " ms\n";
+}
+
 // Bind Insertion Statement 
 void DatabaseManager::prepareStatements() {
+    write_db_ = db_;
+    prepareWriteStatements(db_, insert_stmt_, hwm_stmt_);
+
+    const char* series_insert_sql = "INSERT OR IGNORE INTO Series (Port, Frequency, Debug) VALUES (?, ?, ?);";
+    const char* series_select_sql = "SELECT Id FROM Series WHERE Port = ? AND Frequency = ? AND Debug = ?;";
+    if (sqlite3_prepare_v2(db_, series_insert_sql, -1, &series_insert_stmt_, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db_, series_select_sql, -1, &series_select_stmt_, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare series statements: " + 
+                                std::string(sqlite3_errmsg(db_)));
+    }
+}
+
+// Statements of the journal writer, on DB_PATH or on a partition
+void DatabaseManager::prepareWriteStatements(sqlite3* db, sqlite3_stmt*& insert, sqlite3_stmt*& hwm) {
     const char* sql = 
-        "INSERT INTO SensorData (Port, Frequency, Debug, Pressure, Temperature, Velocity, Timestamp) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?);";
+        "INSERT INTO Samples (SeriesId, Pressure, Temperature, Velocity, Timestamp) "
+        "VALUES (?, ?, ?, ?, ?);";
     
-    if (sqlite3_prepare_v2(db_, sql, -1, &insert_stmt_, nullptr) != SQLITE_OK) {
+    if (sqlite3_prepare_v2(db, sql, -1, &insert, nullptr) != SQLITE_OK) {
         throw std::runtime_error("Failed to prepare insert statement: " + 
-                                std::string(sqlite3_errmsg(db_)));
+                                std::string(sqlite3_errmsg(db)));
+    }
+
+    const char* hwm_sql = "INSERT OR REPLACE INTO JournalState (Id, CommittedSeq) VALUES (0, ?);";
+    if (sqlite3_prepare_v2(db, hwm_sql, -1, &hwm, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(insert);
+        insert = nullptr;
+        throw std::runtime_error("Failed to prepare high-water mark statement: " + 
+                                std::string(sqlite3_errmsg(db)));
     }
 }
 
+// Looked up once per (frequency, debug), then served from the cache. Series rows are never deleted,
+// so a cached id stays valid. Called outside of transactions only - a rolled back insert would
+// leave a dangling id in the cache. "No series yet" is cached as 0 as well, so reads (ETags) of a
+// configuration nothing was stored with don't query either - only this manager adds series to
+// DB_PATH, and adding one replaces the 0
+int64_t DatabaseManager::seriesId(uint8_t frequency, bool debug, bool create) {
+    const uint32_t key = (static_cast<uint32_t>(frequency) << 1) | (debug ? 1 : 0);
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    auto it = series_ids_.find(key);
+    if (it != series_ids_.end() && (it->second != 0 || !create)) {
+        return it->second;
+    }
+
+    if (create) {
+        sqlite3_reset(series_insert_stmt_);
+        sqlite3_bind_text(series_insert_stmt_, 1, port_name_.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(series_insert_stmt_, 2, frequency);
+        sqlite3_bind_int(series_insert_stmt_, 3, debug ? 1 : 0);
+        int rc = sqlite3_step(series_insert_stmt_);
+        sqlite3_reset(series_insert_stmt_);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "DatabaseManager: Failed to add series: " << sqlite3_errmsg(db_) << "\n";
+            return 0;
+        }
+    }
+    sqlite3_reset(series_select_stmt_);
+    sqlite3_bind_text(series_select_stmt_, 1, port_name_.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(series_select_stmt_, 2, frequency);
+    sqlite3_bind_int(series_select_stmt_, 3, debug ? 1 : 0);
+    int64_t id = 0;
+    if (sqlite3_step(series_select_stmt_) == SQLITE_ROW) {
+        id = sqlite3_column_int64(series_select_stmt_, 0);
+    }
+    sqlite3_reset(series_select_stmt_);
+    series_ids_[key] = id;
+    return id;
+}
+
+int64_t DatabaseManager::seriesId(const DeviceConfig& config, bool create) {
+    return seriesId(config.frequency, config.debug, create);
+}
+
 // Validate if a path is in a restricted directory
 bool DatabaseManager::isPathRestricted(const fs::path& path) {
     try {
@@ -101,6 +338,7 @@ bool DatabaseManager::isPathRestricted(const fs::path& path) {
         const std::string parent_path = normalize(canonical_parent);
 
         for (const auto& restricted : restricted_dirs) {
+            if (!fs::exists(restricted)) continue; // e.g. no /snap - canonical() would throw
             const fs::path canonical_restricted = fs::canonical(restricted);
             const std::string restricted_path = normalize(canonical_restricted);
 
@@ -117,70 +355,1362 @@ bool DatabaseManager::isPathRestricted(const fs::path& path) {
 }
 
 bool DatabaseManager::storeSensorData(const SensorData& data) {
+    int64_t series_id = seriesId(config_.load(), true);
+    if (series_id == 0) {
+        return false;
+    }
+    if (partitions_.period != PartitionSettings::Period::None) {
+        try {
+            openPartition(partitionStart(data.timestamp));
+        } catch (const std::exception& e) {
+            std::cerr << "DatabaseManager: " << e.what() << "\n";
+            return false;
+        }
+    }
     sqlite3_reset(insert_stmt_);
     
-    sqlite3_bind_text(insert_stmt_, 1, port_name_.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(insert_stmt_, 2, frequency_);
-    sqlite3_bind_int(insert_stmt_, 3, debug_ ? 1 : 0);
-    sqlite3_bind_blob(insert_stmt_, 4, &data.pressure, sizeof(__fp16), SQLITE_STATIC);
-    sqlite3_bind_blob(insert_stmt_, 5, &data.temperature, sizeof(__fp16), SQLITE_STATIC);
-    sqlite3_bind_blob(insert_stmt_, 6, &data.velocity, sizeof(__fp16), SQLITE_STATIC);
-    sqlite3_bind_int64(insert_stmt_, 7, data.timestamp);
+    sqlite3_bind_int64(insert_stmt_, 1, series_id);
+    sqlite3_bind_blob(insert_stmt_, 2, &data.pressure, sizeof(uint16_t), SQLITE_STATIC);
+    sqlite3_bind_blob(insert_stmt_, 3, &data.temperature, sizeof(uint16_t), SQLITE_STATIC);
+    sqlite3_bind_blob(insert_stmt_, 4, &data.velocity, sizeof(uint16_t), SQLITE_STATIC);
+    sqlite3_bind_int64(insert_stmt_, 5, data.timestamp);
+
+    if (sqlite3_step(insert_stmt_) != SQLITE_DONE) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        addToStats(series_id, data.timestamp, data.pressure, data.temperature, data.velocity);
+    }
+    bumpGenerations({series_id}, 0, 1);
+    return true;
+}
+
+// Stores records exactly as they were journaled - with the configuration at ingest time - and
+// moves the high-water mark to the last of them. All or nothing: on failure the transaction is
+// rolled back and the records can be retried.
+// With partitions, a batch crossing midnight (or the week boundary) is one transaction per partition,
+// each with its own high-water mark. If a later one fails, the retry skips what's already stored.
+bool DatabaseManager::storeJournalRecords(const std::vector<FrameJournal::Record>& records) {
+    // Series ids before BEGIN - see seriesId(). A batch nearly always has a single configuration
+    std::vector<int64_t> series(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        const auto& record = records[i];
+        if (i > 0 && record.frequency == records[i - 1].frequency && record.debug == records[i - 1].debug) {
+            series[i] = series[i - 1];
+        } else if ((series[i] = seriesId(record.frequency, record.debug, true)) == 0) {
+            return false;
+        }
+    }
+
+    if (partitions_.period == PartitionSettings::Period::None) {
+        return storeRecordsIn(records, series, 0, records.size());
+    }
+    size_t begin = 0;
+    while (begin < records.size() && records[begin].seq <= stored_seq_) {
+        begin++;
+    }
+    while (begin < records.size()) {
+        const int64_t start = partitionStart(records[begin].wall_s);
+        size_t end = begin + 1;
+        while (end < records.size() && partitionStart(records[end].wall_s) == start) {
+            end++;
+        }
+        try {
+            openPartition(start);
+        } catch (const std::exception& e) {
+            std::cerr << "DatabaseManager: " << e.what() << "\n";
+            return false;
+        }
+        if (!storeRecordsIn(records, series, begin, end)) {
+            return false;
+        }
+        stored_seq_ = records[end - 1].seq;
+        begin = end;
+    }
+    return true;
+}
+
+bool DatabaseManager::storeRecordsIn(const std::vector<FrameJournal::Record>& records,
+                                     const std::vector<int64_t>& series, size_t begin, size_t end) {
+    if (sqlite3_exec(write_db_, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    for (size_t i = begin; i < end; i++) {
+        const auto& record = records[i];
+        sqlite3_reset(insert_stmt_);
+        sqlite3_bind_int64(insert_stmt_, 1, series[i]);
+        sqlite3_bind_blob(insert_stmt_, 2, &record.pressure, sizeof(uint16_t), SQLITE_STATIC);
+        sqlite3_bind_blob(insert_stmt_, 3, &record.temperature, sizeof(uint16_t), SQLITE_STATIC);
+        sqlite3_bind_blob(insert_stmt_, 4, &record.velocity, sizeof(uint16_t), SQLITE_STATIC);
+        sqlite3_bind_int64(insert_stmt_, 5, record.wall_s);
+        if (sqlite3_step(insert_stmt_) != SQLITE_DONE) {
+            std::cerr << "DatabaseManager: Insert of journal record " << record.seq << " failed: "
+                      << sqlite3_errmsg(write_db_) << "\n";
+            sqlite3_reset(insert_stmt_);
+            sqlite3_exec(write_db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+            return false;
+        }
+    }
+    sqlite3_reset(insert_stmt_);
+    if (end > begin) {
+        sqlite3_reset(hwm_stmt_);
+        sqlite3_bind_int64(hwm_stmt_, 1, static_cast<sqlite3_int64>(records[end - 1].seq));
+        int rc = sqlite3_step(hwm_stmt_);
+        sqlite3_reset(hwm_stmt_);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "DatabaseManager: Failed to update high-water mark: " << sqlite3_errmsg(write_db_) << "\n";
+            sqlite3_exec(write_db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+            return false;
+        }
+    }
+    if (sqlite3_exec(write_db_, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "DatabaseManager: Commit failed: " << sqlite3_errmsg(write_db_) << "\n";
+        sqlite3_exec(write_db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (size_t i = begin; i < end; i++) {
+            const auto& record = records[i];
+            addToStats(series[i], record.wall_s, record.pressure, record.temperature, record.velocity);
+        }
+    }
+    bumpGenerations(series, begin, end);
+    return true;
+}
+
+// After the commit: a reader that sees the new generation sees the new samples as well
+void DatabaseManager::bumpGenerations(const std::vector<int64_t>& series, size_t begin, size_t end) {
+    std::lock_guard<std::mutex> lock(generation_mutex_);
+    for (size_t i = begin; i < end; i++) {
+        if (i > begin && series[i] == series[i - 1]) continue;
+        generations_[series[i]] = ++last_generation_;
+    }
+}
+
+void DatabaseManager::addToStats(int64_t series_id, int64_t timestamp, uint16_t pressure, uint16_t temperature,
+                                 uint16_t velocity) {
+    auto it = stats_.find(series_id);
+    if (it == stats_.end()) {
+        it = stats_.emplace(series_id, sketch::TimeWindows(stats_settings_.minutes, stats_settings_.hours,
+                                                           stats_settings_.relative_accuracy)).first;
+    }
+    it->second.add(timestamp, fp16::toFloat(pressure), fp16::toFloat(temperature), fp16::toFloat(velocity));
+}
+
+sketch::TimeWindows::Result DatabaseManager::getStats(int64_t from, int64_t to, int64_t& oldest) {
+    int64_t series_id = seriesId(config_.load(), false);
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    auto it = stats_.find(series_id);
+    if (series_id == 0 || it == stats_.end()) {
+        oldest = 0;
+        return sketch::TimeWindows(stats_settings_.minutes, stats_settings_.hours,
+                                   stats_settings_.relative_accuracy).query(from, to);
+    }
+    oldest = it->second.oldest();
+    return it->second.query(from, to);
+}
+
+const StatsSettings& DatabaseManager::getStatsSettings() const {
+    return stats_settings_;
+}
+
+size_t DatabaseManager::getStatsMemory() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    size_t bytes = 0;
+    for (const auto& [series_id, windows] : stats_) {
+        bytes += windows.memoryBytes();
+    }
+    return bytes;
+}
+
+uint64_t DatabaseManager::getGeneration() {
+    int64_t series_id = seriesId(config_.load(), false);
+    std::lock_guard<std::mutex> lock(generation_mutex_);
+    auto it = generations_.find(series_id);
+    return std::max(it != generations_.end() ? it->second : 0, retention_generation_);
+}
+
+// With partitions every file has its own mark - the highest one counts (after a clock step back
+// the newest samples can be in an older partition)
+uint64_t DatabaseManager::getCommittedSeq() {
+    auto readSeq = [](sqlite3* db) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT CommittedSeq FROM JournalState WHERE Id = 0;", -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+        }
+        uint64_t seq = 0;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            seq = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        return seq;
+    };
+
+    uint64_t seq = readSeq(db_);
+    if (partitions_.period != PartitionSettings::Period::None) {
+        for (int64_t start : listPartitions()) {
+            sqlite3* db;
+            if (sqlite3_open_v2(partitionPath(start).c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+                std::string error = "Failed to open partition " + partitionPath(start).string() + ": " + sqlite3_errmsg(db);
+                sqlite3_close(db);
+                throw std::runtime_error(error);
+            }
+            try {
+                seq = std::max(seq, readSeq(db));
+            } catch (...) {
+                sqlite3_close(db);
+                throw;
+            }
+            sqlite3_close(db);
+        }
+        stored_seq_ = seq;
+    }
+    return seq;
+}
+
+// Crash recovery: stores every journal record after the high-water mark, in large batches.
+// Runs before the writer thread starts, so nothing else uses the connection.
+DatabaseManager::ReplayStats DatabaseManager::replayJournal(FrameJournal& journal, size_t batch_size) {
+    ReplayStats stats;
+    stats.from_seq = getCommittedSeq();
+    stats.to_seq = stats.from_seq;
+    if (journal.lastSeq() < stats.from_seq) {
+        // Journal was removed or is older than the database - keep sequence numbers unique
+        std::cerr << "DatabaseManager: Journal ends at " << journal.lastSeq() << " but database has "
+                  << stats.from_seq << " stored, continuing after " << stats.from_seq << "\n";
+        journal.skipTo(stats.from_seq);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<FrameJournal::Record> batch;
+    batch.reserve(batch_size);
+    while (journal.readAfter(stats.to_seq, batch_size, batch) > 0) {
+        if (!storeJournalRecords(batch)) {
+            throw std::runtime_error("Journal replay failed after record " + std::to_string(stats.to_seq) +
+                                     ": " + std::string(sqlite3_errmsg(db_)));
+        }
+        stats.to_seq = batch.back().seq;
+        stats.samples += batch.size();
+    }
+    stats.duration_ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+        std::chrono::steady_clock::now() - start).count();
+    stats.rate_per_s = stats.duration_ms > 0 ? stats.samples / (stats.duration_ms / 1000.0) : 0.0;
+
+    std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+    replay_stats_ = stats;
+    return stats;
+}
+
+DatabaseManager::ReplayStats DatabaseManager::getReplayStats() const {
+    std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+    return replay_stats_;
+}
+
+void DatabaseManager::startJournalWriter(FrameJournal& journal, uint64_t committed_seq,
+                                         const JournalWriterSettings& settings) {
+    stopJournalWriter();
+    journal_ = &journal;
+    writer_stop_ = false;
+    seal_chunk_samples_ = settings.seal_after.count() > 0 ? settings.chunk_samples : 0;
+    {
+        std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+        writer_stats_.committed_seq = committed_seq;
+    }
+    writer_thread_ = std::thread([this, committed_seq, settings]() {
+        writerLoop(committed_seq, settings);
+    });
+}
+
+void DatabaseManager::stopJournalWriter() {
+    if (!writer_thread_.joinable()) return;
+    writer_stop_ = true;
+    journal_->wakeWaiters();
+    writer_thread_.join();
+}
+
+// Moves records from the journal into SQLite in batches. Keeps running behind the serial reader,
+// so a slow commit only grows the backlog in the journal instead of stalling ingest.
+// Also owns the journal's housekeeping: periodic msync() and dropping stored segments.
+void DatabaseManager::writerLoop(uint64_t committed_seq, JournalWriterSettings settings) {
+    trace::setThreadName("journal writer");
+    std::vector<FrameJournal::Record> batch;
+    batch.reserve(settings.batch_size);
+    auto next_sync = std::chrono::steady_clock::now() + settings.sync_interval;
+    auto next_seal = std::chrono::steady_clock::now();
+
+    while (true) {
+        bool stopping = writer_stop_.load();
+        if (!stopping && journal_->lastSeq() <= committed_seq) {
+            journal_->waitForRecords(committed_seq, settings.sync_interval);
+        }
+
+        bool failed = false;
+        if (journal_->readAfter(committed_seq, settings.batch_size, batch) > 0) {
+            if (batch.front().seq != committed_seq + 1) {
+                std::cerr << "DatabaseManager: Journal records " << committed_seq + 1 << "-"
+                          << batch.front().seq - 1 << " are missing, skipping them\n";
+            }
+            auto commit_start = std::chrono::steady_clock::now();
+            trace::Span span("commit", "storage");
+            span.arg("samples", static_cast<int64_t>(batch.size()));
+            bool stored = storeJournalRecords(batch);
+            int64_t commit_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - commit_start).count();
+
+            std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+            if (stored) {
+                committed_seq = batch.back().seq;
+                writer_stats_.committed_seq = committed_seq;
+                writer_stats_.batches++;
+                writer_stats_.samples += batch.size();
+                writer_stats_.last_batch_size = batch.size();
+                writer_stats_.last_commit_us = commit_us;
+                writer_stats_.max_commit_us = std::max(writer_stats_.max_commit_us, commit_us);
+            } else {
+                writer_stats_.commit_errors++;
+                failed = true;
+            }
+        } else if (stopping) {
+            break; // Everything in the journal is stored
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_sync || stopping) {
+            next_sync = now + settings.sync_interval;
+            trace::Span span("journal sync", "storage");
+            journal_->sync();
+            journal_->dropSegmentsUpTo(committed_seq, settings.retain_segments);
+        }
+
+        // Once a minute: pack what's older than seal_after into chunks
+        if (settings.seal_after.count() > 0 && now >= next_seal && !stopping && !failed) {
+            next_seal = now + std::chrono::minutes(1);
+            trace::Span span("seal chunks", "storage");
+            try {
+                span.arg("samples", static_cast<int64_t>(
+                    sealChunks(static_cast<int64_t>(time(nullptr)) - settings.seal_after.count(), settings.chunk_samples)));
+            } catch (const std::exception& e) {
+                std::cerr << "DatabaseManager: " << e.what() << "\n";
+            }
+        }
+
+        if (failed) {
+            if (stopping) {
+                std::cerr << "DatabaseManager: Stopping with " << journal_->lastSeq() - committed_seq
+                          << " record(-s) not stored, they stay in the journal\n";
+                break;
+            }
+            // E.g. database locked by another process - back off instead of spinning
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    journal_->sync();
+}
+
+DatabaseManager::WriterStats DatabaseManager::getWriterStats() const {
+    WriterStats stats;
+    {
+        std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+        stats = writer_stats_;
+    }
+    if (journal_) {
+        stats.journal = journal_->getStats();
+    }
+    return stats;
+}
+
+const std::string& DatabaseManager::getPath() const { return db_path_; }
+const DatabaseProfile& DatabaseManager::getProfile() const { return profile_; }
 
-    return sqlite3_step(insert_stmt_) == SQLITE_DONE;
+std::vector<DatabaseManager::SensorData> DatabaseManager::getLastNMessages(int n, QueryCost* cost) {
+    return getMessages(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), n, cost);
 }
 
-std::vector<DatabaseManager::SensorData> DatabaseManager::getLastNMessages(int n) {
+std::vector<DatabaseManager::SensorData> DatabaseManager::getMessages(int64_t from, int64_t to, int n, QueryCost* cost) {
     std::vector<SensorData> result;
-    
-    std::string sql = "SELECT Pressure, Temperature, Velocity, Timestamp FROM SensorData "
-                    "WHERE Port = ? AND Frequency = ? AND Debug = ? ORDER BY Timestamp DESC LIMIT ?;";
+    int64_t series_id = seriesId(config_.load(), false);
+    if (series_id == 0) {
+        return result;                                   // Nothing stored with this configuration yet
+    }
+    if (partitions_.period != PartitionSettings::Period::None) {
+        return queryPartitions(series_id, from, to, n, cost);
+    }
+
+    // We are probably going to have more calls that actually request the existing data
+    // So the reserve should help us speed up the push_backs below. Not beyond what a query
+    // usually returns though - n comes from the client
+    result.reserve(std::min(n, 1 << 16));
+    sqlite3* db = acquireReadConnection();
+    try {
+        selectSamples(db, "", series_id, from, to, n, result, cost);
+    } catch (...) {
+        sqlite3_close(db);
+        throw;
+    }
+    releaseReadConnection(db);
+    return result;
+}
+
+// Appends up to n samples of the series, newest first: the rows in Samples, merged with the
+// sealed chunks. Walks the (SeriesId, Timestamp) index backwards - stops after n rows. Chunks are
+// decoded one at a time, newest first, and only while they can hold one of the n newest samples
+void DatabaseManager::selectSamples(sqlite3* db, const std::string& schema, int64_t series_id,
+                                    int64_t from, int64_t to, int n, std::vector<SensorData>& result,
+                                    QueryCost* cost) {
+    if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to begin read: " + std::string(sqlite3_errmsg(db)));
+    }
+    try {
+        selectSamplesIn(db, schema, series_id, from, to, n, result, cost);
+    } catch (...) {
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+        throw;
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+void DatabaseManager::selectSamplesIn(sqlite3* db, const std::string& schema, int64_t series_id,
+                                      int64_t from, int64_t to, int n, std::vector<SensorData>& result,
+                                      QueryCost* cost) {
+    QueryCost spent;
+    const size_t first = result.size();
+    std::string sql = "SELECT Pressure, Temperature, Velocity, Timestamp FROM " + schema + "Samples"
+                      " WHERE SeriesId = ? AND Timestamp BETWEEN ? AND ? ORDER BY Timestamp DESC LIMIT ?;";
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
     if (rc != SQLITE_OK) {
-        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
     }
-    sqlite3_bind_text(stmt, 1, port_name_.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, frequency_);
-    sqlite3_bind_int(stmt, 3, (debug_ == true) ? 1 : 0);
+    sqlite3_bind_int64(stmt, 1, series_id);
+    sqlite3_bind_int64(stmt, 2, from);
+    sqlite3_bind_int64(stmt, 3, to);
     sqlite3_bind_int(stmt, 4, n);
 
-    // We are probably going to have more calls that actually request the existing data
-    // So the reserve should help us speed up the push_backs below. 
-    result.reserve(n); 
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        spent.rows_scanned++;
         SensorData data;
         const void* blobPressure = sqlite3_column_blob(stmt, 0);
         const void* blobTemperature = sqlite3_column_blob(stmt, 1);
         const void* blobVelocity = sqlite3_column_blob(stmt, 2);
-        if (blobPressure && blobTemperature && blobVelocity) {
-            data.pressure = *reinterpret_cast<const __fp16*>(blobPressure);
-            data.temperature = *reinterpret_cast<const __fp16*>(blobTemperature);
-            data.velocity = *reinterpret_cast<const __fp16*>(blobVelocity);
+        if (blobPressure && blobTemperature && blobVelocity && sqlite3_column_bytes(stmt, 0) == sizeof(uint16_t) &&
+            sqlite3_column_bytes(stmt, 1) == sizeof(uint16_t) && sqlite3_column_bytes(stmt, 2) == sizeof(uint16_t)) {
+            std::memcpy(&data.pressure, blobPressure, sizeof(uint16_t));
+            std::memcpy(&data.temperature, blobTemperature, sizeof(uint16_t));
+            std::memcpy(&data.velocity, blobVelocity, sizeof(uint16_t));
             data.timestamp = sqlite3_column_int64(stmt, 3);
             result.push_back(data);
         }
     }
     if (rc != SQLITE_DONE) {
         sqlite3_finalize(stmt);
-        throw std::runtime_error("Query error: " + std::string(sqlite3_errmsg(db_)));
+        throw std::runtime_error("Query error: " + std::string(sqlite3_errmsg(db)));
+    }
+    sqlite3_finalize(stmt);
+
+    sql = "SELECT LastTimestamp, Data FROM " + schema + "Chunks"
+          " WHERE SeriesId = ? AND LastTimestamp >= ? AND FirstTimestamp <= ? ORDER BY LastTimestamp DESC;";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+    sqlite3_bind_int64(stmt, 1, series_id);
+    sqlite3_bind_int64(stmt, 2, from);
+    sqlite3_bind_int64(stmt, 3, to);
+
+    auto newer = [](const SensorData& a, const SensorData& b) { return a.timestamp > b.timestamp; };
+    std::vector<chunk::Sample> decoded;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (result.size() - first >= static_cast<size_t>(n) &&
+            sqlite3_column_int64(stmt, 0) < result[first + n - 1].timestamp) {
+            break;                                       // Everything in here is older than what we have
+        }
+        decoded.clear();
+        chunk::decode(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 1)),
+                      static_cast<size_t>(sqlite3_column_bytes(stmt, 1)), decoded);
+        spent.rows_scanned++;
+        spent.chunks_decoded++;
+        spent.samples_decoded += decoded.size();
+        for (auto it = decoded.rbegin(); it != decoded.rend(); ++it) {
+            if (it->timestamp >= from && it->timestamp <= to) {
+                result.push_back({it->pressure, it->temperature, it->velocity, it->timestamp});
+            }
+        }
+        std::stable_sort(result.begin() + first, result.end(), newer);
+        if (result.size() - first > static_cast<size_t>(n)) {
+            result.resize(first + n);
+        }
     }
     sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        throw std::runtime_error("Query error: " + std::string(sqlite3_errmsg(db)));
+    }
+    if (cost) {
+        cost->rows_scanned += spent.rows_scanned;
+        cost->chunks_decoded += spent.chunks_decoded;
+        cost->samples_decoded += spent.samples_decoded;
+    }
+}
+
+// Rows are read in time order and packed as they come, so memory stays at one chunk. Series ids
+// are in DB_PATH, the samples in write_db_
+size_t DatabaseManager::sealChunks(int64_t before, size_t chunk_samples) {
+    std::vector<int64_t> series;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT Id FROM Series;", -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        series.push_back(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    auto start_time = std::chrono::steady_clock::now();
+    sqlite3_stmt* select = nullptr;
+    sqlite3_stmt* insert = nullptr;
+    sqlite3_stmt* erase = nullptr;
+    auto fail = [&](const std::string& what) {
+        std::string error = what + ": " + sqlite3_errmsg(write_db_);
+        sqlite3_finalize(select);
+        sqlite3_finalize(insert);
+        sqlite3_finalize(erase);
+        sqlite3_exec(write_db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw std::runtime_error(error);
+    };
+    if (sqlite3_exec(write_db_, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to begin sealing: " + std::string(sqlite3_errmsg(write_db_)));
+    }
+    if (sqlite3_prepare_v2(write_db_, "SELECT Timestamp, Pressure, Temperature, Velocity FROM Samples "
+                           "WHERE SeriesId = ? AND Timestamp < ? ORDER BY Timestamp;", -1, &select, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(write_db_, "INSERT INTO Chunks (SeriesId, FirstTimestamp, LastTimestamp, Count, Data) "
+                           "VALUES (?, ?, ?, ?, ?);", -1, &insert, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(write_db_, "DELETE FROM Samples WHERE SeriesId = ? AND Timestamp < ?;",
+                           -1, &erase, nullptr) != SQLITE_OK) {
+        fail("Failed to prepare sealing statements");
+    }
+
+    size_t sealed = 0, chunks = 0;
+    std::vector<chunk::Sample> pending;
+    pending.reserve(chunk_samples);
+    for (int64_t series_id : series) {
+        auto flush = [&]() {
+            if (pending.empty()) return;
+            std::vector<uint8_t> data = chunk::encode(pending.data(), pending.size());
+            sqlite3_reset(insert);
+            sqlite3_bind_int64(insert, 1, series_id);
+            sqlite3_bind_int64(insert, 2, pending.front().timestamp);
+            sqlite3_bind_int64(insert, 3, pending.back().timestamp);
+            sqlite3_bind_int64(insert, 4, static_cast<sqlite3_int64>(pending.size()));
+            sqlite3_bind_blob(insert, 5, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+            if (sqlite3_step(insert) != SQLITE_DONE) fail("Failed to store chunk");
+            sealed += pending.size();
+            chunks++;
+            pending.clear();
+        };
+
+        sqlite3_reset(select);
+        sqlite3_bind_int64(select, 1, series_id);
+        sqlite3_bind_int64(select, 2, before);
+        int rc;
+        while ((rc = sqlite3_step(select)) == SQLITE_ROW) {
+            chunk::Sample sample{sqlite3_column_int64(select, 0), 0, 0, 0};
+            uint16_t* values[] = {&sample.pressure, &sample.temperature, &sample.velocity};
+            for (int i = 0; i < 3; i++) {
+                if (sqlite3_column_bytes(select, i + 1) == sizeof(uint16_t)) {
+                    std::memcpy(values[i], sqlite3_column_blob(select, i + 1), sizeof(uint16_t));
+                }
+            }
+            pending.push_back(sample);
+            if (pending.size() >= chunk_samples) flush();
+        }
+        if (rc != SQLITE_DONE) fail("Failed to read samples to seal");
+        flush();
+
+        sqlite3_reset(erase);
+        sqlite3_bind_int64(erase, 1, series_id);
+        sqlite3_bind_int64(erase, 2, before);
+        if (sqlite3_step(erase) != SQLITE_DONE) fail("Failed to delete sealed samples");
+    }
+    sqlite3_finalize(select);
+    sqlite3_finalize(insert);
+    sqlite3_finalize(erase);
+    select = insert = erase = nullptr;
+    if (sqlite3_exec(write_db_, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        fail("Failed to commit sealed chunks");
+    }
+
+    int64_t seal_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time).count();
+    std::lock_guard<std::mutex> lock(writer_stats_mutex_);
+    writer_stats_.samples_sealed += sealed;
+    writer_stats_.chunks_sealed += chunks;
+    writer_stats_.last_seal_us = seal_us;
+    return sealed;
+}
+
+// Chunks span any time range, so they can't be split between partitions - they go back to rows
+// first and are sealed again in their partitions
+void DatabaseManager::unsealChunks(sqlite3* db) {
+    const char* sql =
+        "SELECT SeriesId, Data FROM Chunks;";
+    sqlite3_stmt* select;
+    sqlite3_stmt* insert;
+    if (sqlite3_prepare_v2(db, sql, -1, &select, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+    if (sqlite3_prepare_v2(db, "INSERT INTO Samples (SeriesId, Timestamp, Pressure, Temperature, Velocity) "
+                           "VALUES (?, ?, ?, ?, ?);", -1, &insert, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(select);
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    size_t restored = 0;
+    bool ok = true;
+    std::vector<chunk::Sample> decoded;
+    while (ok && sqlite3_step(select) == SQLITE_ROW) {
+        decoded.clear();
+        chunk::decode(static_cast<const uint8_t*>(sqlite3_column_blob(select, 1)),
+                      static_cast<size_t>(sqlite3_column_bytes(select, 1)), decoded);
+        for (const auto& sample : decoded) {
+            sqlite3_reset(insert);
+            sqlite3_bind_int64(insert, 1, sqlite3_column_int64(select, 0));
+            sqlite3_bind_int64(insert, 2, sample.timestamp);
+            sqlite3_bind_blob(insert, 3, &sample.pressure, sizeof(uint16_t), SQLITE_STATIC);
+            sqlite3_bind_blob(insert, 4, &sample.temperature, sizeof(uint16_t), SQLITE_STATIC);
+            sqlite3_bind_blob(insert, 5, &sample.velocity, sizeof(uint16_t), SQLITE_STATIC);
+            if (sqlite3_step(insert) != SQLITE_DONE) {
+                ok = false;
+                break;
+            }
+            restored++;
+        }
+    }
+    sqlite3_finalize(select);
+    sqlite3_finalize(insert);
+    if (!ok || sqlite3_exec(db, "DELETE FROM Chunks; COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::string error = "Unpacking chunks failed: " + std::string(sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw std::runtime_error(error);
+    }
+    if (restored > 0) {
+        std::cout << "DatabaseManager: Unpacked " << restored << " sample(-s) from chunks\n";
+    }
+}
+
+int64_t DatabaseManager::partitionLength() const {
+    return partitions_.period == PartitionSettings::Period::Week ? 7 * 86400 : 86400;
+}
+
+// UTC days, or weeks starting on Monday - the first one after the epoch was 1970-01-05
+int64_t DatabaseManager::partitionStart(int64_t timestamp) const {
+    const int64_t length = partitionLength();
+    const int64_t offset = partitions_.period == PartitionSettings::Period::Week ? 4 * 86400 : 0;
+    int64_t index = (timestamp - offset) / length;
+    if ((timestamp - offset) % length < 0) {
+        index--;                                         // Round down before 1970 as well
+    }
+    return index * length + offset;
+}
+
+fs::path DatabaseManager::partitionPath(int64_t start) const {
+    time_t seconds = static_cast<time_t>(start);
+    std::tm day{};
+    gmtime_r(&seconds, &day);
+    char name[32];
+    strftime(name, sizeof(name), "%Y-%m-%d.db", &day);
+    return partition_dir_ / name;
+}
+
+std::vector<int64_t> DatabaseManager::listPartitions() const {
+    std::vector<int64_t> starts;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(partition_dir_, ec)) {
+        // Exactly 'YYYY-MM-DD.db', as partitionPath() names them - not the -wal / -shm / -journal
+        // files next to it, nor anything else left in the directory
+        const std::string name = entry.path().filename().string();
+        static const char pattern[] = "####-##-##.db";
+        if (name.size() != sizeof(pattern) - 1 ||
+            !std::equal(name.begin(), name.end(), pattern, [](char c, char p) {
+                return p == '#' ? std::isdigit(static_cast<unsigned char>(c)) != 0 : c == p;
+            })) {
+            continue;
+        }
+        const int year = std::stoi(name.substr(0, 4));
+        const int month = std::stoi(name.substr(5, 2));
+        const int day = std::stoi(name.substr(8, 2));
+        std::tm date{};
+        date.tm_year = year - 1900;
+        date.tm_mon = month - 1;
+        date.tm_mday = day;
+        starts.push_back(static_cast<int64_t>(timegm(&date)));
+    }
+    std::sort(starts.rbegin(), starts.rend());
+    return starts;
+}
+
+// The previous partition is closed, which checkpoints its WAL into the file - from then on it's
+// a single file that backups can copy without locking
+void DatabaseManager::openPartition(int64_t start) {
+    if (write_db_ != db_ && start == write_partition_) {
+        return;
+    }
+    const fs::path path = partitionPath(start);
+    sqlite3* db;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+        std::string error = "Failed to open partition " + path.string() + ": " + sqlite3_errmsg(db);
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+    }
+    sqlite3_stmt* insert = nullptr;
+    sqlite3_stmt* hwm = nullptr;
+    try {
+        applyProfile(db);
+        createSampleTables(db);
+        prepareWriteStatements(db, insert, hwm);
+    } catch (...) {
+        sqlite3_close(db);
+        throw;
+    }
+
+    if (write_db_ != db_ && seal_chunk_samples_ > 0) {
+        try {
+            sealChunks(std::numeric_limits<int64_t>::max(), seal_chunk_samples_);
+        } catch (const std::exception& e) {
+            std::cerr << "DatabaseManager: Partition stays unsealed - " << e.what() << "\n";
+        }
+    }
+    sqlite3_finalize(insert_stmt_);
+    sqlite3_finalize(hwm_stmt_);
+    if (write_db_ != db_) {
+        sqlite3_close(write_db_);
+    }
+    write_db_ = db;
+    write_partition_ = start;
+    insert_stmt_ = insert;
+    hwm_stmt_ = hwm;
+    std::cout << "DatabaseManager: Writing to partition " << path << "\n";
+    dropExpiredPartitions();
+}
+
+// Samples stored in DB_PATH before partitions were enabled move into their partitions, one
+// partition per transaction
+void DatabaseManager::migrateIntoPartitions() {
+    auto start_time = std::chrono::steady_clock::now();
+    uint64_t moved = 0;
+    unsealChunks(db_);
+    while (true) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db_, "SELECT MIN(Timestamp) FROM Samples;", -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+        }
+        bool found = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+        int64_t oldest = found ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        if (!found) break;
+
+        const int64_t start = partitionStart(oldest);
+        openPartition(start);                            // Creates the file with its tables
+        if (sqlite3_prepare_v2(db_, "ATTACH DATABASE ? AS part;", -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+        }
+        const std::string path = partitionPath(start).string();
+        sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            throw std::runtime_error("Failed to attach " + path + ": " + std::string(sqlite3_errmsg(db_)));
+        }
+
+        const std::string range = " WHERE Timestamp >= " + std::to_string(start) +
+                                  " AND Timestamp < " + std::to_string(start + partitionLength());
+        const std::string sql =
+            "BEGIN;"
+            "INSERT INTO part.Samples (SeriesId, Timestamp, Pressure, Temperature, Velocity) "
+            "SELECT SeriesId, Timestamp, Pressure, Temperature, Velocity FROM main.Samples" + range + " ORDER BY rowid;"
+            "DELETE FROM main.Samples" + range + ";"
+            "COMMIT;";
+        char* err_msg = nullptr;
+        rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg);
+        moved += sqlite3_changes(db_);
+        if (rc != SQLITE_OK) {
+            std::string error = "Moving samples into " + path + " failed: " + std::string(err_msg);
+            sqlite3_free(err_msg);
+            sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+            sqlite3_exec(db_, "DETACH DATABASE part;", nullptr, nullptr, nullptr);
+            throw std::runtime_error(error);
+        }
+        sqlite3_exec(db_, "DETACH DATABASE part;", nullptr, nullptr, nullptr);
+    }
+    if (moved > 0) {
+        std::cout << "DatabaseManager: Moved " << moved << " sample(-s) from " << db_path_ << " into partitions in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count()
+                  << " ms\n";
+    }
+}
+
+// Retention: whole partitions that ended more than retention_days ago are unlinked - no DELETE, no
+// VACUUM. Never the one being written to (e.g. with the clock far behind)
+void DatabaseManager::dropExpiredPartitions() {
+    if (partitions_.retention_days <= 0) return;
+    const int64_t cutoff = static_cast<int64_t>(time(nullptr)) - static_cast<int64_t>(partitions_.retention_days) * 86400;
+    for (int64_t start : listPartitions()) {
+        if (start + partitionLength() > cutoff || (write_db_ != db_ && start == write_partition_)) {
+            continue;
+        }
+        const std::string path = partitionPath(start).string();
+        std::error_code ec;
+        for (const char* suffix : {"-wal", "-shm", "-journal", ""}) {
+            fs::remove(path + suffix, ec);
+        }
+        std::cout << "DatabaseManager: Dropped partition " << path << " (retention " << partitions_.retention_days
+                  << " days)\n";
+        std::lock_guard<std::mutex> lock(generation_mutex_);
+        retention_generation_ = ++last_generation_;
+    }
+}
+
+// SQLite URI of a database file, opened read-only
+static std::string readOnlyUri(const fs::path& path) {
+    std::string uri = "file:";
+    for (char c : path.string()) {
+        if (c == '%' || c == '?' || c == '#') {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+            uri += escaped;
+        } else {
+            uri += c;
+        }
+    }
+    return uri + "?mode=ro";
+}
+
+// Reads ATTACH the partitions overlapping [from, to] one at a time, newest first, read-only - a
+// partition dropped in the meantime is skipped instead of being created again. Partitions don't
+// overlap in time, so newest first per partition is newest first overall
+std::vector<DatabaseManager::SensorData> DatabaseManager::queryPartitions(int64_t series_id, int64_t from,
+                                                                          int64_t to, int n, QueryCost* cost) {
+    sqlite3* db = acquireReadConnection();
+    std::vector<SensorData> result;
+    result.reserve(std::min(n, 1 << 16));
+    try {
+        for (int64_t start : listPartitions()) {
+            if (start > to || start + partitionLength() <= from) continue;
+
+            std::string uri = readOnlyUri(partitionPath(start));
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS part;", -1, &stmt, nullptr) != SQLITE_OK) {
+                throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+            }
+            sqlite3_bind_text(stmt, 1, uri.c_str(), -1, SQLITE_TRANSIENT);
+            int rc = sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            if (rc != SQLITE_DONE) continue;             // Dropped by retention
+
+            try {
+                selectSamples(db, "part.", series_id, from, to, n - static_cast<int>(result.size()), result, cost);
+            } catch (...) {
+                sqlite3_exec(db, "DETACH DATABASE part;", nullptr, nullptr, nullptr);
+                throw;
+            }
+            sqlite3_exec(db, "DETACH DATABASE part;", nullptr, nullptr, nullptr);
+            if (static_cast<int>(result.size()) >= n) break;
+        }
+    } catch (...) {
+        sqlite3_close(db);
+        throw;
+    }
+
+    releaseReadConnection(db);
     return result;
 }
 
-// Updates the value using validated result in PUT /config command
-void DatabaseManager::updFrequency(const uint8_t& freq) { frequency_ = freq; }
-void DatabaseManager::updDebug(const bool& debug) { debug_ = debug; }
+// Without partitions the samples are in DB_PATH itself, with them every read ATTACHes its partitions
+// to an empty in-memory database
+sqlite3* DatabaseManager::acquireReadConnection() {
+    {
+        std::lock_guard<std::mutex> lock(read_pool_mutex_);
+        if (!read_pool_.empty()) {
+            sqlite3* db = read_pool_.back();
+            read_pool_.pop_back();
+            return db;
+        }
+    }
+    sqlite3* db = nullptr;
+    const bool partitioned = partitions_.period != PartitionSettings::Period::None;
+    int rc = partitioned ? sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_URI, nullptr)
+                         : sqlite3_open_v2(readOnlyUri(db_path_).c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI,
+                                           nullptr);
+    if (rc != SQLITE_OK) {
+        std::string error = "Failed to open read connection: " + std::string(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+    }
+    sqlite3_busy_timeout(db, 1000);                      // Rollback journal: commits lock readers out briefly
+    if (!partitioned) {
+        sqlite3_exec(db, ("PRAGMA mmap_size = " + std::to_string(profile_.mmap_size) + ";").c_str(),
+                     nullptr, nullptr, nullptr);
+        sqlite3_exec(db, ("PRAGMA cache_size = " + std::to_string(profile_.cache_size) + ";").c_str(),
+                     nullptr, nullptr, nullptr);
+    }
+    return db;
+}
+
+void DatabaseManager::releaseReadConnection(sqlite3* db) {
+    std::lock_guard<std::mutex> lock(read_pool_mutex_);
+    read_pool_.push_back(db);
+}
+
+const PartitionSettings& DatabaseManager::getPartitionSettings() const { return partitions_; }
+
+size_t DatabaseManager::getPartitionCount() const {
+    return partitions_.period == PartitionSettings::Period::None ? 0 : listPartitions().size();
+}
+
+std::unique_ptr<DatabaseManager::ExportCursor> DatabaseManager::openExport(int64_t from, int64_t to) {
+    std::unique_ptr<ExportCursor> cursor(new ExportCursor());
+    cursor->from_ = from;
+    cursor->to_ = to;
+    cursor->key_timestamp_ = from;
+    cursor->series_id_ = seriesId(config_.load(), false);
+    if (cursor->series_id_ == 0) {
+        return cursor;                                   // Nothing stored with this configuration yet
+    }
+    if (partitions_.period == PartitionSettings::Period::None) {
+        cursor->files_.push_back({db_path_, false, 0});
+    } else {
+        // Once its period is over, the writer is done with a partition
+        int64_t now = static_cast<int64_t>(time(nullptr));
+        auto starts = listPartitions();
+        for (auto it = starts.rbegin(); it != starts.rend(); ++it) {
+            if (*it > to || *it + partitionLength() <= from) continue;
+            cursor->files_.push_back({partitionPath(*it), *it + partitionLength() <= now, 0});
+        }
+    }
+    // Cut the range at the newest sample stored - the newest file that has one in the range
+    for (auto it = cursor->files_.rbegin(); it != cursor->files_.rend(); ++it) {
+        sqlite3* db = ExportCursor::openFile(it->path);
+        if (!db) continue;
+        int64_t newest;
+        try {
+            newest = cursor->newestIn(db);
+        } catch (...) {
+            sqlite3_close(db);
+            throw;
+        }
+        sqlite3_close(db);
+        if (newest == std::numeric_limits<int64_t>::min()) continue;
+        if (newest >= from) cursor->to_ = newest;
+        break;
+    }
+    for (auto& file : cursor->files_) {
+        sqlite3* db = ExportCursor::openFile(file.path);
+        if (!db) continue;                               // Dropped by retention
+        try {
+            file.count = cursor->countIn(db);
+        } catch (...) {
+            sqlite3_close(db);
+            throw;
+        }
+        sqlite3_close(db);
+        cursor->count_ += file.count;
+    }
+    return cursor;
+}
+
+DatabaseManager::ExportCursor::~ExportCursor() { closeCurrent(); }
+
+uint64_t DatabaseManager::ExportCursor::count() const { return count_; }
+int64_t DatabaseManager::ExportCursor::from() const { return from_; }
+int64_t DatabaseManager::ExportCursor::to() const { return to_; }
+
+std::string DatabaseManager::ExportCursor::version() const {
+    return std::to_string(series_id_) + "-" + std::to_string(from_) + "-" + std::to_string(to_) + "-" +
+           std::to_string(count_);
+}
+
+sqlite3* DatabaseManager::ExportCursor::openFile(const fs::path& path) {
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return nullptr;
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(readOnlyUri(path).c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr) != SQLITE_OK) {
+        sqlite3_close(db);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(db, 1000);                      // Rollback journal: commits lock readers out briefly
+    sqlite3_exec(db, "PRAGMA cache_size = -1024;", nullptr, nullptr, nullptr);  // Read once, no need to cache
+    return db;
+}
+
+// Rows and chunks in one read transaction - sealing moves samples from one to the other
+uint64_t DatabaseManager::ExportCursor::countIn(sqlite3* db) const {
+    static const char* queries[] = {
+        "SELECT COUNT(*) FROM Samples WHERE SeriesId = ?1 AND Timestamp BETWEEN ?2 AND ?3;",
+        "SELECT COALESCE(SUM(Count), 0) FROM Chunks WHERE SeriesId = ?1 AND FirstTimestamp >= ?2 AND LastTimestamp <= ?3;",
+        // Chunks sticking out of the range are decoded
+        "SELECT Data FROM Chunks WHERE SeriesId = ?1 AND LastTimestamp >= ?2 AND FirstTimestamp <= ?3 "
+        "AND (FirstTimestamp < ?2 OR LastTimestamp > ?3);"};
+    if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to begin read: " + std::string(sqlite3_errmsg(db)));
+    }
+    uint64_t count = 0;
+    for (int i = 0; i < 3; i++) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, queries[i], -1, &stmt, nullptr) != SQLITE_OK) {
+            std::string error = "Failed to prepare statement: " + std::string(sqlite3_errmsg(db));
+            sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+            throw std::runtime_error(error);
+        }
+        sqlite3_bind_int64(stmt, 1, series_id_);
+        sqlite3_bind_int64(stmt, 2, from_);
+        sqlite3_bind_int64(stmt, 3, to_);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (i < 2) {
+                count += static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+                continue;
+            }
+            chunk::Decoder decoder(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
+                                   static_cast<size_t>(sqlite3_column_bytes(stmt, 0)));
+            chunk::Sample sample;
+            while (decoder.next(sample)) {
+                if (sample.timestamp >= from_ && sample.timestamp <= to_) count++;
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+            throw std::runtime_error("Query error: " + std::string(sqlite3_errmsg(db)));
+        }
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    return count;
+}
+
+int64_t DatabaseManager::ExportCursor::newestIn(sqlite3* db) const {
+    // A chunk sticking out past to_ means there are samples at to_ or later
+    static const char* queries[] = {
+        "SELECT MAX(Timestamp) FROM Samples WHERE SeriesId = ?1 AND Timestamp <= ?2;",
+        "SELECT MIN(MAX(LastTimestamp), ?2) FROM Chunks WHERE SeriesId = ?1 AND FirstTimestamp <= ?2;"};
+    int64_t newest = std::numeric_limits<int64_t>::min();
+    for (const char* query : queries) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+        }
+        sqlite3_bind_int64(stmt, 1, series_id_);
+        sqlite3_bind_int64(stmt, 2, to_);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            newest = std::max<int64_t>(newest, sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            throw std::runtime_error("Query error: " + std::string(sqlite3_errmsg(db)));
+        }
+    }
+    return newest;
+}
+
+// posix_fadvise() works on the file, not on SQLite's descriptor: the export keeps its own one to
+// read ahead (WILLNEED) and, for files nobody writes any more, to drop them from the page cache
+// when done (DONTNEED) - so a long export doesn't push out the pages ingest works on
+bool DatabaseManager::ExportCursor::openCurrent() {
+    db_ = openFile(files_[file_].path);
+    if (!db_) return false;
+    fd_ = ::open(files_[file_].path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ >= 0) {
+        file_size_ = static_cast<int64_t>(lseek(fd_, 0, SEEK_END));
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    readahead_end_ = 0;
+    return true;
+}
+
+void DatabaseManager::ExportCursor::closeCurrent() {
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        if (file_ < files_.size() && files_[file_].closed) {
+            posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void DatabaseManager::ExportCursor::nextFile() {
+    closeCurrent();
+    file_++;
+    file_position_ = 0;
+    key_timestamp_ = from_;
+    key_skip_ = 0;
+}
+
+void DatabaseManager::ExportCursor::seek(uint64_t index) {
+    if (index < position_) {
+        closeCurrent();
+        position_ = 0;
+        file_ = 0;
+        file_position_ = 0;
+        key_timestamp_ = from_;
+        key_skip_ = 0;
+    }
+    // Whole files by their counts
+    while (file_ < files_.size() && index - position_ >= files_[file_].count - file_position_) {
+        position_ += files_[file_].count - file_position_;
+        nextFile();
+    }
+    // Nothing maps a position to a timestamp within a file - read up to it
+    std::vector<SensorData> skipped(batch_samples);
+    while (position_ < index) {
+        if (read(skipped.data(), static_cast<size_t>(std::min<uint64_t>(batch_samples, index - position_))) == 0) break;
+    }
+}
+
+size_t DatabaseManager::ExportCursor::read(SensorData* out, size_t max) {
+    const int64_t readahead_bytes = 4 * 1024 * 1024;
+    size_t n = 0;
+    while (n < max && position_ < count_ && file_ < files_.size()) {
+        const File& file = files_[file_];
+        if (file_position_ >= file.count) {
+            nextFile();
+            continue;
+        }
+        if (!db_ && !openCurrent()) break;               // Dropped by retention in the meantime
+        size_t got = readBatch(out + n, static_cast<size_t>(std::min<uint64_t>(max - n, file.count - file_position_)));
+        if (got == 0) break;                             // Fewer samples than counted
+        n += got;
+        file_position_ += got;
+        position_ += got;
+
+        // Samples are appended in time order, so the file is roughly in time order as well
+        int64_t at = static_cast<int64_t>(static_cast<double>(file_size_) * file_position_ / file.count);
+        if (fd_ >= 0 && readahead_end_ < file_size_ && at + readahead_bytes / 2 >= readahead_end_) {
+            int64_t start = std::max(at, readahead_end_);
+            posix_fadvise(fd_, start, readahead_bytes, POSIX_FADV_WILLNEED);
+            readahead_end_ = start + readahead_bytes;
+        }
+    }
+    return n;
+}
+
+const DatabaseManager::QueryCost& DatabaseManager::ExportCursor::cost() const { return cost_; }
+
+// Rows and chunks from the (key_timestamp_, key_skip_) position on, merged by timestamp. Sealing
+// packs whole seconds, so the samples of one second are either all rows or all in chunks, in the
+// same order
+size_t DatabaseManager::ExportCursor::readBatch(SensorData* out, size_t max) {
+    max = std::min(max, batch_samples);
+    rows_.clear();
+    chunk_samples_.clear();
+    if (sqlite3_exec(db_, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to begin read: " + std::string(sqlite3_errmsg(db_)));
+    }
+    sqlite3_stmt* stmt = nullptr;
+    auto fail = [&](const std::string& what) {
+        std::string error = what + ": " + sqlite3_errmsg(db_);
+        sqlite3_finalize(stmt);
+        sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, nullptr);
+        throw std::runtime_error(error);
+    };
+
+    if (sqlite3_prepare_v2(db_, "SELECT Timestamp, Pressure, Temperature, Velocity FROM Samples WHERE SeriesId = ? "
+                           "AND Timestamp BETWEEN ? AND ? ORDER BY Timestamp, rowid LIMIT ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        fail("Failed to prepare statement");
+    }
+    sqlite3_bind_int64(stmt, 1, series_id_);
+    sqlite3_bind_int64(stmt, 2, key_timestamp_);
+    sqlite3_bind_int64(stmt, 3, to_);
+    sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(max + key_skip_));
+    uint64_t skip = key_skip_;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        cost_.rows_scanned++;
+        SensorData data{0, 0, 0, sqlite3_column_int64(stmt, 0)};
+        if (data.timestamp == key_timestamp_ && skip > 0) {
+            skip--;
+            continue;
+        }
+        // Like sealChunks() - a value that isn't 2 bytes is exported as 0
+        uint16_t* values[] = {&data.pressure, &data.temperature, &data.velocity};
+        for (int i = 0; i < 3; i++) {
+            if (sqlite3_column_bytes(stmt, i + 1) == sizeof(uint16_t)) {
+                std::memcpy(values[i], sqlite3_column_blob(stmt, i + 1), sizeof(uint16_t));
+            }
+        }
+        rows_.push_back(data);
+    }
+    if (rc != SQLITE_DONE) fail("Query error");
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    if (sqlite3_prepare_v2(db_, "SELECT Data FROM Chunks WHERE SeriesId = ? AND LastTimestamp >= ? "
+                           "AND FirstTimestamp <= ? ORDER BY LastTimestamp;", -1, &stmt, nullptr) != SQLITE_OK) {
+        fail("Failed to prepare statement");
+    }
+    sqlite3_bind_int64(stmt, 1, series_id_);
+    sqlite3_bind_int64(stmt, 2, key_timestamp_);
+    sqlite3_bind_int64(stmt, 3, to_);
+    skip = key_skip_;
+    while (chunk_samples_.size() < max && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        chunk::Decoder decoder(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
+                               static_cast<size_t>(sqlite3_column_bytes(stmt, 0)));
+        chunk::Sample sample;
+        cost_.rows_scanned++;
+        cost_.chunks_decoded++;
+        while (chunk_samples_.size() < max && decoder.next(sample)) {
+            cost_.samples_decoded++;
+            if (sample.timestamp < key_timestamp_ || sample.timestamp > to_) continue;
+            if (sample.timestamp == key_timestamp_ && skip > 0) {
+                skip--;
+                continue;
+            }
+            chunk_samples_.push_back({sample.pressure, sample.temperature, sample.velocity, sample.timestamp});
+        }
+    }
+    if (rc != SQLITE_DONE && rc != SQLITE_ROW) fail("Query error");
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, nullptr);
+
+    size_t n = 0, row = 0, sample = 0;
+    while (n < max && (row < rows_.size() || sample < chunk_samples_.size())) {
+        bool from_chunk = row == rows_.size() ||
+                          (sample < chunk_samples_.size() && chunk_samples_[sample].timestamp <= rows_[row].timestamp);
+        out[n++] = from_chunk ? chunk_samples_[sample++] : rows_[row++];
+    }
+    if (n > 0) {
+        int64_t last = out[n - 1].timestamp;
+        uint64_t same = 0;
+        while (same < n && out[n - 1 - same].timestamp == last) same++;
+        key_skip_ = (last == key_timestamp_ ? key_skip_ : 0) + same;
+        key_timestamp_ = last;
+    }
+    return n;
+}
+
+// ConfigStore Implementation
+ConfigStore::ConfigStore(const DeviceConfig& initial) : current_(initial) {}
+
+DeviceConfig ConfigStore::load() const {
+    return current_.load(std::memory_order_acquire);
+}
+
+// Writers are serialised by cmd_sequence_mutex_ already - the loop only makes versions unique regardless
+DeviceConfig ConfigStore::publish(uint8_t frequency, bool debug) {
+    DeviceConfig expected = current_.load(std::memory_order_relaxed);
+    DeviceConfig desired;
+    do {
+        desired = expected;
+        desired.frequency = frequency;
+        desired.debug = debug;
+        desired.version = expected.version + 1;
+    } while (!current_.compare_exchange_weak(expected, desired, std::memory_order_release,
+                                             std::memory_order_relaxed));
+    return desired;
+}
 
 // HTTPServer Implementation. By default, doesn't read until /start command
+namespace {
+thread_local bool shedding_thread = false;
+thread_local int64_t request_start_ns = 0;     // Of the request on this worker, 0 if not traced
+}
+
+RequestQueue::RequestQueue(size_t threads, size_t max_queued, HttpQueueStats& stats)
+    : max_queued_(std::max<size_t>(max_queued, 1)), stats_(stats) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+        workers_.emplace_back(&RequestQueue::work, this, false);
+    }
+    shedder_ = std::thread(&RequestQueue::work, this, true);
+}
+
+RequestQueue::~RequestQueue() {
+    shutdown();
+}
+
+bool RequestQueue::enqueue(std::function<void()> fn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.size() < max_queued_) {
+        jobs_.push_back({std::move(fn), std::chrono::steady_clock::now()});
+        stats_.queued = jobs_.size();
+        lock.unlock();
+        cv_.notify_one();
+    } else if (shed_jobs_.size() < max_queued_) {
+        shed_jobs_.push_back({std::move(fn), std::chrono::steady_clock::now()});
+        stats_.shed++;
+        lock.unlock();
+        shed_cv_.notify_one();
+    } else {
+        stats_.dropped++;
+        return false;                              // httplib closes the socket
+    }
+    return true;
+}
+
+void RequestQueue::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) return;
+        shutdown_ = true;
+    }
+    cv_.notify_all();
+    shed_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    shedder_.join();
+}
+
+bool RequestQueue::shedding() {
+    return shedding_thread;
+}
+
+void RequestQueue::work(bool shedding) {
+    shedding_thread = shedding;
+    trace::setThreadName(shedding ? "http shedder" : "http worker");
+    std::deque<Job>& jobs = shedding ? shed_jobs_ : jobs_;
+    std::condition_variable& cv = shedding ? shed_cv_ : cv_;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv.wait(lock, [&] { return !jobs.empty() || shutdown_; });
+            if (jobs.empty()) break;               // Shut down and nothing left
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            if (!shedding) {
+                stats_.queued = jobs.size();
+            }
+        }
+        if (shedding) {
+            job.fn();
+            continue;
+        }
+        int64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - job.enqueued).count();
+        stats_.last_wait_us = wait_us;
+        stats_.total_wait_us += wait_us;
+        if (wait_us > stats_.max_wait_us) stats_.max_wait_us = wait_us;
+        stats_.connections++;
+        stats_.busy++;
+        job.fn();
+        stats_.busy--;
+    }
+}
+
 HTTPServer::HTTPServer(const std::string& host, int port,
                         DatabaseManager& db_manager,
-                        uint8_t& frequency, bool& debug,
-                        SerialInterface& serial)
+                        ConfigStore& config,
+                        SerialInterface& serial,
+                        const CompressionSettings& compression,
+                        const HttpPoolSettings& pool,
+                        const QuerySettings& query,
+                        const AlertSettings& alerts)
     : host_(host), port_(port), db_manager_(db_manager),
-    frequency_(frequency), debug_(debug), is_reading_(false),
-    serial_(serial) {
+    config_(config), is_reading_(false),
+    serial_(serial), compression_(compression), pool_(pool), query_(query),
+    alerts_(alerts.rules, alerts.ring_size) {
 
         // Validate server name (hostname)
         if (!isValidHostname(host_) || host_.length() == 0) {
@@ -197,123 +1727,428 @@ HTTPServer::HTTPServer(const std::string& host, int port,
             port_ = 7100;
         }
 
+        std::random_device random;
+        char boot_id[17];
+        snprintf(boot_id, sizeof(boot_id), "%08x%08x", random(), random());
+        boot_id_ = boot_id;
+
+        if (compression_.threads == 0) {
+            compression_.threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (pool_.threads == 0) {
+            pool_.threads = CPPHTTPLIB_THREAD_POOL_COUNT;
+        }
+        svr_.new_task_queue = [this]() -> httplib::TaskQueue* {
+            return new RequestQueue(pool_.threads, pool_.max_queued, queue_stats_);
+        };
+    }
+
+HTTPServer::~HTTPServer(){
+    stop();
+}
+
+void HTTPServer::start() {
+    registerEndpoints();
+    server_thread_ = std::thread([this]() {
+        svr_.listen(host_.c_str(), port_);
+    });
+}
+
+void HTTPServer::stop() {
+    alerts_.close();                           // Ends the event streams, they would hold the workers
+    svr_.stop();
+    if (server_thread_.joinable()) {
+        server_thread_.join();
+    }
+}
+
+// ETag of GET /messages and /device: boot id, configuration and the ingest generation of its series.
+// The body also depends on the query string, but an ETag only has to tell versions of one URL apart.
+// Nothing is read from SQLite - a matching If-None-Match is answered with 304 right away
+bool HTTPServer::notModified(const httplib::Request &req, httplib::Response &res) {
+    DeviceConfig config = config_.load();
+    const std::string etag = "\"" + boot_id_ + "-" + std::to_string(config.frequency) + "-" + (config.debug ? "1" : "0") +
+                             "-" + std::to_string(db_manager_.getGeneration()) + "\"";
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");  // Cache, but revalidate every time
+    if (!req.has_header("If-None-Match")) {
+        return false;
+    }
+    // "*" or a list of ETags, possibly weak (W/"...") - weak comparison is what GET uses
+    std::stringstream candidates(req.get_header_value("If-None-Match"));
+    std::string candidate;
+    while (std::getline(candidates, candidate, ',')) {
+        candidate = trim(candidate);
+        if (candidate.rfind("W/", 0) == 0) {
+            candidate = candidate.substr(2);
+        }
+        if (candidate.size() > 6 && candidate.compare(candidate.size() - 6, 6, "-gzip\"") == 0) {
+            candidate = candidate.substr(0, candidate.size() - 6) + "\"";  // ETag of the compressed body
+        }
+        if (candidate == etag || candidate == "*") {
+            res.status = 304; // Not Modified
+            not_modified_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+void setGzipEncoding(httplib::Response &res) {
+    res.set_header("Content-Encoding", "gzip");
+    // Other bytes, other strong ETag - notModified() takes both
+    if (res.has_header("ETag")) {
+        std::string etag = res.get_header_value("ETag");
+        res.headers.erase("ETag");
+        res.set_header("ETag", etag.substr(0, etag.size() - 1) + "-gzip\"");
+    }
+}
+}
+
+// Bodies set with set_content() are compressed here, after routing, for every endpoint. httplib
+// has already set Content-Length and handled Range. Streamed bodies (GET /export) compress themselves
+void HTTPServer::compressBody(const httplib::Request &req, httplib::Response &res) {
+    if (compression_.level == 0 || res.status != 200 || res.body.size() < compression_.min_bytes ||
+        res.has_header("Content-Encoding")) {
+        return;
+    }
+    const std::string type = res.get_header_value("Content-Type");
+    if (type.rfind("text/", 0) != 0 && type.rfind("application/json", 0) != 0) {
+        return;
+    }
+    res.set_header("Vary", "Accept-Encoding");
+    if (!compression::acceptsGzip(req.get_header_value("Accept-Encoding"))) {
+        return;
+    }
+    std::string compressed;
+    try {
+        compressed = compression::gzip(res.body.data(), res.body.size(), compression_.level,
+                                       compression_.chunk_bytes, compression_.threads);
+    } catch (const std::exception &e) {
+        std::cerr << "HTTP: gzip failed, sending uncompressed - " << e.what() << "\n";
+        return;
+    }
+    gzip_responses_++;
+    gzip_bytes_in_ += res.body.size();
+    gzip_bytes_out_ += compressed.size();
+    res.body.swap(compressed);
+    res.headers.erase("Content-Length");
+    res.set_header("Content-Length", std::to_string(res.body.size()));
+    setGzipEncoding(res);
+}
+
+// GET /start invoked successfully at some point and no GET /stop so far?
+bool HTTPServer::isReading() const { 
+    return is_reading_.load(); 
+}
+
+// Defines the HTTP commands for server
+void HTTPServer::setStreamedContent(const httplib::Request &req, httplib::Response &res, const std::string &endpoint,
+                                    const std::string &type, std::function<bool(httplib::DataSink &sink, bool &done)> next,
+                                    std::function<void(bool success)> finished) {
+    if (compression_.level > 0 && !res.has_header("Vary")) {
+        res.set_header("Vary", "Accept-Encoding");
+    }
+    std::shared_ptr<compression::GzipStream> stream;
+    if (compression_.level > 0 && compression::acceptsGzip(req.get_header_value("Accept-Encoding"))) {
+        // Parts are compressed on all cores
+        setGzipEncoding(res);
+        stream = std::make_shared<compression::GzipStream>(compression_.level, compression_.chunk_bytes,
+                                                           compression_.threads);
+        gzip_responses_++;
+    }
+    // Finished before the last chunk goes out - by the time the client has the whole body, it's
+    // accounted for. The releaser only runs it for responses that didn't get that far
+    auto over = std::make_shared<bool>(false);
+    auto finish = [finished, over](bool success) {
+        if (*over) return;
+        *over = true;
+        if (finished) finished(success);
+    };
+    res.set_chunked_content_provider(type, [this, endpoint, next, stream, finish](size_t, httplib::DataSink &sink) {
+        compression::GzipStream::Callback out = [&](const char* data, size_t size) {
+            gzip_bytes_out_ += size;
+            return sink.write(data, size);
+        };
+        httplib::DataSink part;
+        part.write = [&](const char* data, size_t size) {
+            if (!stream) return sink.write(data, size);
+            gzip_bytes_in_ += size;
+            return stream->write(data, size, out);
+        };
+        try {
+            bool done = false;
+            if (!next(part, done)) return false;
+            if (done) {
+                if (stream && !stream->finish(out)) return false;
+                finish(true);
+                sink.done();
+            }
+            return true;
+        } catch (const std::exception &e) {
+            std::cout << endpoint << ": Error while streaming - " << e.what() << "\n";
+            return false;
+        }
+    }, finish);
+}
+
+// limit > max_limit: the same JSON array as one getMessages() would give, one page of max_limit at
+// a time. The position between pages is (timestamp, samples of that second already sent), like
+// the export cursor. The newest second may still be written to while this runs - a page boundary
+// in it can repeat a sample
+void HTTPServer::streamMessages(const httplib::Request &req, httplib::Response &res, int64_t from, int64_t to,
+                                int limit, std::vector<DatabaseManager::SensorData> first_page,
+                                const DatabaseManager::QueryCost &cost) {
+    struct State {
+        int64_t to;
+        int64_t skip = 0;                          // Samples at `to` already sent
+        int64_t remaining;
+        bool first = true;
+        std::vector<DatabaseManager::SensorData> first_page;
+        DatabaseManager::QueryCost cost;
+        uint64_t bytes = 0;
+    };
+    auto state = std::make_shared<State>();
+    state->to = to;
+    state->remaining = limit;
+    state->first_page = std::move(first_page);
+    state->cost = cost;
+    const int page = query_.max_limit;
+    auto next = [this, state, from, page](httplib::DataSink &sink, bool &done) {
+        std::vector<DatabaseManager::SensorData> messages;
+        bool exhausted = false;
+        if (state->first) {
+            messages.swap(state->first_page);          // Read by the handler already
+        } else {
+            const int64_t wanted = std::min<int64_t>(state->remaining, page);
+            messages = db_manager_.getMessages(from, state->to, static_cast<int>(wanted + state->skip), &state->cost);
+            exhausted = static_cast<int64_t>(messages.size()) < wanted + state->skip;
+            messages.erase(messages.begin(), messages.begin() + std::min<size_t>(state->skip, messages.size()));
+        }
+
+        std::string part;
+        if (!messages.empty()) {
+            part = messagesToJson(messages).dump();    // "[...]" - the brackets go once around everything
+            part[0] = state->first ? '[' : ',';
+            part.pop_back();
+            state->first = false;
+            state->remaining -= static_cast<int64_t>(messages.size());
+
+            const int64_t last = messages.back().timestamp;
+            int64_t same = 0;
+            for (auto it = messages.rbegin(); it != messages.rend() && it->timestamp == last; ++it) same++;
+            state->skip = (last == state->to ? state->skip : 0) + same;
+            state->to = last;
+        }
+        done = exhausted || state->remaining == 0 || messages.empty();
+        if (done) {
+            part += state->first ? "[]" : "]";
+        }
+        state->bytes += part.size();
+        return sink.write(part.data(), part.size());
+    };
+    setStreamedContent(req, res, "GET /messages", "application/json", next, [this, client = req.remote_addr, state](bool) {
+        recordCost("GET /messages", client, state->cost, state->bytes);
+    });
+}
+
+void HTTPServer::recordCost(const std::string &endpoint, const std::string &client_addr,
+                            const DatabaseManager::QueryCost &cost, uint64_t bytes) {
+    auto add = [&](RequestCostTotals &totals) {
+        totals.requests++;
+        totals.rows_scanned += cost.rows_scanned;
+        totals.samples_decoded += cost.samples_decoded;
+        totals.bytes += bytes;
+        totals.max_rows_scanned = std::max(totals.max_rows_scanned, cost.rows_scanned);
+    };
+    {
+        std::lock_guard<std::mutex> lock(cost_mutex_);
+        add(cost_by_endpoint_[endpoint]);
+        auto client = cost_by_client_.find(client_addr);
+        if (client == cost_by_client_.end()) {
+            const bool room = cost_by_client_.size() < query_.cost_clients;
+            client = cost_by_client_.emplace(room ? client_addr : "other", RequestCostTotals()).first;
+        }
+        add(client->second);
+    }
+    std::cout << endpoint << ": " << client_addr << " - scanned " << cost.rows_scanned << " row(-s), decoded "
+              << cost.samples_decoded << " sample(-s) from " << cost.chunks_decoded << " chunk(-s), "
+              << bytes << " bytes\n";
+}
+
+// The response is accounted to the command that was pending, whatever the device answered to
+void HTTPServer::recordCommandResponse(std::chrono::steady_clock::time_point received) {
+    DeviceCommand::Type type;
+    if (pending_cmd_.rfind("$0", 0) == 0) type = DeviceCommand::Type::Start;
+    else if (pending_cmd_.rfind("$1", 0) == 0) type = DeviceCommand::Type::Stop;
+    else if (pending_cmd_.rfind("$2", 0) == 0) type = DeviceCommand::Type::Configure;
+    else return;
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(received - cmd_sent_).count();
+
+    std::lock_guard<std::mutex> lock(command_stats_mutex_);
+    CommandStats& stats = command_stats_[static_cast<int>(type)];
+    stats.add(us);
+    if (cmd_timed_out_) stats.late++;
+    if (cmd_response_ == "ok") stats.ok++;
+    else if (cmd_response_ == "invalid command") stats.rejected++;
+    else if (cmd_response_.find("commands don't match") != std::string::npos) stats.mismatched++;
+    else stats.undefined++;
+}
+
+CommandStats HTTPServer::getCommandStats(DeviceCommand::Type type) const {
+    std::lock_guard<std::mutex> lock(command_stats_mutex_);
+    return command_stats_[static_cast<int>(type)];
+}
+
+std::unique_lock<std::mutex> HTTPServer::lockCommands() {
+    trace::Span span("lock wait", "command");
+    return std::unique_lock<std::mutex>(cmd_sequence_mutex_);
+}
+
+DeviceCommandResult HTTPServer::executeCommand(const DeviceCommand &command) {
+    DeviceCommandResult result;
+    const char* name = DeviceCommand::typeName(command.type);
+    trace::Span span(name, "command");
+    if (command.type == DeviceCommand::Type::Start && isReading()) {
+        result.status = 400; // Bad Request
+        result.message = "Already reading";
+        return result;
+    }
+    if (command.type == DeviceCommand::Type::Stop && !isReading()) {
+        result.status = 400;
+        result.message = "Already stopped - was not reading before request";
+        return result;
+    }
+    std::unique_lock<std::mutex> lock(cmd_mutex_);
+    try {
+        switch (command.type) {
+        case DeviceCommand::Type::Start: pending_cmd_ = "$0"; break;
+        case DeviceCommand::Type::Stop: pending_cmd_ = "$1"; break;
+        case DeviceCommand::Type::Configure:
+            pending_cmd_ = "$2," + std::to_string(command.frequency) + "," + (command.debug ? "1" : "0");
+            break;
+        }
+        cmd_response_received_ = false;
+        cmd_timed_out_ = false;
+        cmd_sent_ = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> stats_lock(command_stats_mutex_);
+            command_stats_[static_cast<int>(command.type)].sent++;
+        }
+        {
+            trace::Span write_span("serial write", "command");
+            serial_.sendData(pending_cmd_ + "\n"); // E.g, sends "$2,v1,v2\n" over UART
+        }
+
+        // Wait for response or timeout
+        trace::Span reply_span("device reply", "command");
+        bool response_valid = cmd_cv_.wait_for(
+            lock, 
+            std::chrono::seconds(10),
+            [&] { return cmd_response_received_; }
+        );
+        result.round_trip_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - cmd_sent_).count();
+        if (!response_valid) {
+            cmd_timed_out_ = true;
+            std::lock_guard<std::mutex> stats_lock(command_stats_mutex_);
+            command_stats_[static_cast<int>(command.type)].timeouts++;
+            result.status = 500;
+            result.message = "Timeout - No response from device";
+            return result;
+        }
+        result.response = cmd_response_;
+    } catch (const std::exception& e) {
+        result.status = 500; // Internal Server Error
+        result.message = std::string("Error sending ") + name + " command - " + e.what();
+        return result;
     }
 
-HTTPServer::~HTTPServer(){
-    stop();
-}
-
-void HTTPServer::start() {
-    registerEndpoints();
-    server_thread_ = std::thread([this]() {
-        svr_.listen(host_.c_str(), port_);
-    });
-}
+    // Check device's response
+    trace::Span apply_span("apply", "command");
+    if (result.response == "ok") {
+        switch (command.type) {
+        case DeviceCommand::Type::Start:
+            is_reading_.store(true);  // Enable reading flag
+            result.message = "Reading started";
+            break;
+        case DeviceCommand::Type::Stop:
+            is_reading_.store(false);  // Disable reading flag
+            result.message = "Reading stopped";
+            break;
+        case DeviceCommand::Type::Configure: {
+            // Publish the new configuration - the reader tags the next sample with it, the
+            // database manager queries its series from now on
+            DeviceConfig config = config_.publish(command.frequency, command.debug);
 
-void HTTPServer::stop() {
-    svr_.stop();
-    if (server_thread_.joinable()) {
-        server_thread_.join();
+            // Upd serial port
+            try {
+                serial_.updBaudRate(config.frequency * 1000);
+            } catch (const std::exception& e) {
+                result.status = 500;
+                result.message = std::string("Error - ") + e.what();
+                return result;
+            }
+            result.message = "Configuration updated and sent to device successfully";
+            break;
+        }
+        }
+    } else if (command.type == DeviceCommand::Type::Configure && result.response == "invalid command") {
+        result.status = 400;
+        result.message = "Device rejected the configuration";
+    } else if (command.type == DeviceCommand::Type::Configure) {
+        result.status = 500;
+        result.message = "Unexpected response: " + result.response;
+    } else {
+        result.status = 500;
+        result.message = "Device error - " + result.response;
     }
+    return result;
 }
 
-// GET /start invoked successfully at some point and no GET /stop so far?
-bool HTTPServer::isReading() const { 
-    return is_reading_.load(); 
-}
-
-// Defines the HTTP commands for server
 void HTTPServer::registerEndpoints() {
-    svr_.Get("/start", [&](const httplib::Request &, httplib::Response &res) {
-        if (isReading()) {
-            res.set_content("GET /start: Already reading\n", "text/plain");
-            std::cout << "GET /start: Already reading\n";
-            res.status = 400; // Bad Request
-            return;
+    // Connections the worker queue had no room for: 503 before any handler runs, then close.
+    // httplib has already added its keep-alive headers when the post routing handler runs
+    // Requests are traced from routing until the handler returned (streamed bodies are written after that)
+    svr_.set_pre_routing_handler([this](const httplib::Request &, httplib::Response &res) {
+        request_start_ns = trace::enabled() ? trace::now() : 0;
+        if (!RequestQueue::shedding()) {
+            return httplib::Server::HandlerResponse::Unhandled;
         }
-        try {
-            std::unique_lock<std::mutex> lock(cmd_mutex_);
-            // Send Start command request
-            pending_cmd_ = "$0";
-            cmd_response_received_ = false;
-            serial_.sendData("$0\n"); 
-
-            // Wait for response or timeout
-            bool response_valid = cmd_cv_.wait_for(
-                lock, 
-                std::chrono::seconds(10),
-                [&] { return cmd_response_received_; }
-            );
-            if (!response_valid) {
-                std::cout << "GET /start: Timeout - No response from device\n";
-                res.set_content("GET /start: Timeout - No response from device\n", "text/plain");
-                res.status = 500;
-                return;
-            }
-
-            // Check device's response
-            if (cmd_response_.find("ok") != std::string::npos) {
-                is_reading_.store(true);  // Enable reading flag
-                std::cout << "GET /start: Reading started\n";
-                res.set_content("GET /start: Reading started\n", "text/plain");
-                res.status = 200;
-            } else {
-                std::cout << "GET /start: Device error - " << cmd_response_  << "\n";
-                res.set_content("GET /start: Device error - " + cmd_response_ +"\n", "text/plain");
-                res.status = 500;
-            }
-            
-        } catch (const std::exception& e) {
-            std::cout << "GET /start: Error sending start command - " << e.what() << "\n";
-            res.set_content("GET /start: Error sending start command: " + std::string(e.what()) + "\n", "text/plain");
-            res.status = 500; // Internal Server Error
+        res.status = 503; // Service Unavailable
+        res.set_header("Retry-After", std::to_string(pool_.retry_after_s));
+        res.set_content("Server busy, retry in " + std::to_string(pool_.retry_after_s) + " s\n", "text/plain");
+        return httplib::Server::HandlerResponse::Handled;
+    });
+    svr_.set_post_routing_handler([this](const httplib::Request &req, httplib::Response &res) {
+        if (RequestQueue::shedding()) {
+            res.headers.erase("Keep-Alive");
+            res.headers.erase("Connection");
+            res.set_header("Connection", "close");
+        } else {
+            compressBody(req, res);
+        }
+        if (request_start_ns != 0) {
+            trace::record((req.method + " " + req.path).c_str(), "http", request_start_ns, "status", res.status);
+            request_start_ns = 0;
         }
     });
 
-    svr_.Get("/stop", [&](const httplib::Request &, httplib::Response &res) {
-        if (!isReading()) {
-            res.set_content("GET /stop: Already stopped - was not reading before request\n", "text/plain");
-            std::cout << "GET /stop: Already stopped - was not reading before request\n";
-            res.status = 400; // Bad Request
-            return;
-        }
-        try {
-            std::unique_lock<std::mutex> lock(cmd_mutex_);
-            // Send Stop command request
-            pending_cmd_ = "$1";
-            cmd_response_received_ = false;
-            serial_.sendData("$1\n"); 
-
-            // Wait for response or timeout
-            bool response_valid = cmd_cv_.wait_for(
-                lock, 
-                std::chrono::seconds(10),
-                [&] { return cmd_response_received_; }
-            );
-            if (!response_valid) {
-                std::cout << "GET /stop: Timeout - No response from device\n";
-                res.set_content("GET /stop: Timeout - No response from device\n", "text/plain");
-                res.status = 500;
-                return;
-            }
+    svr_.Get("/start", [&](const httplib::Request &, httplib::Response &res) {
+        std::unique_lock<std::mutex> sequence = lockCommands();
+        auto result = executeCommand({DeviceCommand::Type::Start});
+        std::cout << "GET /start: " << result.message << "\n";
+        res.set_content("GET /start: " + result.message + "\n", "text/plain");
+        res.status = result.status;
+    });
 
-            // Check device's response
-            if (cmd_response_.find("ok") != std::string::npos) {
-                is_reading_.store(false);  // Disable reading flag
-                std::cout << "GET /stop: Reading stopped\n";
-                res.set_content("GET /stop: Reading stopped\n", "text/plain");
-                res.status = 200;
-            } else {
-                std::cout << "GET /stop: Device error - " << cmd_response_ << "\n";
-                res.set_content("GET /stop: Device error - " + cmd_response_ +"\n", "text/plain");
-                res.status = 500;
-            }
-            
-        } catch (const std::exception& e) {
-            std::cout << "GET /stop: Error sending stop command - " << e.what() << "\n";
-            res.set_content("GET /stop: Error sending stop command - " + std::string(e.what()) + "\n", "text/plain");
-            res.status = 500;
-        }
+    svr_.Get("/stop", [&](const httplib::Request &, httplib::Response &res) {
+        std::unique_lock<std::mutex> sequence = lockCommands();
+        auto result = executeCommand({DeviceCommand::Type::Stop});
+        std::cout << "GET /stop: " << result.message << "\n";
+        res.set_content("GET /stop: " + result.message + "\n", "text/plain");
+        res.status = result.status;
     });
     
     svr_.Get("/messages", [&](const httplib::Request &req, httplib::Response &res) {
@@ -327,32 +2162,48 @@ void HTTPServer::registerEndpoints() {
         try {
             limit = std::stoi(req.get_param_value("limit"));
             if (limit <= 0) throw std::invalid_argument("Limit must be positive");
+            // No more than max_limit are held in memory at once - above it the answer is streamed
         } catch (const std::exception &e) {
             res.status = 400; // Bad Request
             std::cout << "GET /messages: Invalid 'limit' parameter: " << e.what() << "\n";
             res.set_content("GET /messages: Invalid 'limit' parameter: " + std::string(e.what()) + "\n", "text/plain");
             return;
         }
+        // Optional time range, UNIX timestamps, both inclusive
+        int64_t from = std::numeric_limits<int64_t>::min();
+        int64_t to = std::numeric_limits<int64_t>::max();
+        try {
+            if (req.has_param("from")) from = std::stoll(req.get_param_value("from"));
+            if (req.has_param("to")) to = std::stoll(req.get_param_value("to"));
+            if (from > to) throw std::invalid_argument("'from' is after 'to'");
+        } catch (const std::exception &e) {
+            res.status = 400; // Bad Request
+            std::cout << "GET /messages: Invalid time range: " << e.what() << "\n";
+            res.set_content("GET /messages: Invalid time range: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        if (notModified(req, res)) {
+            return;
+        }
         try {
-            auto messages = db_manager_.getLastNMessages(limit);
+            DatabaseManager::QueryCost cost;
+            auto messages = db_manager_.getMessages(from, to, std::min(limit, query_.max_limit), &cost);
             if(messages.empty()){
                 res.status = 200;
                 std::cout << "GET /messages: No Messages with Given Port,Frequency,Debug\n";
                 res.set_content("GET /messages: No Messages with Given Port,Frequency,Debug\n", "text/plain");
+                recordCost("GET /messages", req.remote_addr, cost, res.body.size());
                 return;
             }
-            nlohmann::json jsonArray = nlohmann::json::array();
-            for (const auto& msg : messages) {
-                nlohmann::json jsonObj;
-                jsonObj["pressure"] = static_cast<float>(msg.pressure);
-                jsonObj["temperature"] = static_cast<float>(msg.temperature);
-                jsonObj["velocity"] = static_cast<float>(msg.velocity);
-                jsonObj["timestamp"] = msg.timestamp;
-                jsonArray.push_back(jsonObj);
-            }
             res.status = 200;
-            std::cout << "GET /messages: Returned " << limit << " Message(-s) Successfully\n";
-            res.set_content(jsonArray.dump(), "application/json");
+            if (limit > query_.max_limit && static_cast<int>(messages.size()) == query_.max_limit) {
+                std::cout << "GET /messages: Streaming up to " << limit << " Message(-s)\n";
+                streamMessages(req, res, from, to, limit, std::move(messages), cost);
+                return;
+            }
+            std::cout << "GET /messages: Returned " << messages.size() << " Message(-s) Successfully\n";
+            res.set_content(messagesToJson(messages).dump(), "application/json");
+            recordCost("GET /messages", req.remote_addr, cost, res.body.size());
         } catch (const std::exception &e) {
             res.status = 500; // Internal Server Error
             std::cout << "GET /messages: Error retrieving messages - " << e.what() << "\n";
@@ -360,27 +2211,264 @@ void HTTPServer::registerEndpoints() {
         }
     });
     
+    svr_.Get("/export", [&](const httplib::Request &req, httplib::Response &res) {
+        if (!req.has_param("from") || !req.has_param("to")) {
+            res.status = 400; // Bad Request
+            std::cout << "GET /export: Missing 'from' or 'to' parameter\n";
+            res.set_content("GET /export: Missing 'from' or 'to' parameter\n", "text/plain");
+            return;
+        }
+        // UNIX timestamps, both inclusive. CSV rows print them with 10 digits
+        int64_t from, to;
+        try {
+            from = std::max<int64_t>(std::stoll(req.get_param_value("from")), 0);
+            to = std::min<int64_t>(std::stoll(req.get_param_value("to")), 9999999999LL);
+            if (from > to) throw std::invalid_argument("'from' is after 'to'");
+        } catch (const std::exception &e) {
+            res.status = 400; // Bad Request
+            std::cout << "GET /export: Invalid time range: " << e.what() << "\n";
+            res.set_content("GET /export: Invalid time range: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        std::string format = req.has_param("format") ? req.get_param_value("format") : "csv";
+        if (format != "csv" && format != "binary") {
+            res.status = 400; // Bad Request
+            std::cout << "GET /export: Invalid 'format' parameter: " << format << "\n";
+            res.set_content("GET /export: Invalid 'format' parameter, expected csv or binary\n", "text/plain");
+            return;
+        }
+        try {
+            auto cursor = db_manager_.openExport(from, to);
+            // Strong: the same ETag is the same bytes. It also covers 'to' as cut to the data
+            // stored, which the URL doesn't
+            const std::string etag = "\"x" + cursor->version() + "-" + format + "\"";
+            res.set_header("ETag", etag);
+            if (req.has_header("Range") && req.has_header("If-Range") && req.get_header_value("If-Range") != etag) {
+                // The part the client has is of another version (or If-Range is a date, which an
+                // export has none of): the whole body, 200. httplib parsed the Range before routing
+                // and has no hook to drop it - the Request is the server's own object
+                const_cast<httplib::Request &>(req).ranges.clear();
+            }
+            auto body = std::make_shared<ExportBody>(std::move(cursor),
+                format == "csv" ? ExportBody::Format::Csv : ExportBody::Format::Binary);
+            std::string file_name = "export-" + std::to_string(from) + "-" + std::to_string(to) +
+                                    (format == "csv" ? ".csv" : ".bin");
+            const std::string type = format == "csv" ? "text/csv" : "application/octet-stream";
+            res.set_header("Content-Disposition", "attachment; filename=\"" + file_name + "\"");
+            if (compression_.level > 0) {
+                res.set_header("Vary", "Accept-Encoding");
+            }
+            // Bytes of the body produced, for the cost - only a part of it with a Range
+            auto produced = std::make_shared<size_t>(0);
+            auto finished = [this, client = req.remote_addr, body, produced](bool) {
+                recordCost("GET /export", client, body->cost(), *produced);
+            };
+            if (compression_.level > 0 && !req.has_header("Range") &&
+                compression::acceptsGzip(req.get_header_value("Accept-Encoding"))) {
+                // The compressed size isn't known up front: chunked, and no ranges - they would
+                // refer to the compressed bytes
+                res.set_header("Accept-Ranges", "none");
+                setStreamedContent(req, res, "GET /export", type, [body, produced](httplib::DataSink &sink, bool &done) {
+                    httplib::DataSink page;
+                    page.write = [&](const char* data, size_t size) {
+                        *produced += size;
+                        return sink.write(data, size);
+                    };
+                    bool ok = body->read(*produced, body->size() - *produced, page);
+                    done = *produced == body->size();
+                    return ok;
+                }, finished);
+            } else {
+                // No status set: httplib answers 206 with the requested part if there is a Range header
+                res.set_header("Accept-Ranges", "bytes");
+                res.set_content_provider(body->size(), type,
+                    [body, produced](size_t offset, size_t length, httplib::DataSink &sink) {
+                        try {
+                            if (!body->read(offset, length, sink)) return false;
+                            *produced += length;
+                            return true;
+                        } catch (const std::exception &e) {
+                            std::cout << "GET /export: Error while streaming - " << e.what() << "\n";
+                            return false;
+                        }
+                    }, finished);
+            }
+            std::cout << "GET /export: " << file_name << ", " << body->size() << " bytes\n";
+        } catch (const std::exception &e) {
+            res.status = 500; // Internal Server Error
+            std::cout << "GET /export: Error opening export - " << e.what() << "\n";
+            res.set_content("GET /export: Error opening export - " + std::string(e.what()) + "\n", "text/plain");
+        }
+    });
+
+    svr_.Get("/stats", [&](const httplib::Request &req, httplib::Response &res) {
+        // Optional time range, UNIX timestamps, both inclusive
+        int64_t from = std::numeric_limits<int64_t>::min();
+        int64_t to = std::numeric_limits<int64_t>::max();
+        std::vector<double> quantiles = {0.5, 0.9, 0.95, 0.99};
+        int bins = 10;
+        try {
+            if (req.has_param("from")) from = std::stoll(req.get_param_value("from"));
+            if (req.has_param("to")) to = std::stoll(req.get_param_value("to"));
+            if (from > to) throw std::invalid_argument("'from' is after 'to'");
+            if (req.has_param("quantiles")) {
+                quantiles.clear();
+                std::stringstream list(req.get_param_value("quantiles"));
+                std::string item;
+                while (std::getline(list, item, ',')) {
+                    double q = std::stod(item);
+                    if (!(q >= 0 && q <= 1)) throw std::invalid_argument("quantile " + item + " not in [0, 1]");
+                    quantiles.push_back(q);
+                }
+                if (quantiles.size() > 32) throw std::invalid_argument("more than 32 quantiles");
+            }
+            if (req.has_param("bins")) {
+                bins = std::stoi(req.get_param_value("bins"));
+                if (bins < 0 || bins > 1000) throw std::invalid_argument("bins not in [0, 1000]");
+            }
+        } catch (const std::exception &e) {
+            res.status = 400; // Bad Request
+            std::cout << "GET /stats: Invalid parameter: " << e.what() << "\n";
+            res.set_content("GET /stats: Invalid parameter: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        if (notModified(req, res)) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int64_t oldest;
+        auto stats = db_manager_.getStats(from, to, oldest);
+        nlohmann::json responseJson;
+        DeviceConfig config = config_.load();
+        responseJson["curr_config"] = {
+            {"frequency", config.frequency},
+            {"debug", config.debug}
+        };
+        responseJson["from"] = stats.fields[0].moments.count ? nlohmann::json(stats.from) : nlohmann::json(nullptr);
+        responseJson["to"] = stats.fields[0].moments.count ? nlohmann::json(stats.to) : nlohmann::json(nullptr);
+        responseJson["oldest"] = oldest ? nlohmann::json(oldest) : nlohmann::json(nullptr);
+        const char* names[] = {"pressure", "temperature", "velocity"};
+        for (int i = 0; i < 3; i++) {
+            responseJson[names[i]] = summaryToJson(stats.fields[i], quantiles, bins);
+        }
+        int64_t query_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        res.status = 200;
+        std::cout << "GET /stats: " << stats.fields[0].moments.count << " sample(-s) in " << query_us << " us\n";
+        res.set_content(responseJson.dump(), "application/json");
+    });
+
+    svr_.Get("/alerts", [&](const httplib::Request &req, httplib::Response &res) {
+        // Optional: events after seq `after` (default 0 - all still in the ring), at most `limit`
+        uint64_t after = 0;
+        size_t limit = 1000;
+        try {
+            if (req.has_param("after")) after = std::stoull(req.get_param_value("after"));
+            if (req.has_param("limit")) {
+                int candidate = std::stoi(req.get_param_value("limit"));
+                if (candidate <= 0) throw std::invalid_argument("limit must be positive");
+                limit = static_cast<size_t>(candidate);
+            }
+        } catch (const std::exception &e) {
+            res.status = 400; // Bad Request
+            std::cout << "GET /alerts: Invalid parameter: " << e.what() << "\n";
+            res.set_content("GET /alerts: Invalid parameter: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        nlohmann::json responseJson;
+        responseJson["rules"] = nlohmann::json::array();
+        for (size_t i = 0; i < alerts_.rules().size(); i++) {
+            auto rule = alertRuleToJson(alerts_.rules()[i]);
+            rule["active"] = alerts_.active(i);
+            responseJson["rules"].push_back(rule);
+        }
+        auto events = alerts_.eventsAfter(after, limit);
+        responseJson["last_seq"] = alerts_.getStats().events;
+        responseJson["events"] = nlohmann::json::array();
+        for (const auto& event : events) {
+            responseJson["events"].push_back(alertEventToJson(event, alerts_.rules()));
+        }
+        res.status = 200;
+        res.set_content(responseJson.dump(), "application/json");
+    });
+
+    svr_.Get("/alerts/stream", [&](const httplib::Request &req, httplib::Response &res) {
+        // Every stream holds a worker - half of them stay for everything else
+        const size_t max_streams = std::max<size_t>(1, pool_.threads / 2);
+        if (alert_streams_.fetch_add(1) >= max_streams) {
+            alert_streams_--;
+            res.status = 503; // Service Unavailable
+            res.set_header("Retry-After", std::to_string(pool_.retry_after_s));
+            res.set_content("GET /alerts/stream: " + std::to_string(max_streams) + " stream(-s) open already\n",
+                            "text/plain");
+            return;
+        }
+        // From the event after Last-Event-ID (a reconnecting EventSource) or `after`, default: new events only
+        auto after = std::make_shared<uint64_t>(alerts_.getStats().events);
+        try {
+            if (req.has_header("Last-Event-ID")) {
+                *after = std::stoull(req.get_header_value("Last-Event-ID"));
+            } else if (req.has_param("after")) {
+                *after = std::stoull(req.get_param_value("after"));
+            }
+        } catch (const std::exception &e) {
+            alert_streams_--;
+            res.status = 400; // Bad Request
+            res.set_content("GET /alerts/stream: Invalid parameter: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        std::cout << "GET /alerts/stream: " << req.remote_addr << " - events after " << *after << "\n";
+        res.set_header("Cache-Control", "no-cache");
+        res.set_header("X-Accel-Buffering", "no");   // Proxies pass every event on right away
+        res.set_chunked_content_provider("text/event-stream", [this, after](size_t, httplib::DataSink &sink) {
+            if (alerts_.closed()) {
+                sink.done();
+                return true;
+            }
+            auto events = alerts_.eventsAfter(*after, 256);
+            if (events.empty()) {
+                // Nothing within 15 s - a comment line, so the connection isn't idle and a dead client is noticed
+                if (!alerts_.waitForEvents(*after, std::chrono::seconds(15)) && !alerts_.closed()) {
+                    return sink.write(": keep-alive\n\n", 14);
+                }
+                return true;
+            }
+            std::string part;
+            for (const auto& event : events) {
+                part += "id: " + std::to_string(event.seq) + "\nevent: " + (event.raised ? "raised" : "cleared") +
+                        "\ndata: " + alertEventToJson(event, alerts_.rules()).dump() + "\n\n";
+                *after = event.seq;
+            }
+            return sink.write(part.data(), part.size());
+        }, [this](bool) { alert_streams_--; });
+    });
+
     svr_.Get("/device", [&](const httplib::Request &req, httplib::Response &res) {
+        if (notModified(req, res)) {
+            return;
+        }
         try {
-            auto last10 = db_manager_.getLastNMessages(10);
+            DatabaseManager::QueryCost cost;
+            auto last10 = db_manager_.getLastNMessages(10, &cost);
             nlohmann::json responseJson;
+            DeviceConfig config = config_.load();
             responseJson["curr_config"] = {
-                {"frequency", frequency_},
-                {"debug", debug_}
+                {"frequency", config.frequency},
+                {"debug", config.debug}
             };
             if (!last10.empty()) {
                 const auto& latest = last10.front(); // Latest is the first due to DESC order
                 responseJson["latest"] = {
-                    {"pressure", static_cast<float>(latest.pressure)},
-                    {"temperature", static_cast<float>(latest.temperature)},
-                    {"velocity", static_cast<float>(latest.velocity)}
+                    {"pressure", fp16::toFloat(latest.pressure)},
+                    {"temperature", fp16::toFloat(latest.temperature)},
+                    {"velocity", fp16::toFloat(latest.velocity)}
                 };
                 // Sum up everything from last 10 messages
                 double sumP = 0.0, sumT = 0.0, sumV = 0.0;
                 for (const auto& msg : last10) {
-                    sumP += static_cast<float>(msg.pressure);
-                    sumT += static_cast<float>(msg.temperature);
-                    sumV += static_cast<float>(msg.velocity);
+                    sumP += fp16::toFloat(msg.pressure);
+                    sumT += fp16::toFloat(msg.temperature);
+                    sumV += fp16::toFloat(msg.velocity);
                 }
                 // Divide everything by 10 (if exists)
                 int count = last10.size();
@@ -409,6 +2497,7 @@ void HTTPServer::registerEndpoints() {
             res.status = 200;
             std::cout << "GET /device: Returned Metadata Successfully\n";
             res.set_content(responseJson.dump(), "application/json");
+            recordCost("GET /device", req.remote_addr, cost, res.body.size());
         } catch (const std::exception &e) {
             res.status = 500;
             std::cout << "GET /device: Error retrieving device metadata - " << e.what() << "\n";
@@ -417,6 +2506,7 @@ void HTTPServer::registerEndpoints() {
     });
     
     svr_.Put("/configure", [&](const httplib::Request &req, httplib::Response &res) {
+        DeviceCommand command;
         try {
             auto jsonBody = nlohmann::json::parse(req.body);
             if (!jsonBody.contains("frequency") || !jsonBody.contains("debug")) {
@@ -425,67 +2515,294 @@ void HTTPServer::registerEndpoints() {
                 res.set_content("PUT /configure: Missing required parameters: frequency and debug\n", "text/plain");
                 return;
             }
-            int newFrequency = jsonBody["frequency"];
-            bool newDebug = jsonBody["debug"];
-            if (newFrequency <= 0 || newFrequency > 255) {
-                res.status = 400;
-                std::cout << "PUT /configure: Frequency must be between 1 and 255\n";
-                res.set_content("PUT /configure: Frequency must be between 1 and 255\n", "text/plain");
-                return;
-            }
-            std::unique_lock<std::mutex> lock(cmd_mutex_);
-            // Prepare and send the configure command
-            pending_cmd_ = "$2," + std::to_string(newFrequency) + "," + (newDebug ? "1" : "0");
-            cmd_response_received_ = false;
-            serial_.sendData(pending_cmd_ + "\n"); // E.g, sends "$2,v1,v2\n" over UART
+            jsonBody["command"] = "configure";
+            command = parseDeviceCommand(jsonBody);
+        } catch (const std::invalid_argument& e) {
+            res.status = 400;
+            std::cout << "PUT /configure: " << e.what() << "\n";
+            res.set_content("PUT /configure: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        } catch (const std::exception& e) {
+            res.status = 500;
+            std::cout << "PUT /configure: Error - " << e.what() << "\n";
+            res.set_content("PUT /configure: Error - " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+        std::unique_lock<std::mutex> sequence = lockCommands();
+        auto result = executeCommand(command);
+        std::cout << "PUT /configure: " << result.message << "\n";
+        res.set_content("PUT /configure: " + result.message + "\n", "text/plain");
+        res.status = result.status;
+    });
 
-            // Wait for response or timeout (10 seconds)
-            bool response_valid = cmd_cv_.wait_for(
-                lock, 
-                std::chrono::seconds(10),
-                [&] { return cmd_response_received_; }
-            );
-            
-            if (!response_valid) {
-                res.status = 500;
-                std::cout << "PUT /configure: Timeout: No response from device\n";
-                res.set_content("PUT /configure: Timeout: No response from device\n", "text/plain");
-                
-            } else {
-                if (cmd_response_ == "ok") {
-                    // Upd server configuration after successful response
-                    frequency_ = newFrequency;
-                    debug_ = newDebug;
-
-                    // Upd database-manager
-                    db_manager_.updFrequency(frequency_);
-                    db_manager_.updDebug(debug_);
-
-                    // Upd serial port
-                    serial_.updBaudRate(frequency_ * 1000);
-
-                    std::cout << "PUT /configure: Configuration updated and sent to device successfully\n";
-                    res.set_content("PUT /configure: Configuration updated and sent to device successfully\n", "text/plain");
-                    res.status = 200;
-                    
-                } else if (cmd_response_ == "invalid command") {
-                    res.status = 400;
-                    std::cout << "PUT /configure: Device rejected the configuration\n";
-                    res.set_content("PUT /configure: Device rejected the configuration\n", "text/plain");
-                    
-                } else {
-                    res.status = 500;
-                    std::cout << "PUT /configure: Unexpected response: " << cmd_response_ << "\n";
-                    res.set_content("PUT /configure: Unexpected response: " + cmd_response_ + "\n", "text/plain");
+    // A list of device commands in one request, executed back to back. cmd_sequence_mutex_ is held for
+    // the whole list, so no other command gets in between. Stops at the first one that fails
+    svr_.Post("/commands", [&](const httplib::Request &req, httplib::Response &res) {
+        std::vector<DeviceCommand> commands;
+        try {
+            auto jsonBody = nlohmann::json::parse(req.body);
+            const auto& steps = jsonBody.is_object() ? jsonBody.at("commands") : jsonBody;
+            if (!steps.is_array() || steps.empty()) {
+                throw std::invalid_argument("expected a non-empty array of commands");
+            }
+            if (steps.size() > max_batch_commands) {
+                throw std::invalid_argument("at most " + std::to_string(max_batch_commands) + " commands per request");
+            }
+            for (const auto& step : steps) {
+                try {
+                    commands.push_back(parseDeviceCommand(step));
+                } catch (const std::invalid_argument& e) {
+                    throw std::invalid_argument("command " + std::to_string(commands.size()) + ": " + e.what());
                 }
             }
+        } catch (const std::exception& e) {
+            res.status = 400;
+            std::cout << "POST /commands: Invalid body: " << e.what() << "\n";
+            res.set_content("POST /commands: Invalid body: " + std::string(e.what()) + "\n", "text/plain");
+            return;
+        }
+
+        auto requested = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> sequence = lockCommands();
+        auto locked = std::chrono::steady_clock::now();
+        nlohmann::json results = nlohmann::json::array();
+        int status = 200;
+        for (const auto& command : commands) {
+            auto step_start = std::chrono::steady_clock::now();
+            auto result = executeCommand(command);
+            nlohmann::json step = {
+                {"command", DeviceCommand::typeName(command.type)},
+                {"status", result.status},
+                {"message", result.message},
+                {"response", result.response.empty() ? nlohmann::json(nullptr) : nlohmann::json(result.response)},
+                {"round_trip_us", result.round_trip_us},
+                {"duration_us", std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - step_start).count()}
+            };
+            if (command.type == DeviceCommand::Type::Configure) {
+                step["frequency"] = command.frequency;
+                step["debug"] = command.debug;
+            }
+            results.push_back(step);
+            if (result.status != 200) {
+                status = result.status;
+                break;
+            }
+        }
+        sequence.unlock();
+        auto finished = std::chrono::steady_clock::now();
+
+        nlohmann::json responseJson;
+        responseJson["success"] = status == 200;
+        responseJson["requested"] = commands.size();
+        responseJson["completed"] = status == 200 ? results.size() : results.size() - 1;
+        responseJson["lock_wait_us"] = std::chrono::duration_cast<std::chrono::microseconds>(locked - requested).count();
+        responseJson["total_us"] = std::chrono::duration_cast<std::chrono::microseconds>(finished - requested).count();
+        responseJson["steps"] = results;
+        std::cout << "POST /commands: " << responseJson["completed"] << " of " << commands.size()
+                  << " command(-s) done in " << responseJson["total_us"] << " us\n";
+        res.status = status;
+        res.set_content(responseJson.dump(), "application/json");
+    });
+
+    // Spans recorded so far as Chrome trace-event JSON - open in chrome://tracing or ui.perfetto.dev.
+    // ?clear=1 empties the rings afterwards, so the next call only has what happened in between
+    svr_.Get("/debug/trace", [&](const httplib::Request &req, httplib::Response &res) {
+        const bool clear = req.has_param("clear") && req.get_param_value("clear") == "1";
+        auto json = traceToJson(trace::collect(clear));
+        res.status = 200;
+        res.set_content(json.dump(), "application/json");
+    });
 
-            
+    // {"enabled": true | false} - switches tracing on and off at runtime, spans already recorded stay
+    svr_.Put("/debug/trace", [&](const httplib::Request &req, httplib::Response &res) {
+        try {
+            bool enabled = nlohmann::json::parse(req.body).at("enabled").get<bool>();
+            trace::setEnabled(enabled);
+            std::cout << "PUT /debug/trace: Tracing " << (enabled ? "enabled" : "disabled") << "\n";
+            res.set_content(std::string("PUT /debug/trace: Tracing ") + (enabled ? "enabled" : "disabled") + "\n",
+                            "text/plain");
+            res.status = 200;
         } catch (const std::exception& e) {
-            res.status = 500;
-            std::cout << "PUT /configure: Error - " << e.what() << "\n";
-            res.set_content("PUT /configure: Error - " + std::string(e.what()) + "\n", "text/plain");
+            res.status = 400;
+            std::cout << "PUT /debug/trace: Expected {\"enabled\": true | false} - " << e.what() << "\n";
+            res.set_content("PUT /debug/trace: Expected {\"enabled\": true | false} - " + std::string(e.what()) + "\n",
+                            "text/plain");
+        }
+    });
+
+    // Runtime counters of the server, grouped by component
+    svr_.Get("/metrics", [&](const httplib::Request &, httplib::Response &res) {
+        auto write_stats = serial_.getWriteStats();
+        nlohmann::json recent = nlohmann::json::array();
+        for (const auto& record : write_stats.recent) {
+            recent.push_back({
+                {"command", record.command},
+                {"bytes", record.bytes},
+                {"time_to_wire_us", record.time_to_wire_us}
+            });
+        }
+        nlohmann::json responseJson;
+        responseJson["serial"] = {
+            {"write_queue_depth", write_stats.queue_depth},
+            {"write_queue_bytes", write_stats.queued_bytes},
+            {"commands_sent", write_stats.commands_sent},
+            {"partial_writes", write_stats.partial_writes},
+            {"would_block", write_stats.would_block},
+            {"last_time_to_wire_us", write_stats.last_time_to_wire_us},
+            {"max_time_to_wire_us", write_stats.max_time_to_wire_us},
+            {"recent_writes", recent}
+        };
+        auto line_stats = serial_.getLineStats();
+        responseJson["uart"] = {
+            {"port", serial_.getPortName()},
+            {"baud_rate", serial_.getBaudRate()},
+            {"icount_supported", line_stats.icount_supported},
+            {"rx", line_stats.rx},
+            {"tx", line_stats.tx},
+            {"overrun", line_stats.overrun},
+            {"buf_overrun", line_stats.buf_overrun},
+            {"frame_errors", line_stats.frame},
+            {"parity_errors", line_stats.parity},
+            {"breaks", line_stats.brk},
+            {"queue_supported", line_stats.queue_supported},
+            {"input_pending", line_stats.input_pending},
+            {"output_pending", line_stats.output_pending}
+        };
+        responseJson["ingest"] = {
+            {"bytes_read", ingest_stats_.bytes_read.load()},
+            {"discarded_bytes", ingest_stats_.discarded_bytes.load()},
+            {"frames", ingest_stats_.frames.load()},
+            {"samples_journaled", ingest_stats_.samples_journaled.load()},
+            {"parse_errors", ingest_stats_.parse_errors.load()},
+            {"journal_errors", ingest_stats_.journal_errors.load()},
+            {"ignored_frames", ingest_stats_.ignored_frames.load()},
+            {"last_append_us", ingest_stats_.last_append_us.load()},
+            {"max_append_us", ingest_stats_.max_append_us.load()}
+        };
+        responseJson["commands"] = nlohmann::json::object();
+        for (auto type : {DeviceCommand::Type::Start, DeviceCommand::Type::Stop, DeviceCommand::Type::Configure}) {
+            auto command_stats = getCommandStats(type);
+            nlohmann::json histogram = nlohmann::json::array();
+            for (size_t i = 0; i < CommandStats::histogram_buckets; i++) {
+                if (command_stats.histogram[i] == 0) continue;
+                histogram.push_back({
+                    {"lower_us", i == 0 ? 0 : int64_t{1} << i},
+                    {"upper_us", i + 1 == CommandStats::histogram_buckets ? nlohmann::json(nullptr)
+                                                                         : nlohmann::json(int64_t{2} << i)},
+                    {"count", command_stats.histogram[i]}
+                });
+            }
+            nlohmann::json round_trip = summaryToJson(command_stats.round_trip_us, {0.5, 0.9, 0.99, 1}, 0);
+            round_trip["histogram"] = histogram;
+            responseJson["commands"][DeviceCommand::typeName(type)] = {
+                {"sent", command_stats.sent},
+                {"ok", command_stats.ok},
+                {"rejected", command_stats.rejected},
+                {"mismatched", command_stats.mismatched},
+                {"undefined", command_stats.undefined},
+                {"timeouts", command_stats.timeouts},
+                {"late", command_stats.late},
+                {"last_round_trip_us", command_stats.last_round_trip_us},
+                {"round_trip_us", round_trip}
+            };
+        }
+        auto writer_stats = db_manager_.getWriterStats();
+        responseJson["storage"] = {
+            {"journal_last_seq", writer_stats.journal.last_seq},
+            {"journal_synced_seq", writer_stats.journal.synced_seq},
+            {"journal_segments", writer_stats.journal.segments},
+            {"journal_syncs", writer_stats.journal.syncs},
+            {"last_sync_us", writer_stats.journal.last_sync_us},
+            {"max_sync_us", writer_stats.journal.max_sync_us},
+            {"committed_seq", writer_stats.committed_seq},
+            {"backlog", writer_stats.journal.last_seq - std::min(writer_stats.journal.last_seq, writer_stats.committed_seq)},
+            {"samples_stored", writer_stats.samples},
+            {"batches", writer_stats.batches},
+            {"last_batch_size", writer_stats.last_batch_size},
+            {"last_commit_us", writer_stats.last_commit_us},
+            {"max_commit_us", writer_stats.max_commit_us},
+            {"commit_errors", writer_stats.commit_errors},
+            {"samples_sealed", writer_stats.samples_sealed},
+            {"chunks_sealed", writer_stats.chunks_sealed},
+            {"last_seal_us", writer_stats.last_seal_us},
+            {"db_profile", db_manager_.getProfile().name},
+            {"journal_mode", db_manager_.getProfile().journal_mode},
+            {"synchronous", db_manager_.getProfile().synchronous},
+            {"partition_period", PartitionSettings::periodName(db_manager_.getPartitionSettings().period)},
+            {"partitions", db_manager_.getPartitionCount()}
+        };
+        auto alert_stats = alerts_.getStats();
+        responseJson["alerts"] = {
+            {"rules", alerts_.rules().size()},
+            {"active", alert_stats.active},
+            {"samples", alert_stats.samples},
+            {"events", alert_stats.events},
+            {"overwritten", alert_stats.overwritten},
+            {"streams", alert_streams_.load()}
+        };
+        responseJson["stats"] = {
+            {"minutes", db_manager_.getStatsSettings().minutes},
+            {"hours", db_manager_.getStatsSettings().hours},
+            {"relative_accuracy", db_manager_.getStatsSettings().relative_accuracy},
+            {"memory_bytes", db_manager_.getStatsMemory()}
+        };
+        auto trace_stats = trace::getStats();
+        responseJson["trace"] = {
+            {"enabled", trace_stats.enabled},
+            {"capacity", trace_stats.capacity},
+            {"threads", trace_stats.threads},
+            {"recorded", trace_stats.recorded},
+            {"overwritten", trace_stats.overwritten}
+        };
+        auto replay_stats = db_manager_.getReplayStats();
+        responseJson["recovery"] = {
+            {"from_seq", replay_stats.from_seq},
+            {"to_seq", replay_stats.to_seq},
+            {"samples_replayed", replay_stats.samples},
+            {"duration_ms", replay_stats.duration_ms},
+            {"rate_per_s", replay_stats.rate_per_s}
+        };
+        responseJson["http"] = {
+            {"not_modified", not_modified_.load()},
+            {"gzip_responses", gzip_responses_.load()},
+            {"gzip_bytes_in", gzip_bytes_in_.load()},
+            {"gzip_bytes_out", gzip_bytes_out_.load()},
+            {"threads", pool_.threads},
+            {"max_queued", pool_.max_queued},
+            {"queued", queue_stats_.queued.load()},
+            {"busy", queue_stats_.busy.load()},
+            {"connections", queue_stats_.connections.load()},
+            {"shed", queue_stats_.shed.load()},
+            {"dropped", queue_stats_.dropped.load()},
+            {"last_queue_wait_us", queue_stats_.last_wait_us.load()},
+            {"max_queue_wait_us", queue_stats_.max_wait_us.load()},
+            {"mean_queue_wait_us", queue_stats_.connections.load() == 0 ? 0.0 :
+                static_cast<double>(queue_stats_.total_wait_us.load()) / queue_stats_.connections.load()}
+        };
+        auto costJson = [](const std::map<std::string, RequestCostTotals>& totals) {
+            nlohmann::json json = nlohmann::json::object();
+            for (const auto& [name, cost] : totals) {
+                json[name] = {
+                    {"requests", cost.requests},
+                    {"rows_scanned", cost.rows_scanned},
+                    {"samples_decoded", cost.samples_decoded},
+                    {"bytes", cost.bytes},
+                    {"max_rows_scanned", cost.max_rows_scanned}
+                };
+            }
+            return json;
+        };
+        {
+            std::lock_guard<std::mutex> lock(cost_mutex_);
+            responseJson["cost"] = {
+                {"max_limit", query_.max_limit},
+                {"endpoints", costJson(cost_by_endpoint_)},
+                {"clients", costJson(cost_by_client_)}
+            };
         }
+        res.status = 200;
+        res.set_content(responseJson.dump(), "application/json");
     });
 }
 // Returns true if the hostname is valid (i.e. resolvable)
@@ -519,3 +2836,326 @@ std::string trim(const std::string &s) {
     size_t end = s.find_last_not_of(" \t\n\r");
     return (start == std::string::npos) ? "" : s.substr(start, end - start + 1);
 }
+
+bool parseMessage(const std::string& message, float& pressure, float& temperature, float& velocity) {
+    std::istringstream iss(message);
+    char comma;
+    return (iss >> pressure >> comma >> temperature >> comma >> velocity) && (comma == ',');
+}
+
+// Scans with an offset and erases the consumed part once, instead of copying the rest of the
+// buffer after every frame
+size_t extractFrames(std::string& buffer, std::vector<std::string>& frames) {
+    size_t dropped = 0;
+    size_t pos = 0;
+    while (pos < buffer.size()) {
+        size_t start = buffer.find('$', pos);
+        if (start == std::string::npos) {
+            // No frame start at all - nothing here can become a frame
+            dropped += buffer.size() - pos;
+            pos = buffer.size();
+            break;
+        }
+        dropped += start - pos;
+        size_t end = buffer.find('\n', start);
+        if (end == std::string::npos) {
+            pos = start; // Incomplete message
+            break;
+        }
+        frames.emplace_back(buffer, start, end - start);
+        pos = end + 1;
+    }
+    buffer.erase(0, pos);
+    return dropped;
+}
+
+// Converts all values in one batch first - SensorData is laid out as 3 halves + padding + timestamp,
+// so the halves are gathered into one contiguous array
+ExportBody::ExportBody(std::unique_ptr<DatabaseManager::ExportCursor> cursor, Format format)
+    : cursor_(std::move(cursor)), format_(format) {
+    if (format_ == Format::Csv) {
+        header_ = "timestamp,pressure,temperature,velocity\n";
+        sample_bytes_ = 47;                              // 10 + 3 * (1 + 11) + '\n'
+    } else {
+        uint32_t block = static_cast<uint32_t>(DatabaseManager::ExportCursor::batch_samples);
+        uint64_t count = cursor_->count();
+        int64_t from = cursor_->from(), to = cursor_->to();
+        header_.assign(32, '\0');
+        std::memcpy(&header_[0], "SDX1", 4);
+        std::memcpy(&header_[4], &block, sizeof(block));
+        std::memcpy(&header_[8], &count, sizeof(count));
+        std::memcpy(&header_[16], &from, sizeof(from));
+        std::memcpy(&header_[24], &to, sizeof(to));
+        sample_bytes_ = sizeof(int64_t) + 3 * sizeof(uint16_t);
+    }
+}
+
+const DatabaseManager::QueryCost& ExportBody::cost() const { return cursor_->cost(); }
+
+size_t ExportBody::size() const {
+    return header_.size() + static_cast<size_t>(cursor_->count()) * sample_bytes_;
+}
+
+bool ExportBody::read(size_t offset, size_t length, httplib::DataSink& sink) {
+    if (offset < header_.size()) {
+        return sink.write(header_.data() + offset, std::min(length, header_.size() - offset));
+    }
+    const size_t page_bytes = DatabaseManager::ExportCursor::batch_samples * sample_bytes_;
+    size_t page = (offset - header_.size()) / page_bytes;
+    size_t in_page = (offset - header_.size()) % page_bytes;
+    if (page != page_ && !loadPage(page)) {
+        return false;
+    }
+    return sink.write(page_data_.data() + in_page, std::min(length, page_data_.size() - in_page));
+}
+
+bool ExportBody::loadPage(size_t page) {
+    const size_t page_samples = DatabaseManager::ExportCursor::batch_samples;
+    uint64_t first = static_cast<uint64_t>(page) * page_samples;
+    size_t n = static_cast<size_t>(std::min<uint64_t>(page_samples, cursor_->count() - first));
+    samples_.resize(n);
+    cursor_->seek(first);
+    if (cursor_->read(samples_.data(), n) != n) {
+        std::cout << "GET /export: Fewer samples than counted - data was dropped while exporting\n";
+        page_ = SIZE_MAX;
+        return false;
+    }
+
+    page_data_.resize(n * sample_bytes_);
+    char* out = &page_data_[0];
+    if (format_ == Format::Csv) {
+        std::vector<uint16_t> halves(n * 3);
+        for (size_t i = 0; i < n; i++) {
+            halves[3 * i] = samples_[i].pressure;
+            halves[3 * i + 1] = samples_[i].temperature;
+            halves[3 * i + 2] = samples_[i].velocity;
+        }
+        std::vector<float> values(halves.size());
+        fp16::toFloat(halves.data(), values.data(), halves.size());
+        char row[64];
+        for (size_t i = 0; i < n; i++) {
+            snprintf(row, sizeof(row), "%010lld,%11.4f,%11.4f,%11.4f\n", static_cast<long long>(samples_[i].timestamp),
+                     values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+            std::memcpy(out + i * sample_bytes_, row, sample_bytes_);
+        }
+    } else {
+        char* timestamps = out;
+        char* pressures = timestamps + n * sizeof(int64_t);
+        char* temperatures = pressures + n * sizeof(uint16_t);
+        char* velocities = temperatures + n * sizeof(uint16_t);
+        for (size_t i = 0; i < n; i++) {
+            std::memcpy(timestamps + i * sizeof(int64_t), &samples_[i].timestamp, sizeof(int64_t));
+            std::memcpy(pressures + i * sizeof(uint16_t), &samples_[i].pressure, sizeof(uint16_t));
+            std::memcpy(temperatures + i * sizeof(uint16_t), &samples_[i].temperature, sizeof(uint16_t));
+            std::memcpy(velocities + i * sizeof(uint16_t), &samples_[i].velocity, sizeof(uint16_t));
+        }
+    }
+    page_ = page;
+    return true;
+}
+
+void CommandStats::add(int64_t us) {
+    last_round_trip_us = us;
+    round_trip_us.add(static_cast<double>(us));
+    size_t bucket = 0;
+    while (bucket + 1 < histogram_buckets && us >= (int64_t{2} << bucket)) bucket++;
+    histogram[bucket]++;
+}
+
+const char* DeviceCommand::typeName(Type type) {
+    switch (type) {
+    case Type::Start: return "start";
+    case Type::Stop: return "stop";
+    case Type::Configure: return "configure";
+    }
+    return "";
+}
+
+DeviceCommand parseDeviceCommand(const nlohmann::json& json) {
+    DeviceCommand command;
+    try {
+        const std::string name = json.at("command").get<std::string>();
+        if (name == "start") {
+            command.type = DeviceCommand::Type::Start;
+        } else if (name == "stop") {
+            command.type = DeviceCommand::Type::Stop;
+        } else if (name == "configure") {
+            command.type = DeviceCommand::Type::Configure;
+            int frequency = json.at("frequency").get<int>();
+            if (frequency <= 0 || frequency > 255) {
+                throw std::invalid_argument("Frequency must be between 1 and 255");
+            }
+            command.frequency = static_cast<uint8_t>(frequency);
+            command.debug = json.at("debug").get<bool>();
+        } else {
+            throw std::invalid_argument("command '" + name + "' is none of 'start', 'stop' and 'configure'");
+        }
+    } catch (const nlohmann::json::exception& e) {
+        throw std::invalid_argument(e.what());
+    }
+    return command;
+}
+
+std::vector<alerts::Rule> parseAlertRules(const nlohmann::json& json) {
+    if (!json.is_array()) throw std::invalid_argument("expected an array of rules");
+    std::vector<alerts::Rule> rules;
+    for (const auto& item : json) {
+        alerts::Rule rule;
+        try {
+            rule.name = item.at("name").get<std::string>();
+            rule.channel = alerts::Rule::channelByName(item.at("channel").get<std::string>());
+            const std::string type = item.value("type", "threshold");
+            if (type == "threshold") {
+                rule.kind = alerts::Kind::Threshold;
+            } else if (type == "rate") {
+                rule.kind = alerts::Kind::Rate;
+            } else {
+                throw std::invalid_argument("type '" + type + "' is neither 'threshold' nor 'rate'");
+            }
+            const std::string op = item.value("op", ">");
+            if (op != ">" && op != "<") throw std::invalid_argument("op '" + op + "' is neither '>' nor '<'");
+            rule.op = op == ">" ? alerts::Op::Above : alerts::Op::Below;
+            rule.threshold = item.at("threshold").get<double>();
+            rule.hysteresis = item.value("hysteresis", 0.0);
+            rule.window_ms = item.value("window_ms", rule.window_ms);
+        } catch (const nlohmann::json::exception& e) {
+            throw std::invalid_argument("rule " + std::to_string(rules.size()) + ": " + e.what());
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("rule " + std::to_string(rules.size()) + ": " + e.what());
+        }
+        if (rule.hysteresis < 0 || rule.window_ms < 0) {
+            throw std::invalid_argument("rule '" + rule.name + "': hysteresis and window_ms can't be negative");
+        }
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+nlohmann::json alertRuleToJson(const alerts::Rule& rule) {
+    nlohmann::json json = {
+        {"name", rule.name},
+        {"channel", alerts::Rule::channelName(rule.channel)},
+        {"type", rule.kind == alerts::Kind::Threshold ? "threshold" : "rate"},
+        {"op", rule.op == alerts::Op::Above ? ">" : "<"},
+        {"threshold", rule.threshold},
+        {"hysteresis", rule.hysteresis}
+    };
+    if (rule.kind == alerts::Kind::Rate) {
+        json["window_ms"] = rule.window_ms;
+    }
+    return json;
+}
+
+nlohmann::json alertEventToJson(const alerts::Event& event, const std::vector<alerts::Rule>& rules) {
+    const auto& rule = rules[event.rule];
+    return {
+        {"seq", event.seq},
+        {"time_ms", event.wall_ms},
+        {"rule", rule.name},
+        {"channel", alerts::Rule::channelName(rule.channel)},
+        {"state", event.raised ? "raised" : "cleared"},
+        {"value", event.value}
+    };
+}
+
+nlohmann::json summaryToJson(const sketch::Summary& summary, const std::vector<double>& quantiles, int bins) {
+    const auto& moments = summary.moments;
+    nlohmann::json json = {{"count", moments.count}, {"non_finite", summary.non_finite}};
+    if (moments.count == 0) {
+        json["mean"] = json["stddev"] = json["min"] = json["max"] = nullptr;
+        json["quantiles"] = nlohmann::json::object();
+        json["histogram"] = nlohmann::json::array();
+        return json;
+    }
+    json["mean"] = moments.mean;
+    json["stddev"] = std::sqrt(moments.variance());
+    json["min"] = moments.min;
+    json["max"] = moments.max;
+    nlohmann::json quantileJson = nlohmann::json::object();
+    for (double q : quantiles) {
+        // Within the relative accuracy of the true value - and never outside what was seen. The ends are exact
+        char name[32];
+        snprintf(name, sizeof(name), "%g", q);
+        quantileJson[name] = q == 0 ? moments.min : q == 1 ? moments.max
+                                    : std::clamp(summary.quantiles.quantile(q), moments.min, moments.max);
+    }
+    json["quantiles"] = quantileJson;
+
+    nlohmann::json histogram = nlohmann::json::array();
+    if (bins > 0) {
+        const double width = (moments.max - moments.min) / bins;
+        std::vector<uint64_t> counts(static_cast<size_t>(bins), 0);
+        for (const auto& bucket : summary.quantiles.buckets()) {
+            double value = std::clamp((bucket.lower + bucket.upper) / 2, moments.min, moments.max);
+            size_t bin = width > 0 ? std::min(static_cast<size_t>((value - moments.min) / width), counts.size() - 1) : 0;
+            counts[bin] += bucket.count;
+        }
+        for (int i = 0; i < (width > 0 ? bins : 1); i++) {
+            histogram.push_back({
+                {"lower", moments.min + width * i},
+                {"upper", width > 0 ? moments.min + width * (i + 1) : moments.max},
+                {"count", counts[static_cast<size_t>(i)]}
+            });
+        }
+    }
+    json["histogram"] = histogram;
+    return json;
+}
+
+nlohmann::json traceToJson(const std::vector<trace::ThreadTrace>& traces) {
+    const int pid = static_cast<int>(getpid());
+    nlohmann::json events = nlohmann::json::array();
+    uint64_t overwritten = 0;
+    for (const auto& thread : traces) {
+        overwritten += thread.overwritten;
+        events.push_back({
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", pid},
+            {"tid", thread.tid},
+            {"args", {{"name", thread.exited ? thread.name + " (exited)" : thread.name}}}
+        });
+        for (const auto& event : thread.events) {
+            nlohmann::json json = {
+                {"name", event.name},
+                {"cat", event.category},
+                {"ph", "X"},
+                {"ts", event.start_ns / 1000.0},
+                {"dur", event.duration_ns / 1000.0},
+                {"pid", pid},
+                {"tid", thread.tid}
+            };
+            if (event.arg_name) {
+                json["args"] = {{event.arg_name, event.arg}};
+            }
+            events.push_back(json);
+        }
+    }
+    return {
+        {"traceEvents", events},
+        {"displayTimeUnit", "ms"},
+        {"otherData", {{"overwritten", overwritten}}}
+    };
+}
+
+nlohmann::json messagesToJson(const std::vector<DatabaseManager::SensorData>& messages) {
+    std::vector<uint16_t> halves(messages.size() * 3);
+    for (size_t i = 0; i < messages.size(); i++) {
+        halves[3 * i] = messages[i].pressure;
+        halves[3 * i + 1] = messages[i].temperature;
+        halves[3 * i + 2] = messages[i].velocity;
+    }
+    std::vector<float> values(halves.size());
+    fp16::toFloat(halves.data(), values.data(), halves.size());
+
+    nlohmann::json jsonArray = nlohmann::json::array();
+    for (size_t i = 0; i < messages.size(); i++) {
+        nlohmann::json jsonObj;
+        jsonObj["pressure"] = values[3 * i];
+        jsonObj["temperature"] = values[3 * i + 1];
+        jsonObj["velocity"] = values[3 * i + 2];
+        jsonObj["timestamp"] = messages[i].timestamp;
+        jsonArray.push_back(jsonObj);
+    }
+    return jsonArray;
+}
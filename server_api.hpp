@@ -5,6 +5,13 @@
 #include "httplib.h"
 #include "nlohmann/json.hpp"
 #include "serial_interface.hpp"
+#include "frame_journal.hpp"
+#include "fp16.hpp"
+#include "chunk_codec.hpp"
+#include "compression.hpp"
+#include "sketch.hpp"
+#include "alerts.hpp"
+#include "trace.hpp"
 #include <string>
 #include <cstring>
 #include <algorithm>
@@ -13,25 +20,337 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <sstream>
 #include <atomic>
 #include <mutex> 
 #include <condition_variable>
+#include <thread>
 #include <filesystem>
+#include <unordered_map>
+#include <map>
+#include <deque>
 #include <netdb.h>
 
 namespace fs = std::filesystem; // to make code more readable
 
+// SQLite settings applied when the database is opened. Use one of the named profiles:
+//   durable    - rollback journal, fsync on every commit (SQLite defaults)
+//   balanced   - WAL, fsync at checkpoints only. A power cut can lose the last commits, but they
+//                are still in the frame journal and are replayed at startup
+//   throughput - WAL without fsync, large cache and mmap. A power cut can corrupt the database
+struct DatabaseProfile {
+    std::string name = "balanced";
+    std::string journal_mode = "WAL";
+    std::string synchronous = "NORMAL";
+    int64_t mmap_size = 64 * 1024 * 1024;                 // Bytes, 0 = no mmap
+    int cache_size = -16 * 1024;                          // Negative = KiB, as in PRAGMA cache_size
+    int page_size = 4096;                                 // Only takes effect for new database files
+    std::string temp_store = "MEMORY";
+
+    static DatabaseProfile byName(const std::string& name);  // Throws std::invalid_argument if unknown
+};
+
+// Samples in one SQLite file per day or week (UTC) instead of all in DB_PATH. The files are named
+// after their first day, e.g. '<DB_PATH>.days/2026-10-18.db' or '<DB_PATH>.weeks/2026-10-12.db'
+// (weeks start on Monday). The Series table stays in DB_PATH
+struct PartitionSettings {
+    enum class Period { None, Day, Week };
+    Period period = Period::None;                         // None: all samples in DB_PATH
+    int retention_days = 0;                               // Partitions that ended longer ago are deleted, 0 = keep all
+
+    static Period periodByName(const std::string& name);  // none, day or week. Throws std::invalid_argument if unknown
+    static std::string periodName(Period period);
+};
+
+// How the journal writer thread moves frames from the journal into SQLite
+struct JournalWriterSettings {
+    size_t batch_size = 512;                              // Records per transaction
+    std::chrono::milliseconds sync_interval{200};         // How often the journal is msync()'ed
+    size_t retain_segments = 16;                          // Fully stored segments kept for rebuilds
+    std::chrono::seconds seal_after{3600};                // Older samples are packed into chunks, 0 = never
+    size_t chunk_samples = 4096;                          // Samples per chunk
+};
+
+// Streaming statistics per series for GET /stats, kept in memory and updated with every commit:
+// per minute for the last `minutes` minutes of data, per hour for the last `hours` hours
+struct StatsSettings {
+    size_t minutes = 1440;
+    size_t hours = 720;
+    double relative_accuracy = 0.01;                      // Of the quantiles
+};
+
+// gzip Content-Encoding of responses, for clients that send Accept-Encoding: gzip
+struct CompressionSettings {
+    int level = 6;                                        // zlib level 1-9, 0 = never compress
+    size_t min_bytes = 1024;                              // Smaller bodies are sent as they are
+    size_t chunk_bytes = 256 * 1024;                      // Compressed independently of each other
+    size_t threads = 0;                                   // Chunks compressed at once, 0 = one per core
+};
+
+// Workers of the HTTP server. A worker serves one connection at a time, including its keep-alive
+// requests; accepted connections wait in a queue of at most max_queued until a worker is free
+struct HttpPoolSettings {
+    size_t threads = 0;                                   // 0 = httplib's default, max(8, cores - 1)
+    size_t max_queued = 64;                               // Beyond that connections get 503
+    int retry_after_s = 1;                                // Retry-After of the 503
+};
+
+// Reads on behalf of HTTP clients. GET /messages answers up to max_limit samples from one query;
+// a larger limit is streamed in pages of max_limit, so a request never holds more than that
+struct QuerySettings {
+    int max_limit = 10000;
+    size_t cost_clients = 256;                            // Clients with their own cost totals, the rest are "other"
+};
+
+// Rules evaluated on every sample as it is read, see alerts.hpp. Events stay in a ring of ring_size
+// for GET /alerts and /alerts/stream
+struct AlertSettings {
+    std::vector<alerts::Rule> rules;
+    size_t ring_size = 1024;
+};
+
+// Device configuration samples are stored with. Immutable - PUT /configure publishes a new one
+// through ConfigStore, readers take a copy and use it for the whole operation
+struct DeviceConfig {
+    uint8_t frequency = 115;
+    bool debug = false;
+    uint16_t reserved = 0;                                // No padding - compare_exchange compares all bytes
+    uint32_t version = 0;                                 // Bumped by every publish
+};
+
+// The current DeviceConfig in a single atomic word. load() is one lock-free read and never sees
+// half of an update - the serial reader takes a copy per sample, HTTP threads one per request
+class ConfigStore {
+public:
+    explicit ConfigStore(const DeviceConfig& initial = DeviceConfig());
+    DeviceConfig load() const;
+    DeviceConfig publish(uint8_t frequency, bool debug); // Returns what was published
+
+private:
+    std::atomic<DeviceConfig> current_;
+    static_assert(std::atomic<DeviceConfig>::is_always_lock_free, "DeviceConfig has to fit a lock-free atomic");
+};
+
+// One device command: $0 (start), $1 (stop) or $2,frequency,debug (configure). GET /start, /stop and
+// PUT /configure run one each, POST /commands runs a list of them back to back
+struct DeviceCommand {
+    enum class Type { Start, Stop, Configure };
+    Type type = Type::Start;
+    uint8_t frequency = 0;                                // Configure only
+    bool debug = false;
+
+    static const char* typeName(Type type);               // start, stop or configure
+};
+
+struct DeviceCommandResult {
+    int status = 200;                                     // What the single command endpoint answers with
+    std::string message;                                  // Without the endpoint, e.g. "Reading started"
+    std::string response;                                 // Status the device answered with, empty if none
+    int64_t round_trip_us = 0;                            // From sending the command until its response
+};
+
+// Round trips of one device command type, from sendData() until the serial reader matched the response.
+// See GET /metrics "commands"
+struct CommandStats {
+    static constexpr size_t histogram_buckets = 26;       // [2^i, 2^(i+1)) us, the first from 0, the last open
+    uint64_t sent = 0;
+    uint64_t ok = 0;
+    uint64_t rejected = 0;                                // 'invalid command'
+    uint64_t mismatched = 0;                              // Answer to another command, or other values echoed
+    uint64_t undefined = 0;                               // Status neither ok nor invalid command
+    uint64_t timeouts = 0;                                // No answer within 10 s
+    uint64_t late = 0;                                    // Answered after its timeout - counted in round_trip_us too
+    int64_t last_round_trip_us = 0;
+    sketch::Summary round_trip_us;
+    uint64_t histogram[histogram_buckets] = {};
+
+    void add(int64_t us);
+};
+
+// What requests of one endpoint / one client cost in total, see GET /metrics "cost"
+struct RequestCostTotals {
+    uint64_t requests = 0;
+    uint64_t rows_scanned = 0;
+    uint64_t samples_decoded = 0;
+    uint64_t bytes = 0;                                   // Body as produced, before compression
+    uint64_t max_rows_scanned = 0;                        // By a single request
+};
+
 class DatabaseManager {
+public:
+    struct SensorData {
+        uint16_t pressure;     // fp16 bit patterns, see fp16.hpp
+        uint16_t temperature;
+        uint16_t velocity;
+        int64_t timestamp;
+    };
+
+    struct WriterStats {
+        uint64_t committed_seq = 0;                       // Last journal record stored in SQLite
+        uint64_t batches = 0;
+        uint64_t samples = 0;
+        size_t last_batch_size = 0;
+        int64_t last_commit_us = 0;
+        int64_t max_commit_us = 0;
+        uint64_t commit_errors = 0;
+        uint64_t samples_sealed = 0;                      // Packed into chunks
+        uint64_t chunks_sealed = 0;
+        int64_t last_seal_us = 0;
+        FrameJournal::Stats journal;
+    };
+
+    // What a read took: SQLite rows stepped through and samples decoded from chunks, including the
+    // ones filtered out or cut off afterwards
+    struct QueryCost {
+        uint64_t rows_scanned = 0;
+        uint64_t chunks_decoded = 0;
+        uint64_t samples_decoded = 0;
+    };
+
+    struct ReplayStats {
+        uint64_t from_seq = 0;                            // High-water mark found at startup
+        uint64_t to_seq = 0;
+        uint64_t samples = 0;
+        double duration_ms = 0;
+        double rate_per_s = 0;
+    };
+
+    // Samples of one series in [from, to], oldest first, for GET /export. Every batch is read in its
+    // own short read transaction on a read-only connection, so an export running for minutes doesn't
+    // hold back commits or WAL checkpoints. Position between batches is (timestamp, samples of that
+    // second already read) - sealing keeps the order within a second, so it may run in between.
+    // Memory stays at two batches, whatever the range. `to` is cut to the newest sample stored when
+    // the cursor is opened, so samples arriving later don't land in the range
+    class ExportCursor {
+    public:
+        static constexpr size_t batch_samples = 4096;
+        ~ExportCursor();
+        uint64_t count() const;                          // Samples in the range when it was opened
+        int64_t from() const;
+        int64_t to() const;                              // Cut to the newest sample stored
+        // Series, range and count - changes when samples in the range are added or dropped
+        std::string version() const;
+        // The next read starts at the index-th sample. Files in front of it are skipped by their
+        // counts, samples in front of it within its file are read
+        void seek(uint64_t index);
+        size_t read(SensorData* out, size_t max);        // Fewer than max only at the end, or if a file is gone
+        const QueryCost& cost() const;                   // Of the reads so far
+
+    private:
+        friend class DatabaseManager;
+        struct File {
+            fs::path path;
+            bool closed;                                 // No longer written to - dropped from the page cache after reading
+            uint64_t count;
+        };
+        std::vector<File> files_;                        // Oldest first
+        int64_t series_id_ = 0;
+        int64_t from_ = 0;
+        int64_t to_ = 0;
+        uint64_t count_ = 0;
+        uint64_t position_ = 0;                          // Index of the next sample
+        size_t file_ = 0;                                // files_[file_] is open if db_ is
+        uint64_t file_position_ = 0;                     // Samples read from it
+        int64_t key_timestamp_ = 0;                      // Next sample: first one after key_skip_ samples
+        uint64_t key_skip_ = 0;                          // at key_timestamp_
+        sqlite3* db_ = nullptr;
+        int fd_ = -1;                                    // Only for posix_fadvise
+        int64_t file_size_ = 0;
+        int64_t readahead_end_ = 0;
+        std::vector<SensorData> rows_;
+        std::vector<SensorData> chunk_samples_;
+        QueryCost cost_;
+
+        static sqlite3* openFile(const fs::path& path);  // Read-only, nullptr if it doesn't exist (any more)
+        uint64_t countIn(sqlite3* db) const;
+        int64_t newestIn(sqlite3* db) const;             // Newest timestamp <= to_, INT64_MIN if none
+        bool openCurrent();
+        void closeCurrent();
+        void nextFile();
+        size_t readBatch(SensorData* out, size_t max);   // From files_[file_], one read transaction
+    };
+
 private:
     sqlite3* db_;
+    std::string db_path_;
+    DatabaseProfile profile_;
     std::string port_name_;
-    uint8_t& frequency_;  
-    bool& debug_;     
+    const ConfigStore& config_;
     
+    std::string applyProfile(sqlite3* db);               // Returns the journal_mode SQLite accepted
     void createTableIfNotExists();
+    void createSampleTables(sqlite3* db);                // Samples, its index and JournalState
+    void migrateLegacyTable();
     void prepareStatements();
+    void prepareWriteStatements(sqlite3* db, sqlite3_stmt*& insert, sqlite3_stmt*& hwm);
+    bool storeRecordsIn(const std::vector<FrameJournal::Record>& records, const std::vector<int64_t>& series,
+                        size_t begin, size_t end);     // One transaction on write_db_
+    // Rows and chunks in one read transaction - sealing moves samples from one to the other
+    void selectSamples(sqlite3* db, const std::string& schema, int64_t series_id,
+                       int64_t from, int64_t to, int n, std::vector<SensorData>& result, QueryCost* cost);
+    void selectSamplesIn(sqlite3* db, const std::string& schema, int64_t series_id,
+                         int64_t from, int64_t to, int n, std::vector<SensorData>& result, QueryCost* cost);
+    void unsealChunks(sqlite3* db);                      // Chunks back into Samples rows
     bool isPathRestricted(const fs::path& path);
     sqlite3_stmt* insert_stmt_ = nullptr;
+    sqlite3_stmt* hwm_stmt_ = nullptr;
+
+    // Series dictionary: (port, frequency, debug) -> Series.Id. The port is fixed per manager, so the
+    // cache is keyed by frequency << 1 | debug, 0 if there is no such series yet. Guards the series
+    // statements as well
+    std::mutex series_mutex_;
+    std::unordered_map<uint32_t, int64_t> series_ids_;
+    sqlite3_stmt* series_insert_stmt_ = nullptr;
+    sqlite3_stmt* series_select_stmt_ = nullptr;
+    int64_t seriesId(uint8_t frequency, bool debug, bool create); // 0 if unknown and !create
+    int64_t seriesId(const DeviceConfig& config, bool create);
+
+    // Ingest generations: every commit that stores samples of a series gives it a new, higher one.
+    // Dropping partitions changes all series at once
+    std::mutex generation_mutex_;
+    uint64_t last_generation_ = 0;                       // Last one handed out
+    uint64_t retention_generation_ = 0;                  // Handed out when partitions were dropped
+    std::unordered_map<int64_t, uint64_t> generations_;  // Series id -> generation of its last commit
+    void bumpGenerations(const std::vector<int64_t>& series, size_t begin, size_t end);
+
+    // Statistics of what was stored since the start, per series. Updated after the commit, before the
+    // generation moves on - an ETag that includes the samples includes them in the statistics as well
+    StatsSettings stats_settings_;
+    mutable std::mutex stats_mutex_;
+    std::unordered_map<int64_t, sketch::TimeWindows> stats_;
+    void addToStats(int64_t series_id, int64_t timestamp, uint16_t pressure, uint16_t temperature,
+                    uint16_t velocity);                  // With stats_mutex_ held
+
+    // Partitions. Only the writer opens / switches write_db_ - reads use connections from read_pool_:
+    // read-only on DB_PATH, or with partitions the partitions they need ATTACHed. Never db_, which
+    // would see the writer's transaction before it commits
+    PartitionSettings partitions_;
+    fs::path partition_dir_;
+    sqlite3* write_db_ = nullptr;                        // db_, or the partition being written to
+    int64_t write_partition_ = 0;                        // Start of that partition
+    uint64_t stored_seq_ = 0;                            // Last record committed to a partition
+    size_t seal_chunk_samples_ = 0;                      // Set by the writer - seals a partition before closing it
+    std::mutex read_pool_mutex_;
+    std::vector<sqlite3*> read_pool_;                    // Idle read connections
+    sqlite3* acquireReadConnection();                    // From read_pool_, or a new one
+    void releaseReadConnection(sqlite3* db);             // Back into read_pool_
+    int64_t partitionLength() const;
+    int64_t partitionStart(int64_t timestamp) const;
+    fs::path partitionPath(int64_t start) const;
+    std::vector<int64_t> listPartitions() const;         // Starts, newest first
+    void openPartition(int64_t start);                   // Makes it write_db_, creates it if needed
+    void migrateIntoPartitions();
+    void dropExpiredPartitions();
+    std::vector<SensorData> queryPartitions(int64_t series_id, int64_t from, int64_t to, int n, QueryCost* cost);
+
+    // Journal writer - runs in its own thread, is the only user of insert_stmt_ while running
+    FrameJournal* journal_ = nullptr;
+    std::thread writer_thread_;
+    std::atomic<bool> writer_stop_{false};
+    mutable std::mutex writer_stats_mutex_;
+    WriterStats writer_stats_;
+    ReplayStats replay_stats_;
+    void writerLoop(uint64_t committed_seq, JournalWriterSettings settings);
 
     const std::vector<fs::path> restricted_dirs = {
           "/bin", "/boot", "/dev", "/etc", "/lib", 
@@ -40,17 +359,12 @@ private:
      };
 
 public:
-    struct SensorData {
-        __fp16 pressure;
-        __fp16 temperature;
-        __fp16 velocity;
-        int64_t timestamp;
-    };
-
     DatabaseManager(const std::string& db_path = "database.db", 
                     const std::string& port_name = "/dev/ttyS11", 
-                    uint8_t& frequency = *(new uint8_t(115)),  // Default value via reference
-                    bool& debug = *(new bool(false))); // Default value via reference
+                    const ConfigStore& config = *(new ConfigStore()), // Default value via reference
+                    const DatabaseProfile& profile = DatabaseProfile(),
+                    const PartitionSettings& partitions = PartitionSettings(),
+                    const StatsSettings& stats = StatsSettings());
     ~DatabaseManager();
 
     // Disable copy / assgin / move constructors
@@ -59,12 +373,97 @@ public:
     DatabaseManager(DatabaseManager&&) = delete;
     DatabaseManager& operator=(DatabaseManager&&) = delete;
 
-    bool storeSensorData(const SensorData& data);
-    std::vector<SensorData> getLastNMessages(int n); // Return N messages that match port, freq, debug
+    bool storeSensorData(const SensorData& data);        // Direct insert with the current configuration
+    bool storeJournalRecords(const std::vector<FrameJournal::Record>& records); // One transaction (per partition)
     
-    // Setters - used ONLY during /configure call
-    void updFrequency(const uint8_t& freq);
-    void updDebug(const bool& debug);
+    uint64_t getCommittedSeq();                          // Durable high-water mark, 0 if nothing stored yet
+    ReplayStats replayJournal(FrameJournal& journal, size_t batch_size); // Stores everything after the mark
+    ReplayStats getReplayStats() const;
+
+    // Starts the thread that stores journal records with seq > committed_seq
+    void startJournalWriter(FrameJournal& journal, uint64_t committed_seq, const JournalWriterSettings& settings);
+    void stopJournalWriter();                            // Stores what's left in the journal, then stops
+    WriterStats getWriterStats() const;
+    // Packs the samples older than `before` (UNIX timestamp) of the file being written to into
+    // compressed chunks - one transaction. Returns the samples packed. Writer thread only, or before it runs
+    size_t sealChunks(int64_t before, size_t chunk_samples);
+    const std::string& getPath() const;
+    const DatabaseProfile& getProfile() const;           // As applied - journal_mode is what SQLite accepted
+    const PartitionSettings& getPartitionSettings() const;
+    size_t getPartitionCount() const;
+    // Return N messages that match port, freq, debug, newest first. Adds what the query took to *cost
+    std::vector<SensorData> getLastNMessages(int n, QueryCost* cost = nullptr);
+    std::vector<SensorData> getMessages(int64_t from, int64_t to, int n, QueryCost* cost = nullptr); // Same, from <= Timestamp <= to
+    std::unique_ptr<ExportCursor> openExport(int64_t from, int64_t to);   // Counts the samples, throws std::runtime_error
+    // Ingest generation of the current configuration's series, from memory once the series is known.
+    // Only meaningful within this process. Read it before querying - a commit in between only makes
+    // the query result newer
+    uint64_t getGeneration();
+    // Statistics of the current configuration's series over [from, to], rounded out to the minutes /
+    // hours kept. `oldest` is the first second there are statistics of (0 if none)
+    sketch::TimeWindows::Result getStats(int64_t from, int64_t to, int64_t& oldest);
+    size_t getStatsMemory() const;                       // Bytes, all series
+    const StatsSettings& getStatsSettings() const;
+};
+
+// Counters of the serial reader loop in main(). Written by the reader only, read by GET /metrics
+struct IngestStats {
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> discarded_bytes{0};      // Noise in front of '$' or without any frame start
+    std::atomic<uint64_t> frames{0};               // Complete '$...\n' frames
+    std::atomic<uint64_t> samples_journaled{0};    // Parsed samples appended to the frame journal
+    std::atomic<uint64_t> parse_errors{0};         // Sensor frames that didn't parse
+    std::atomic<uint64_t> journal_errors{0};
+    std::atomic<uint64_t> ignored_frames{0};       // Frames received while neither reading nor awaiting a response
+    std::atomic<int64_t> last_append_us{0};        // Duration of the last journal append
+    std::atomic<int64_t> max_append_us{0};
+};
+
+// Filled by RequestQueue, kept by HTTPServer - httplib creates a new queue for every listen()
+struct HttpQueueStats {
+    std::atomic<uint64_t> queued{0};               // Waiting for a worker now
+    std::atomic<uint64_t> busy{0};                 // Workers serving a connection now
+    std::atomic<uint64_t> connections{0};          // Served by a worker
+    std::atomic<uint64_t> shed{0};                 // Queue full - answered with 503
+    std::atomic<uint64_t> dropped{0};              // Queue full and the 503 thread behind as well - closed
+    std::atomic<int64_t> last_wait_us{0};          // Time from accept() until a worker took the connection
+    std::atomic<int64_t> max_wait_us{0};
+    std::atomic<int64_t> total_wait_us{0};
+};
+
+// httplib task queue (Server::new_task_queue) with a fixed number of workers and a bounded queue.
+// httplib's own ThreadPool closes the socket when its queue is full, which the client only sees as
+// a reset. Here the connection goes to a single shedding thread instead, on which shedding() is
+// true: the server answers its request with 503 + Retry-After right away and closes it. Only if
+// that thread is max_queued connections behind too, the socket is closed without an answer
+class RequestQueue : public httplib::TaskQueue {
+public:
+    RequestQueue(size_t threads, size_t max_queued, HttpQueueStats& stats);
+    ~RequestQueue() override;
+
+    bool enqueue(std::function<void()> fn) override;
+    void shutdown() override;                      // Serves what is queued, then joins the threads
+
+    static bool shedding();                        // On the thread that answers with 503
+
+private:
+    struct Job {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    size_t max_queued_;
+    HttpQueueStats& stats_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable shed_cv_;
+    std::deque<Job> jobs_;
+    std::deque<Job> shed_jobs_;
+    bool shutdown_ = false;
+    std::vector<std::thread> workers_;
+    std::thread shedder_;
+
+    void work(bool shedding);
 };
 
 class HTTPServer {
@@ -74,27 +473,71 @@ private:
     SerialInterface& serial_;
     std::string host_;
     int port_;
-    uint8_t& frequency_;
-    bool& debug_;
+    ConfigStore& config_;
 
     std::thread server_thread_;                // Thread to run the server ops
     std::atomic<bool> is_reading_;             // Flag to check if can read messages from device
+    std::string boot_id_;                      // Random per process - generations start over at every start
+    std::atomic<uint64_t> not_modified_{0};    // 304 answers
+    CompressionSettings compression_;
+    std::atomic<uint64_t> gzip_responses_{0};
+    std::atomic<uint64_t> gzip_bytes_in_{0};   // Before / after compression
+    std::atomic<uint64_t> gzip_bytes_out_{0};
+    HttpPoolSettings pool_;
+    HttpQueueStats queue_stats_;
+    QuerySettings query_;
+    std::mutex cost_mutex_;
+    std::map<std::string, RequestCostTotals> cost_by_endpoint_;
+    std::map<std::string, RequestCostTotals> cost_by_client_;  // By remote address
+    std::atomic<size_t> alert_streams_{0};     // Open GET /alerts/stream connections
+    static constexpr size_t max_batch_commands = 32;  // Per POST /commands - each can take up to 10 s
+    mutable std::mutex command_stats_mutex_;
+    CommandStats command_stats_[3];            // By DeviceCommand::Type
 
     bool isValidHostname(const std::string &hostname);
+    bool notModified(const httplib::Request &req, httplib::Response &res); // Sets the ETag, true if answered with 304
+    void compressBody(const httplib::Request &req, httplib::Response &res);
+    // Chunked body: `next` writes the next part to its sink and sets done after the last one. gzip'ed
+    // if the client takes it. `finished` runs once: after the last part, or when the client went away
+    void setStreamedContent(const httplib::Request &req, httplib::Response &res, const std::string &endpoint,
+                            const std::string &type, std::function<bool(httplib::DataSink &sink, bool &done)> next,
+                            std::function<void(bool success)> finished);
+    // GET /messages above max_limit, continues after the first page the handler read
+    void streamMessages(const httplib::Request &req, httplib::Response &res, int64_t from, int64_t to, int limit,
+                        std::vector<DatabaseManager::SensorData> first_page, const DatabaseManager::QueryCost &cost);
+    std::unique_lock<std::mutex> lockCommands();  // cmd_sequence_mutex_, the wait traced as "lock wait"
+    // Sends the command and waits up to 10 s for the device's answer, then applies it (reading flag,
+    // configuration, baud rate). With cmd_sequence_mutex_ held by the caller - takes cmd_mutex_ itself
+    DeviceCommandResult executeCommand(const DeviceCommand &command);
+    // Adds to the totals and logs the request's cost
+    void recordCost(const std::string &endpoint, const std::string &client,
+                    const DatabaseManager::QueryCost &cost, uint64_t bytes);
 
 public:
      HTTPServer(const std::string& host, int port,
                DatabaseManager& db_manager,
-               uint8_t& frequency, bool& debug,
-               SerialInterface& serial);
+               ConfigStore& config,
+               SerialInterface& serial,
+               const CompressionSettings& compression = CompressionSettings(),
+               const HttpPoolSettings& pool = HttpPoolSettings(),
+               const QuerySettings& query = QuerySettings(),
+               const AlertSettings& alerts = AlertSettings());
      ~HTTPServer();
 
     // Not ideal, should be as private =/
+    // One command sequence at a time: a single command endpoint or a whole POST /commands holds
+    // cmd_sequence_mutex_ throughout. cmd_mutex_ only hands pending_cmd_ and its response over between
+    // the command and the serial reader - it is released while waiting for the device
+    std::mutex cmd_sequence_mutex_;
     std::mutex cmd_mutex_;                     // Protects pending command data
     std::condition_variable cmd_cv_;           // Notifies when response arrives
     std::string pending_cmd_;                  // Currently awaited command (e.g., "$0")
     std::string cmd_response_;                 // Response from device (e.g., "ok")
     bool cmd_response_received_{false};        // Flag to check if response arrived
+    std::chrono::steady_clock::time_point cmd_sent_;  // When pending_cmd_ was handed to sendData()
+    bool cmd_timed_out_{false};                // Nobody waits for the answer to pending_cmd_ any more
+    IngestStats ingest_stats_;                 // Updated by the serial reader loop
+    alerts::Engine alerts_;                    // Evaluated by the serial reader loop
 
     // Disable copy / assgin / move constructors
     HTTPServer(const HTTPServer&) = delete;
@@ -106,6 +549,9 @@ public:
     void stop();
     bool isReading() const;
     void registerEndpoints();
+    // Called by the serial reader with cmd_mutex_ held, once cmd_response_ is set for pending_cmd_
+    void recordCommandResponse(std::chrono::steady_clock::time_point received);
+    CommandStats getCommandStats(DeviceCommand::Type type) const;
 
     // Getter
     int getPort() const;
@@ -115,4 +561,60 @@ public:
 // Some functions to work with strings - might be a good idea to create a separate API for it
 std::string trim(const std::string &s);
 
+// Function to parse the received message - simplified. Expects 'pressure,temperature,velocity' without '$'
+bool parseMessage(const std::string& message, float& pressure, float& temperature, float& velocity);
+
+// Moves every complete '$...\n' frame at the front of buffer into frames ('$' kept, '\n' dropped).
+// Bytes outside of frames are dropped, an incomplete frame stays in buffer. Returns the dropped byte count
+size_t extractFrames(std::string& buffer, std::vector<std::string>& frames);
+
+// ALERT_RULES: a JSON array of {"name", "channel", "type": "threshold" | "rate", "op": ">" | "<",
+// "threshold", "hysteresis", "window_ms"}. Throws std::invalid_argument
+std::vector<alerts::Rule> parseAlertRules(const nlohmann::json& json);
+nlohmann::json alertRuleToJson(const alerts::Rule& rule);
+nlohmann::json alertEventToJson(const alerts::Event& event, const std::vector<alerts::Rule>& rules);
+
+// A step of POST /commands: {"command": "start" | "stop" | "configure", "frequency", "debug"}, the
+// last two for configure only. Throws std::invalid_argument
+DeviceCommand parseDeviceCommand(const nlohmann::json& json);
+
+// Body of GET /debug/trace: Chrome trace-event JSON, {"traceEvents": [...], "displayTimeUnit": "ms"}.
+// Complete ("X") events with ts / dur in microseconds, plus thread_name metadata per thread
+nlohmann::json traceToJson(const std::vector<trace::ThreadTrace>& traces);
+
+// Body of GET /messages
+nlohmann::json messagesToJson(const std::vector<DatabaseManager::SensorData>& messages);
+
+// One field in GET /stats: count, mean, stddev, min, max, the quantiles asked for and a histogram of
+// `bins` equal bins between min and max, filled from the sketch buckets
+nlohmann::json summaryToJson(const sketch::Summary& summary, const std::vector<double>& quantiles, int bins);
+
+// Body of GET /export, as a content provider. Pages of ExportCursor::batch_samples samples have a
+// fixed size in both formats, so a byte offset (HTTP Range) is mapped to a sample index without
+// formatting anything in front of it - ExportCursor::seek() still reads the samples in front of it
+// in the same file:
+//   csv    - header line, then 'timestamp,pressure,temperature,velocity' rows of fixed width
+//            (%010lld,%11.4f,%11.4f,%11.4f)
+//   binary - 32 byte header: "SDX1", uint32 samples per block, uint64 count, int64 from, int64 to;
+//            then blocks of int64 timestamps[n], uint16 pressure[n], temperature[n], velocity[n]
+//            (fp16 bit patterns). Little endian, n = samples per block except for the last block
+class ExportBody {
+public:
+    enum class Format { Csv, Binary };
+    ExportBody(std::unique_ptr<DatabaseManager::ExportCursor> cursor, Format format);
+    size_t size() const;                                 // Content-Length
+    bool read(size_t offset, size_t length, httplib::DataSink& sink);  // False if the data went away
+    const DatabaseManager::QueryCost& cost() const;      // Of the reads so far
+
+private:
+    std::unique_ptr<DatabaseManager::ExportCursor> cursor_;
+    Format format_;
+    std::string header_;
+    size_t sample_bytes_;
+    size_t page_ = SIZE_MAX;                             // Page in page_data_
+    std::string page_data_;
+    std::vector<DatabaseManager::SensorData> samples_;
+    bool loadPage(size_t page);
+};
+
 #endif // SERVER_API_HPP
\ No newline at end of file
@@ -13,6 +13,27 @@
 #include <cstring>
 #include <stdexcept>
 #include <string>
+#include <sstream>
+#include <fstream>
+#include <future>
+#include <atomic>
+#include "httplib.h"
+#include "nlohmann/json.hpp"
+#include "frame_journal.hpp"
+#include "server_api.hpp"
+#include "device_simulator.hpp"
+#include "fp16.hpp"
+#include "chunk_codec.hpp"
+#include "compression.hpp"
+#include "sketch.hpp"
+#include "trace.hpp"
+#include <zlib.h>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <map>
+#include <sqlite3.h>
 
 // Structure to hold PTY info.
 struct PtyPair {
@@ -20,6 +41,24 @@ struct PtyPair {
     std::string slave_name;
 };
 
+// Inflates a whole gzip member - false unless the stream ends exactly at the end of data
+bool gunzip(const std::string& data, std::string& out) {
+    z_stream strm{};
+    if (inflateInit2(&strm, 31) != Z_OK) return false;
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    strm.avail_in = static_cast<uInt>(data.size());
+    char buffer[65536];
+    int rc;
+    do {
+        strm.next_out = reinterpret_cast<Bytef*>(buffer);
+        strm.avail_out = sizeof(buffer);
+        rc = inflate(&strm, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - strm.avail_out);
+    } while (rc == Z_OK);
+    inflateEnd(&strm);
+    return rc == Z_STREAM_END && strm.avail_in == 0;
+}
+
 // Create a PTY pair and return the master file descriptor along with the slave name.
 PtyPair createPtyPair() {
     PtyPair p;
@@ -85,6 +124,1114 @@ TEST(ServerIntegrationTest, GracefulShutdown) {
     }
 }
 
+// Reads from the PTY master until a full line arrives or the timeout expires. Drops '\r'.
+std::string readLine(int master_fd, std::chrono::milliseconds timeout) {
+    std::string line;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+        char c;
+        ssize_t n = read(master_fd, &c, 1);
+        if (n == 1) {
+            if (c == '\n') return line;
+            if (c != '\r') line += c;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    return line;
+}
+
+// A PTY is put in raw mode with the VMIN / VTIME asked for: no echo, no line buffering and a '\r'
+// arrives as it was sent
+TEST(SerialInterfaceTest, PtyIsRawWithVminVtime) {
+    PtyPair ptyPair = createPtyPair();
+    SerialInterface::LineSettings settings;
+    settings.vmin = 4;
+    settings.vtime = 2;
+    SerialInterface serial(ptyPair.slave_name, 115000, settings);
+    EXPECT_TRUE(serial.isVirtual());
+
+    struct termios tio;
+    ASSERT_EQ(tcgetattr(serial.getFileDescriptor(), &tio), 0);
+    EXPECT_EQ(tio.c_lflag & (ICANON | ECHO | ISIG | IEXTEN), 0u);
+    EXPECT_EQ(tio.c_iflag & (ICRNL | INLCR | IGNCR | IXON), 0u);
+    EXPECT_EQ(tio.c_oflag & OPOST, 0u);
+    EXPECT_EQ(tio.c_cflag & CSIZE, static_cast<tcflag_t>(CS8));
+    EXPECT_EQ(tio.c_cc[VMIN], 4);
+    EXPECT_EQ(tio.c_cc[VTIME], 2);
+
+    ASSERT_EQ(write(ptyPair.master_fd, "$0\r,ok\n", 7), 7);
+    std::string received;
+    char buffer[16];
+    for (int i = 0; i < 50 && received.size() < 7; i++) {
+        ssize_t n = read(serial.getFileDescriptor(), buffer, sizeof(buffer));
+        if (n > 0) {
+            received.append(buffer, static_cast<size_t>(n));
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_EQ(received, "$0\r,ok\n");
+    // Nothing echoed back to the device
+    fcntl(ptyPair.master_fd, F_SETFL, fcntl(ptyPair.master_fd, F_GETFL) | O_NONBLOCK);
+    EXPECT_EQ(read(ptyPair.master_fd, buffer, sizeof(buffer)), -1);
+    close(ptyPair.master_fd);
+}
+
+TEST(ServerIntegrationTest, StartCommandRoundTrip) {
+    PtyPair ptyPair = createPtyPair();
+    fcntl(ptyPair.master_fd, F_SETFL, fcntl(ptyPair.master_fd, F_GETFL) | O_NONBLOCK);
+    std::string testDbPath = "test_database.db";
+
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1) << "Fork failed";
+    if (pid == 0) {
+        execl("./server", "./server", ptyPair.slave_name.c_str(), "115000", "localhost", "7101", testDbPath.c_str(), (char*)NULL);
+        exit(1);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+
+    // The handler blocks until the device answers, so issue it asynchronously and play the device
+    auto startResult = std::async(std::launch::async, [] {
+        httplib::Client client("localhost", 7101);
+        auto res = client.Get("/start");
+        return res ? res->status : -1;
+    });
+    EXPECT_EQ(readLine(ptyPair.master_fd, std::chrono::seconds(5)), "$0");
+    ASSERT_GT(write(ptyPair.master_fd, "$0,ok\n", 6), 0);
+    EXPECT_EQ(startResult.get(), 200);
+
+    httplib::Client client("localhost", 7101);
+    auto metrics = client.Get("/metrics");
+    ASSERT_TRUE(metrics);
+    auto json = nlohmann::json::parse(metrics->body);
+    EXPECT_EQ(json["serial"]["commands_sent"], 1);
+    EXPECT_EQ(json["serial"]["write_queue_depth"], 0);
+
+    // Line noise without a frame start, one sample and one frame that doesn't parse
+    const std::string input = "noise\n$1013.25,20.50,3.00\n$abc\n";
+    ASSERT_EQ(write(ptyPair.master_fd, input.data(), input.size()), static_cast<ssize_t>(input.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    metrics = client.Get("/metrics");
+    ASSERT_TRUE(metrics);
+    json = nlohmann::json::parse(metrics->body);
+    auto ingest = json["ingest"];
+    EXPECT_EQ(ingest["bytes_read"], 6 + input.size());
+    EXPECT_EQ(ingest["discarded_bytes"], 6);
+    EXPECT_EQ(ingest["frames"], 3);                  // Incl. '$0,ok'
+    EXPECT_EQ(ingest["samples_journaled"], 1);
+    EXPECT_EQ(ingest["parse_errors"], 1);
+    auto uart = json["uart"];
+    EXPECT_EQ(uart["port"], ptyPair.slave_name);
+    EXPECT_EQ(uart["queue_supported"], true);        // PTYs have TIOCINQ, but no TIOCGICOUNT
+    EXPECT_EQ(uart["input_pending"], 0);
+
+    kill(pid, SIGINT);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    close(ptyPair.master_fd);
+}
+
+// Samples that made it into the journal but not into the database (crash) are stored at startup
+TEST(ServerIntegrationTest, ReplaysJournalAtStartup) {
+    const fs::path dir = fs::temp_directory_path() / "serial_server_replay_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const std::string journalDir = (dir / "test_replay.frames").string();
+    const std::string testDbPath = (dir / "test_replay.db").string();
+    {
+        FrameJournal journal(journalDir, 64 * 1024);
+        for (int i = 0; i < 100; i++) {
+            FrameJournal::Record record;
+            record.wall_s = 1700000000 + i / 7;  // Several per second - pages end in the middle of one
+            record.frequency = 115;  // Server defaults, so GET /messages matches them
+            record.debug = false;
+            record.pressure = 0x3C00; // 1.0 as fp16
+            record.temperature = fp16::fromFloat(static_cast<float>(i));
+            record.velocity = 0x4200; // 3.0
+            record.frame = "1,2,3";
+            journal.append(record);
+        }
+    }
+
+    PtyPair ptyPair = createPtyPair();
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1) << "Fork failed";
+    if (pid == 0) {
+        setenv("JOURNAL_DIR", journalDir.c_str(), 1);
+        setenv("HTTP_MAX_LIMIT", "30", 1);         // limit=1000 is streamed in pages of 30
+        execl("./server", "./server", ptyPair.slave_name.c_str(), "115000", "localhost", "7102", testDbPath.c_str(), (char*)NULL);
+        exit(1);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+
+    httplib::Client client("localhost", 7102);
+    auto messages = client.Get("/messages?limit=1000");
+    ASSERT_TRUE(messages);
+    auto json = nlohmann::json::parse(messages->body);
+    ASSERT_EQ(json.size(), 100u);
+    EXPECT_EQ(json[0]["pressure"], 1.0);
+    EXPECT_EQ(json[0]["velocity"], 3.0);
+    for (size_t i = 0; i < json.size(); i++) {
+        EXPECT_EQ(json[i]["temperature"], 99.0 - i) << i;  // Newest first, none repeated or left out
+    }
+    auto page = client.Get("/messages?limit=30");
+    ASSERT_TRUE(page);
+    EXPECT_EQ(nlohmann::json::parse(page->body), nlohmann::json(json.begin(), json.begin() + 30));
+    auto streamed = client.Get("/messages?limit=45");
+    ASSERT_TRUE(streamed);
+    EXPECT_EQ(nlohmann::json::parse(streamed->body), nlohmann::json(json.begin(), json.begin() + 45));
+
+    // Nothing is ingested - polling with the ETag gets 304 without a body
+    const std::string etag = messages->get_header_value("ETag");
+    ASSERT_FALSE(etag.empty());
+    auto unchanged = client.Get("/messages?limit=1000", {{"If-None-Match", etag}});
+    ASSERT_TRUE(unchanged);
+    EXPECT_EQ(unchanged->status, 304);
+    EXPECT_TRUE(unchanged->body.empty());
+    auto other = client.Get("/messages?limit=1000", {{"If-None-Match", "\"other\""}});
+    ASSERT_TRUE(other);
+    EXPECT_EQ(other->status, 200);
+
+    // Same body gzip'ed, with its own ETag that revalidates as well
+    client.set_decompress(false);                // httplib is built without zlib, the test inflates itself
+    auto compressed = client.Get("/messages?limit=1000", {{"Accept-Encoding", "br, gzip;q=0.8"}});
+    ASSERT_TRUE(compressed);
+    EXPECT_EQ(compressed->get_header_value("Content-Encoding"), "gzip");
+    std::string inflated;
+    ASSERT_TRUE(gunzip(compressed->body, inflated));
+    EXPECT_EQ(inflated, messages->body);
+    EXPECT_LT(compressed->body.size(), messages->body.size() / 4);
+    auto compressed_etag = compressed->get_header_value("ETag");
+    EXPECT_NE(compressed_etag, etag);
+    auto revalidated = client.Get("/messages?limit=1000", {{"If-None-Match", compressed_etag}});
+    ASSERT_TRUE(revalidated);
+    EXPECT_EQ(revalidated->status, 304);
+
+    // Replayed samples are in the statistics too, all in the minute from 1699999980 on
+    auto stats = client.Get("/stats?quantiles=0,0.5,1&bins=4");
+    ASSERT_TRUE(stats);
+    auto statsJson = nlohmann::json::parse(stats->body);
+    EXPECT_EQ(statsJson["from"], 1699999980);
+    EXPECT_EQ(statsJson["to"], 1700000039);
+    auto temperature = statsJson["temperature"];
+    EXPECT_EQ(temperature["count"], 100);
+    EXPECT_EQ(temperature["min"], 0.0);
+    EXPECT_EQ(temperature["max"], 99.0);
+    EXPECT_DOUBLE_EQ(temperature["mean"].get<double>(), 49.5);
+    EXPECT_NEAR(temperature["stddev"].get<double>(), 28.866, 0.001);
+    EXPECT_EQ(temperature["quantiles"]["0"], 0.0);
+    EXPECT_NEAR(temperature["quantiles"]["0.5"].get<double>(), 49.0, 49.0 * 0.01);
+    EXPECT_EQ(temperature["quantiles"]["1"], 99.0);
+    ASSERT_EQ(temperature["histogram"].size(), 4u);
+    uint64_t histogram_count = 0;
+    for (const auto& bin : temperature["histogram"]) histogram_count += bin["count"].get<uint64_t>();
+    EXPECT_EQ(histogram_count, 100u);
+    EXPECT_EQ(statsJson["pressure"]["stddev"], 0.0);
+    auto outside = client.Get("/stats?from=0&to=1000");
+    ASSERT_TRUE(outside);
+    EXPECT_EQ(nlohmann::json::parse(outside->body)["velocity"]["count"], 0);
+    EXPECT_EQ(client.Get("/stats?quantiles=2")->status, 400);
+
+    // 'to' is cut to the newest sample; a resumed download only gets a part of the version it has
+    auto exported = client.Get("/export?from=1700000000&to=1800000000&format=binary");
+    ASSERT_TRUE(exported);
+    ASSERT_EQ(exported->body.size(), 32u + 100u * 14u);
+    int64_t exported_to;
+    std::memcpy(&exported_to, &exported->body[24], sizeof(exported_to));
+    EXPECT_EQ(exported_to, 1700000014);
+    const std::string export_etag = exported->get_header_value("ETag");
+    ASSERT_FALSE(export_etag.empty());
+    auto part = client.Get("/export?from=1700000000&to=1800000000&format=binary",
+                           {{"Range", "bytes=100-199"}, {"If-Range", export_etag}});
+    ASSERT_TRUE(part);
+    EXPECT_EQ(part->status, 206);
+    EXPECT_EQ(part->body, exported->body.substr(100, 100));
+    auto changed = client.Get("/export?from=1700000000&to=1800000000&format=binary",
+                              {{"Range", "bytes=100-199"}, {"If-Range", "\"other\""}});
+    ASSERT_TRUE(changed);
+    EXPECT_EQ(changed->status, 200);
+    EXPECT_EQ(changed->body, exported->body);
+    auto shorter = client.Get("/export?from=1700000000&to=1700000009&format=binary");
+    ASSERT_TRUE(shorter);
+    EXPECT_NE(shorter->get_header_value("ETag"), export_etag);
+
+    auto metrics = client.Get("/metrics");
+    ASSERT_TRUE(metrics);
+    auto recovery = nlohmann::json::parse(metrics->body)["recovery"];
+    EXPECT_EQ(recovery["samples_replayed"], 100);
+    EXPECT_EQ(recovery["to_seq"], 100);
+    EXPECT_EQ(nlohmann::json::parse(metrics->body)["http"]["not_modified"], 2);
+    EXPECT_EQ(nlohmann::json::parse(metrics->body)["http"]["gzip_responses"], 1);
+    auto cost = nlohmann::json::parse(metrics->body)["cost"]["endpoints"]["GET /messages"];
+    EXPECT_EQ(cost["requests"], 5);                  // 304s don't query
+    // The samples are from 2023 - sealed into chunks already, so mostly decoded rather than scanned
+    EXPECT_GE(cost["rows_scanned"].get<uint64_t>() + cost["samples_decoded"].get<uint64_t>(), 3 * 100 + 30 + 45u);
+
+    kill(pid, SIGINT);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    close(ptyPair.master_fd);
+    fs::remove_all(dir);
+}
+
+// Start, configure and stop against the device simulator, with sensor data flowing in between
+TEST(ServerIntegrationTest, CommandsWithDeviceSimulator) {
+    PtyPair ptyPair = createPtyPair();
+    const std::string testDbPath = std::filesystem::absolute("test_simulator.db").string();
+    std::filesystem::remove(testDbPath);
+    std::filesystem::remove_all(testDbPath + ".frames");
+
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1) << "Fork failed";
+    if (pid == 0) {
+        setenv("ALERT_RULES", R"([{"name": "high_pressure", "channel": "pressure", "op": ">", "threshold": 1000,
+                                  "hysteresis": 5}])", 1);
+        setenv("TRACE", "1", 1);
+        execl("./server", "./server", ptyPair.slave_name.c_str(), "115000", "localhost", "7103", testDbPath.c_str(), (char*)NULL);
+        exit(1);
+    }
+    DeviceSimulator::Settings settings;
+    settings.rate_hz = 200;
+    settings.response_delay = std::chrono::milliseconds(20);
+    DeviceSimulator device(ptyPair.master_fd, settings);  // Owns the master from here on
+    device.start();
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+
+    httplib::Client client("localhost", 7103);
+    auto start = client.Get("/start");
+    ASSERT_TRUE(start);
+    EXPECT_EQ(start->status, 200);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+    auto messages = client.Get("/messages?limit=10");
+    ASSERT_TRUE(messages);
+    auto json = nlohmann::json::parse(messages->body);
+    ASSERT_EQ(json.size(), 10u);
+    EXPECT_NEAR(json[0]["pressure"].get<double>(), 1013.0, 5.0);
+
+    // ~1013 hPa is above the rule from the first sample on - raised once, and stays raised
+    auto alerts = client.Get("/alerts");
+    ASSERT_TRUE(alerts);
+    auto alertsJson = nlohmann::json::parse(alerts->body);
+    ASSERT_EQ(alertsJson["rules"].size(), 1u);
+    EXPECT_TRUE(alertsJson["rules"][0]["active"]);
+    ASSERT_EQ(alertsJson["events"].size(), 1u);
+    EXPECT_EQ(alertsJson["events"][0]["rule"], "high_pressure");
+    EXPECT_EQ(alertsJson["events"][0]["state"], "raised");
+    std::string stream;
+    client.Get("/alerts/stream?after=0", [&](const char* data, size_t length) {
+        stream.append(data, length);
+        return stream.find("\n\n") == std::string::npos;   // Hang up after the first event
+    });
+    EXPECT_EQ(stream.rfind("id: 1\nevent: raised\ndata: {", 0), 0u) << stream;
+
+    auto configure = client.Put("/configure", R"({"frequency": 100, "debug": true})", "application/json");
+    ASSERT_TRUE(configure);
+    EXPECT_EQ(configure->status, 200);
+    auto stop = client.Get("/stop");
+    ASSERT_TRUE(stop);
+    EXPECT_EQ(stop->status, 200);
+
+    // The same three in one round trip, then a batch that fails at its first step (not reading)
+    auto batch = client.Post("/commands", R"({"commands": [{"command": "start"},
+        {"command": "configure", "frequency": 50, "debug": false}, {"command": "stop"}]})", "application/json");
+    ASSERT_TRUE(batch);
+    EXPECT_EQ(batch->status, 200);
+    auto batchJson = nlohmann::json::parse(batch->body);
+    EXPECT_TRUE(batchJson["success"]);
+    EXPECT_EQ(batchJson["completed"], 3);
+    ASSERT_EQ(batchJson["steps"].size(), 3u);
+    EXPECT_EQ(batchJson["steps"][1]["command"], "configure");
+    EXPECT_EQ(batchJson["steps"][1]["response"], "ok");
+    EXPECT_GE(batchJson["steps"][1]["round_trip_us"].get<int64_t>(), 20000);  // response_delay
+    auto failed = client.Post("/commands", R"([{"command": "stop"}, {"command": "start"}])", "application/json");
+    ASSERT_TRUE(failed);
+    EXPECT_EQ(failed->status, 400);
+    auto failedJson = nlohmann::json::parse(failed->body);
+    EXPECT_FALSE(failedJson["success"]);
+    EXPECT_EQ(failedJson["completed"], 0);
+    EXPECT_EQ(failedJson["steps"].size(), 1u);
+    auto invalid = client.Post("/commands", R"([{"command": "configure", "frequency": 300, "debug": true}])",
+                               "application/json");
+    ASSERT_TRUE(invalid);
+    EXPECT_EQ(invalid->status, 400);
+
+    // Round trips are at least the simulator's response delay; the failed stop was never sent
+    auto metrics = client.Get("/metrics");
+    ASSERT_TRUE(metrics);
+    auto commands = nlohmann::json::parse(metrics->body)["commands"];
+    EXPECT_EQ(commands["configure"]["sent"], 2);
+    EXPECT_EQ(commands["configure"]["ok"], 2);
+    EXPECT_EQ(commands["stop"]["sent"], 2);
+    EXPECT_EQ(commands["start"]["timeouts"], 0);
+    EXPECT_EQ(commands["start"]["round_trip_us"]["count"], 2);
+    EXPECT_GE(commands["start"]["round_trip_us"]["min"].get<double>(), 20000);
+    uint64_t histogram_count = 0;
+    for (const auto& bucket : commands["configure"]["round_trip_us"]["histogram"]) {
+        EXPECT_GE(bucket["upper_us"].get<int64_t>(), 20000);
+        histogram_count += bucket["count"].get<uint64_t>();
+    }
+    EXPECT_EQ(histogram_count, 2u);
+
+    // Every layer shows up in the trace: the request, the command inside it, the reader and the writer
+    auto traceResponse = client.Get("/debug/trace");
+    ASSERT_TRUE(traceResponse);
+    auto traceJson = nlohmann::json::parse(traceResponse->body);
+    std::set<std::string> spans;
+    for (const auto& event : traceJson["traceEvents"]) {
+        if (event["ph"] == "X") spans.insert(event["name"].get<std::string>());
+    }
+    for (const char* name : {"GET /start", "POST /commands", "lock wait", "configure", "serial write",
+                             "device reply", "ingest", "commit"}) {
+        EXPECT_TRUE(spans.count(name)) << name;
+    }
+
+    // A single /configure racing a batch waits for the whole batch - every reply matches its command
+    auto racingBatch = std::async(std::launch::async, [] {
+        httplib::Client batchClient("localhost", 7103);
+        return batchClient.Post("/commands", R"([{"command": "configure", "frequency": 60, "debug": true},
+            {"command": "configure", "frequency": 70, "debug": true},
+            {"command": "configure", "frequency": 80, "debug": true}])", "application/json");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));   // Within the batch's first round trip
+    auto single = client.Put("/configure", R"({"frequency": 90, "debug": true})", "application/json");
+    auto racedBatch = racingBatch.get();
+    ASSERT_TRUE(single);
+    ASSERT_TRUE(racedBatch);
+    EXPECT_EQ(single->status, 200) << single->body;
+    EXPECT_EQ(racedBatch->status, 200) << racedBatch->body;
+    auto racedMetrics = client.Get("/metrics");
+    ASSERT_TRUE(racedMetrics);
+    auto racedCommands = nlohmann::json::parse(racedMetrics->body)["commands"];
+    EXPECT_EQ(racedCommands["configure"]["ok"], 6);
+    EXPECT_EQ(racedCommands["configure"]["mismatched"], 0);
+    auto deviceInfo = client.Get("/device");
+    ASSERT_TRUE(deviceInfo);
+    int serverFrequency = nlohmann::json::parse(deviceInfo->body)["curr_config"]["frequency"];
+
+    device.stop();
+    auto stats = device.getStats();
+    EXPECT_EQ(stats.commands, 10u);
+    EXPECT_EQ(stats.frequency, serverFrequency);            // 90 if the single came last, else 80
+    EXPECT_TRUE(stats.debug);
+    EXPECT_FALSE(stats.streaming);
+    EXPECT_GT(stats.frames_sent, 100u);
+
+    kill(pid, SIGINT);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+// Database tests: a temp directory of their own, removed afterwards also when an assertion
+// fails, and the server's default configuration
+class DatabaseTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        dir = fs::temp_directory_path() /
+              ("serial_server_" + std::string(info->test_suite_name()) + "_" + info->name());
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+    }
+    void TearDown() override { fs::remove_all(dir); }
+
+    fs::path dir;
+    const uint8_t frequency = 115;
+    const bool debug = false;
+    ConfigStore config{DeviceConfig{frequency, debug}};
+};
+using DatabaseSeriesTest = DatabaseTest;
+using DatabasePartitionTest = DatabaseTest;
+using DatabaseChunkTest = DatabaseTest;
+using DatabaseExportTest = DatabaseTest;
+
+// A database with the baseline SensorData table keeps its rows through the move into Series /
+// Samples, and every (port, frequency, debug) gets its own id that stays the same across restarts
+TEST_F(DatabaseSeriesTest, LegacyTableMigratesAndIdsAreStable) {
+    const std::string db_path = (dir / "legacy.db").string();
+    {
+        sqlite3* legacy;
+        ASSERT_EQ(sqlite3_open(db_path.c_str(), &legacy), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(legacy, "CREATE TABLE SensorData (Port TEXT NOT NULL, Frequency INTEGER NOT NULL, "
+                               "Debug INTEGER NOT NULL CHECK (Debug IN (0, 1)), Pressure BLOB, Temperature BLOB, "
+                               "Velocity BLOB, Timestamp INTEGER NOT NULL);", nullptr, nullptr, nullptr), SQLITE_OK);
+        sqlite3_stmt* insert;
+        ASSERT_EQ(sqlite3_prepare_v2(legacy, "INSERT INTO SensorData VALUES (?, ?, ?, ?, ?, ?, ?);", -1, &insert,
+                                     nullptr), SQLITE_OK);
+        struct Row { const char* port; int frequency; int debug; float pressure; int64_t timestamp; };
+        for (const Row& row : {Row{"/dev/ttyTEST", 115, 0, 1.0f, 100}, Row{"/dev/ttyTEST", 115, 0, 2.0f, 101},
+                               Row{"/dev/ttyTEST", 50, 1, 3.0f, 102}, Row{"/dev/ttyOTHER", 115, 0, 4.0f, 103},
+                               Row{"/dev/ttyTEST", 115, 0, 5.0f, 104}}) {
+            uint16_t value = fp16::fromFloat(row.pressure);
+            sqlite3_reset(insert);
+            sqlite3_bind_text(insert, 1, row.port, -1, SQLITE_STATIC);
+            sqlite3_bind_int(insert, 2, row.frequency);
+            sqlite3_bind_int(insert, 3, row.debug);
+            for (int i = 4; i <= 6; i++) sqlite3_bind_blob(insert, i, &value, sizeof(value), SQLITE_TRANSIENT);
+            sqlite3_bind_int64(insert, 7, row.timestamp);
+            ASSERT_EQ(sqlite3_step(insert), SQLITE_DONE);
+        }
+        sqlite3_finalize(insert);
+        sqlite3_close(legacy);
+    }
+    // Series ids as stored, by "port,frequency,debug"
+    auto seriesIds = [&]() {
+        std::map<std::string, int64_t> ids;
+        sqlite3* db;
+        EXPECT_EQ(sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr), SQLITE_OK);
+        sqlite3_stmt* stmt;
+        EXPECT_EQ(sqlite3_prepare_v2(db, "SELECT Port, Frequency, Debug, Id FROM Series;", -1, &stmt, nullptr),
+                  SQLITE_OK);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ids[std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))) + "," +
+                std::to_string(sqlite3_column_int(stmt, 1)) + "," + std::to_string(sqlite3_column_int(stmt, 2))] =
+                sqlite3_column_int64(stmt, 3);
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        return ids;
+    };
+    auto pressures = [](const std::vector<DatabaseManager::SensorData>& messages) {
+        std::vector<float> values;
+        for (const auto& message : messages) values.push_back(fp16::toFloat(message.pressure));
+        return values;
+    };
+
+    std::map<std::string, int64_t> migrated;
+    {
+        DatabaseManager db(db_path, "/dev/ttyTEST", config);
+        EXPECT_EQ(pressures(db.getLastNMessages(100)), (std::vector<float>{5.0f, 2.0f, 1.0f}));
+        EXPECT_EQ(db.getLastNMessages(1).front().timestamp, 104);
+        config.publish(50, true);
+        EXPECT_EQ(pressures(db.getLastNMessages(100)), (std::vector<float>{3.0f}));
+
+        migrated = seriesIds();
+        ASSERT_EQ(migrated.size(), 3u);
+        std::set<int64_t> distinct;
+        for (const auto& [series, id] : migrated) distinct.insert(id);
+        EXPECT_EQ(distinct.size(), 3u);
+
+        // A configuration not seen before gets a new id, the others keep theirs
+        std::vector<FrameJournal::Record> records(2);
+        records[0] = {1, 0, 200, 115, false, fp16::fromFloat(6.0f), 0, 0, ""};
+        records[1] = {2, 0, 201, 60, false, fp16::fromFloat(7.0f), 0, 0, ""};
+        ASSERT_TRUE(db.storeJournalRecords(records));
+    }
+    auto grown = seriesIds();
+    ASSERT_EQ(grown.size(), 4u);
+    for (const auto& [series, id] : migrated) EXPECT_EQ(grown[series], id) << series;
+    EXPECT_EQ(std::set<int64_t>({grown["/dev/ttyTEST,60,0"], migrated["/dev/ttyTEST,115,0"],
+                                 migrated["/dev/ttyTEST,50,1"], migrated["/dev/ttyOTHER,115,0"]}).size(), 4u);
+    {
+        config.publish(115, false);
+        DatabaseManager db(db_path, "/dev/ttyTEST", config);
+        EXPECT_EQ(pressures(db.getLastNMessages(100)), (std::vector<float>{6.0f, 5.0f, 2.0f, 1.0f}));
+        config.publish(60, false);
+        EXPECT_EQ(pressures(db.getLastNMessages(100)), (std::vector<float>{7.0f}));
+    }
+    EXPECT_EQ(seriesIds(), grown);
+}
+
+// A configuration without a series reads as generation 0 and no samples - remembered, but only
+// until the first sample of it is stored
+TEST_F(DatabaseSeriesTest, MissingSeriesIsCachedUntilStored) {
+    DatabaseManager db((dir / "series.db").string(), "/dev/ttyTEST", config);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(db.getGeneration(), 0u);
+        EXPECT_TRUE(db.getLastNMessages(10).empty());
+    }
+    std::vector<FrameJournal::Record> records(1);
+    records[0] = {1, 0, 1700000000, frequency, debug, fp16::fromFloat(1.0f), 0, 0, ""};
+    ASSERT_TRUE(db.storeJournalRecords(records));
+    EXPECT_GT(db.getGeneration(), 0u);
+    EXPECT_EQ(db.getLastNMessages(10).size(), 1u);
+}
+
+// Day partitions: samples of a database without partitions move into theirs, a batch across
+// midnight is split, range queries only see their days and retention drops whole files
+TEST_F(DatabasePartitionTest, RangeQueriesAndRetention) {
+    const std::string db_path = (dir / "partitioned.db").string();
+    const int64_t today = time(nullptr) / 86400 * 86400;
+    uint64_t seq = 0;
+    auto records = [&](int64_t first_second, int count) {
+        std::vector<FrameJournal::Record> batch(count);
+        for (auto& record : batch) {
+            record.seq = ++seq;
+            record.wall_s = first_second++;
+            record.frequency = frequency;
+            record.pressure = fp16::fromFloat(static_cast<float>(seq));
+        }
+        return batch;
+    };
+
+    {
+        DatabaseManager db(db_path, "/dev/ttyTEST", config);
+        ASSERT_TRUE(db.storeJournalRecords(records(today - 10 * 86400, 10)));   // 10 days ago
+    }
+    // Files that only look like partitions are left alone
+    fs::create_directories(db_path + ".days");
+    for (const char* stray : {"2024-01-01.txt", "2024-1-1.db", "2024-01-01.db.bak", "2024-01-0x.db"}) {
+        std::ofstream(db_path + ".days/" + stray) << "not a database";
+    }
+    {
+        DatabaseManager db(db_path, "/dev/ttyTEST", config, DatabaseProfile(),
+                           {PartitionSettings::Period::Day, 0});
+        EXPECT_EQ(db.getPartitionCount(), 1u);
+        EXPECT_EQ(db.getCommittedSeq(), 10u);
+        ASSERT_TRUE(db.storeJournalRecords(records(today - 5, 10)));            // Yesterday and today
+        EXPECT_EQ(db.getPartitionCount(), 3u);
+        EXPECT_EQ(db.getCommittedSeq(), 20u);
+
+        auto all = db.getLastNMessages(100);
+        ASSERT_EQ(all.size(), 20u);
+        EXPECT_EQ(fp16::toFloat(all.front().pressure), 20.0f);
+        EXPECT_EQ(fp16::toFloat(all.back().pressure), 1.0f);
+        auto yesterday = db.getMessages(today - 86400, today - 1, 100);
+        ASSERT_EQ(yesterday.size(), 5u);
+        EXPECT_EQ(yesterday.front().timestamp, today - 1);
+        EXPECT_EQ(db.getMessages(today - 86400, today + 86400, 3).size(), 3u);
+    }
+    {
+        DatabaseManager db(db_path, "/dev/ttyTEST", config, DatabaseProfile(),
+                           {PartitionSettings::Period::Day, 7});
+        EXPECT_EQ(db.getPartitionCount(), 2u);                                   // 10 days ago is gone
+        EXPECT_EQ(db.getLastNMessages(100).size(), 10u);
+        EXPECT_EQ(db.getCommittedSeq(), 20u);
+    }
+}
+
+// A crash after a new segment was allocated but before its header was written leaves a zero-filled
+// newest segment. It is put aside at restart, and the segment started under its name takes appends
+TEST(FrameJournalTest, ZeroFilledNewestSegmentIsPutAside) {
+    const fs::path dir = fs::temp_directory_path() / "serial_server_journal_test";
+    fs::remove_all(dir);
+    auto segments = [&]() {
+        std::vector<fs::path> paths;
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().extension() == ".seg") paths.push_back(entry.path());
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    };
+    FrameJournal::Record record;
+    record.frame = std::string(200, 'x');
+    uint64_t last = 0;
+    {
+        FrameJournal journal(dir.string(), 64 * 1024);
+        while (segments().size() < 2) last = journal.append(record);
+    }
+    // Second segment as the crash left it
+    const fs::path second = segments().back();
+    const auto size = fs::file_size(second);
+    std::ofstream(second, std::ios::binary | std::ios::trunc) << std::string(size, '\0');
+
+    FrameJournal journal(dir.string(), 64 * 1024);
+    EXPECT_EQ(journal.getStats().last_seq, last - 1);             // Only the record in the lost segment is gone
+    EXPECT_TRUE(fs::exists(second.string() + ".corrupt"));
+    EXPECT_EQ(journal.append(record), last);                      // Starts the segment under the same name
+    EXPECT_EQ(journal.append(record), last + 1);
+    std::vector<FrameJournal::Record> out;
+    EXPECT_EQ(journal.readAfter(last - 1, 10, out), 2u);
+    EXPECT_EQ(segments().back(), second);
+    fs::remove_all(dir);
+}
+
+// Round trip through the chunk codec, incl. irregular timestamps, and truncated chunks don't crash
+TEST(ChunkCodecTest, RoundTrip) {
+    std::mt19937 rng(6);
+    std::vector<chunk::Sample> samples;
+    int64_t timestamp = -5;
+    for (int i = 0; i < 20000; i++) {
+        if (i % 1000 == 0) timestamp += 1;                           // 1 kHz, whole seconds
+        if (i % 7777 == 0) timestamp += static_cast<int64_t>(rng());  // Gaps of any size
+        uint16_t base = static_cast<uint16_t>(0x6400 + i / 50);
+        samples.push_back({timestamp, base, static_cast<uint16_t>(base ^ (rng() & 0x7)), static_cast<uint16_t>(rng())});
+    }
+    std::vector<uint8_t> data = chunk::encode(samples.data(), samples.size());
+    EXPECT_LT(data.size(), samples.size() * 6);
+    std::vector<chunk::Sample> decoded;
+    ASSERT_EQ(chunk::decode(data.data(), data.size(), decoded), samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        ASSERT_EQ(decoded[i].timestamp, samples[i].timestamp) << i;
+        ASSERT_EQ(decoded[i].pressure, samples[i].pressure) << i;
+        ASSERT_EQ(decoded[i].temperature, samples[i].temperature) << i;
+        ASSERT_EQ(decoded[i].velocity, samples[i].velocity) << i;
+    }
+    decoded.clear();
+    EXPECT_LT(chunk::decode(data.data(), data.size() / 2, decoded), samples.size());
+    EXPECT_EQ(chunk::decode(data.data(), 1, decoded), 0u);
+}
+
+// Sealing packs old rows into chunks; queries return exactly what they returned before
+TEST_F(DatabaseChunkTest, SealedChunksMergeWithRows) {
+    DatabaseManager db((dir / "chunks.db").string(), "/dev/ttyTEST", config);
+
+    const int64_t t0 = 1700000000;
+    std::vector<FrameJournal::Record> records(10000);
+    for (size_t i = 0; i < records.size(); i++) {
+        records[i].seq = i + 1;
+        records[i].wall_s = t0 + static_cast<int64_t>(i / 1000);
+        records[i].frequency = frequency;
+        records[i].pressure = fp16::fromFloat(1013.0f + std::sin(i * 0.01f));
+        records[i].temperature = fp16::fromFloat(21.5f);
+        records[i].velocity = static_cast<uint16_t>(i);
+    }
+    EXPECT_EQ(db.getGeneration(), 0u);
+    ASSERT_TRUE(db.storeJournalRecords(records));
+    const uint64_t generation = db.getGeneration();
+    EXPECT_GT(generation, 0u);
+    auto before_all = db.getLastNMessages(20000);
+    auto before_range = db.getMessages(t0 + 2, t0 + 3, 1500);
+    auto before_last = db.getLastNMessages(4500);
+
+    EXPECT_EQ(db.sealChunks(t0 + 6, 1024), 6000u);
+    EXPECT_EQ(db.getWriterStats().chunks_sealed, 6u);               // 5 full ones and the rest
+    EXPECT_EQ(db.getGeneration(), generation);                      // Same samples - ETags stay valid
+    auto compare = [](const std::vector<DatabaseManager::SensorData>& a,
+                      const std::vector<DatabaseManager::SensorData>& b) {
+        ASSERT_EQ(a.size(), b.size());
+        for (size_t i = 0; i < a.size(); i++) {
+            ASSERT_EQ(a[i].timestamp, b[i].timestamp) << i;
+            ASSERT_EQ(a[i].velocity, b[i].velocity) << i;
+            ASSERT_EQ(a[i].pressure, b[i].pressure) << i;
+        }
+    };
+    compare(db.getLastNMessages(20000), before_all);
+    compare(db.getMessages(t0 + 2, t0 + 3, 1500), before_range);
+    compare(db.getLastNMessages(4500), before_last);
+}
+
+// Queries running while old seconds are sealed see every sample exactly once - rows and chunks are
+// read in one transaction, on a connection that doesn't see the seal before it commits
+TEST_F(DatabaseChunkTest, QueriesDuringSealingSeeEachSampleOnce) {
+    for (auto period : {PartitionSettings::Period::None, PartitionSettings::Period::Day}) {
+        const std::string db_path = (dir / (period == PartitionSettings::Period::None ? "single.db" : "days.db")).string();
+        DatabaseManager db(db_path, "/dev/ttyTEST", config, DatabaseProfile(), {period, 0});
+        const int64_t t0 = 1700000000;
+        std::vector<FrameJournal::Record> records(20000);
+        for (size_t i = 0; i < records.size(); i++) {
+            records[i].seq = i + 1;
+            records[i].wall_s = t0 + static_cast<int64_t>(i / 500);
+            records[i].frequency = frequency;
+            records[i].velocity = static_cast<uint16_t>(i);
+        }
+        ASSERT_TRUE(db.storeJournalRecords(records));
+
+        std::atomic<bool> sealed{false};
+        std::thread sealer([&] {
+            for (int64_t second = 1; second <= 40; second++) {
+                db.sealChunks(t0 + second, 128);
+            }
+            sealed = true;
+        });
+        int queries = 0;
+        bool once = true;
+        while (!sealed || queries == 0) {
+            auto messages = db.getLastNMessages(30000);
+            std::set<uint16_t> seen;
+            for (const auto& message : messages) seen.insert(message.velocity);
+            once = once && messages.size() == records.size() && seen.size() == records.size();
+            queries++;
+        }
+        sealer.join();
+        EXPECT_TRUE(once) << "period " << static_cast<int>(period) << ", " << queries << " queries";
+        EXPECT_EQ(db.getWriterStats().chunks_sealed, 160u);
+    }
+}
+
+// GET /export bodies: rows and sealed chunks come out in time order, and any byte range equals the
+// same part of the whole body (what a resumed download relies on)
+TEST_F(DatabaseExportTest, RangesMatchWholeBody) {
+    DatabaseManager db((dir / "export.db").string(), "/dev/ttyTEST", config);
+
+    const int64_t t0 = 1700000000;
+    std::vector<FrameJournal::Record> records(10000);
+    for (size_t i = 0; i < records.size(); i++) {
+        records[i].seq = i + 1;
+        records[i].wall_s = t0 + static_cast<int64_t>(i / 1000);
+        records[i].frequency = frequency;
+        records[i].pressure = fp16::fromFloat(static_cast<float>(i % 2000));
+        records[i].velocity = static_cast<uint16_t>(i);
+    }
+    ASSERT_TRUE(db.storeJournalRecords(records));
+    db.sealChunks(t0 + 4, 1500);                                     // Seconds 0 to 3 in chunks
+
+    // Reads [offset, offset + length) the way httplib calls a content provider
+    auto read = [](ExportBody& body, size_t offset, size_t length) {
+        std::string out;
+        httplib::DataSink sink;
+        sink.write = [&](const char* data, size_t size) {
+            out.append(data, size);
+            return true;
+        };
+        while (out.size() < length) {
+            if (!body.read(offset + out.size(), length - out.size(), sink)) break;
+        }
+        return out;
+    };
+
+    ExportBody csv(db.openExport(t0 + 1, t0 + 8), ExportBody::Format::Csv);
+    std::string whole = read(csv, 0, csv.size());
+    ASSERT_EQ(whole.size(), csv.size());
+    EXPECT_EQ(whole.size(), 40u + 8000u * 47u);
+    std::istringstream lines(whole);
+    std::string line;
+    std::getline(lines, line);
+    EXPECT_EQ(line, "timestamp,pressure,temperature,velocity");
+    for (size_t i = 1000; i < 9000; i++) {
+        ASSERT_TRUE(std::getline(lines, line));
+        ASSERT_EQ(std::stoll(line.substr(0, 10)), t0 + static_cast<int64_t>(i / 1000)) << line;
+        ASSERT_EQ(std::stof(line.substr(11, 11)), static_cast<float>(i % 2000)) << line;
+    }
+    for (auto [offset, length] : {std::pair<size_t, size_t>{5000000 % whole.size(), 1000}, {17, 200000},
+                                  {whole.size() - 3, 3}, {3, 5}}) {
+        ExportBody resumed(db.openExport(t0 + 1, t0 + 8), ExportBody::Format::Csv);
+        EXPECT_EQ(read(resumed, offset, length), whole.substr(offset, length)) << offset;
+    }
+
+    ExportBody binary(db.openExport(t0 + 1, t0 + 8), ExportBody::Format::Binary);
+    std::string data = read(binary, 0, binary.size());
+    ASSERT_EQ(data.size(), 32u + 8000u * 14u);
+    uint32_t block;
+    uint64_t count;
+    std::memcpy(&block, &data[4], sizeof(block));
+    std::memcpy(&count, &data[8], sizeof(count));
+    EXPECT_EQ(data.substr(0, 4), "SDX1");
+    EXPECT_EQ(count, 8000u);
+    for (size_t i = 0, offset = 32; i < count; i += block) {
+        size_t n = std::min<size_t>(block, count - i);
+        for (size_t j = 0; j < n; j++) {
+            uint16_t velocity;
+            std::memcpy(&velocity, &data[offset + n * 8 + 2 * n * 2 + j * 2], sizeof(velocity));
+            ASSERT_EQ(velocity, 1000 + i + j);
+        }
+        offset += n * 14;
+    }
+
+    // The range ends at the newest sample - one arriving later is outside of it and leaves the
+    // version alone, while an open range picks it up
+    auto open = db.openExport(t0 + 5, t0 + 100);
+    EXPECT_EQ(open->to(), t0 + 9);
+    const std::string closed_version = db.openExport(t0 + 1, t0 + 8)->version();
+    const std::string open_version = open->version();
+    std::vector<FrameJournal::Record> later(1, records.back());
+    later[0].seq = records.size() + 1;
+    later[0].wall_s = t0 + 10;
+    ASSERT_TRUE(db.storeJournalRecords(later));
+    EXPECT_EQ(db.openExport(t0 + 1, t0 + 8)->version(), closed_version);
+    EXPECT_EQ(db.openExport(t0 + 5, t0 + 100)->to(), t0 + 10);
+    EXPECT_NE(db.openExport(t0 + 5, t0 + 100)->version(), open_version);
+    EXPECT_EQ(db.openExport(t0 + 1, t0 + 2)->to(), t0 + 2);         // Cut inside a chunk
+}
+
+// Chunks compressed in parallel still make a single gzip member any decoder reads; q=0 refuses gzip
+TEST(CompressionTest, ParallelChunksFormOneGzipStream) {
+    std::string text;
+    std::mt19937 rng(7);
+    while (text.size() < 3 * 1024 * 1024 + 123) {
+        text += std::to_string(1700000000 + text.size() / 4700) + "," + std::to_string(rng() % 100000) + ",21.5\n";
+    }
+    for (size_t threads : {1, 4}) {
+        std::string data = compression::gzip(text.data(), text.size(), 6, 64 * 1024, threads);
+        std::string inflated;
+        ASSERT_TRUE(gunzip(data, inflated)) << threads;
+        EXPECT_EQ(inflated, text);
+        EXPECT_LT(data.size(), text.size() / 2);
+    }
+    std::string empty;
+    ASSERT_TRUE(gunzip(compression::gzip("", 0, 6, 1024, 2), empty));
+    EXPECT_TRUE(empty.empty());
+
+    EXPECT_TRUE(compression::acceptsGzip("gzip, deflate, br"));
+    EXPECT_TRUE(compression::acceptsGzip("*"));
+    EXPECT_TRUE(compression::acceptsGzip("deflate, GZIP;q=0.5"));
+    EXPECT_FALSE(compression::acceptsGzip(""));
+    EXPECT_FALSE(compression::acceptsGzip("identity"));
+    EXPECT_FALSE(compression::acceptsGzip("gzip;q=0, *"));
+    EXPECT_FALSE(compression::acceptsGzip("*;q=0"));
+}
+
+// Quantiles stay within the relative accuracy, and merged sketches are the sketch of all values
+TEST(SketchTest, QuantilesAndMerge) {
+    std::mt19937 rng(11);
+    std::lognormal_distribution<double> distribution(3.0, 1.5);
+    std::vector<double> values;
+    sketch::Summary all(0.01), first(0.01), second(0.01);
+    for (int i = 0; i < 20000; i++) {
+        double value = i % 10 == 0 ? -distribution(rng) : distribution(rng);
+        values.push_back(value);
+        all.add(value);
+        (i % 3 ? first : second).add(value);
+    }
+    first.merge(second);
+    std::sort(values.begin(), values.end());
+    for (double q : {0.0, 0.01, 0.1, 0.25, 0.5, 0.9, 0.99, 0.999}) {
+        double exact = values[static_cast<size_t>(q * (values.size() - 1))];
+        EXPECT_NEAR(all.quantiles.quantile(q), exact, std::abs(exact) * 0.01) << q;
+        EXPECT_EQ(first.quantiles.quantile(q), all.quantiles.quantile(q)) << q;
+    }
+    EXPECT_EQ(first.moments.count, all.moments.count);
+    EXPECT_NEAR(first.moments.mean, all.moments.mean, 1e-9 * std::abs(all.moments.mean));
+    EXPECT_NEAR(first.moments.variance(), all.moments.variance(), 1e-9 * all.moments.variance());
+    EXPECT_EQ(first.moments.min, values.front());
+    EXPECT_EQ(first.moments.max, values.back());
+
+    // Two hours of minutes: the first hour is dropped from them, the hour buckets still cover it
+    sketch::TimeWindows windows(60, 24, 0.01);
+    for (int64_t t = 0; t < 2 * 3600; t += 10) windows.add(t, 1.0, static_cast<double>(t), 0.0);
+    EXPECT_EQ(windows.oldest(), 0);
+    auto whole = windows.query(0, 2 * 3600);
+    EXPECT_EQ(whole.from, 0);
+    EXPECT_EQ(whole.to, 2 * 3600 - 1);
+    EXPECT_EQ(whole.fields[1].moments.count, 720u);
+    auto minutes = windows.query(3650, 3725);
+    EXPECT_EQ(minutes.from, 3600);
+    EXPECT_EQ(minutes.to, 3779);
+    EXPECT_EQ(minutes.fields[1].moments.count, 18u);
+}
+
+// fp16 overflow decodes to inf: such values are counted, and neither crash the sketch nor poison
+// the moments and quantiles of the finite ones
+TEST(SketchTest, NonFiniteValuesAreCounted) {
+    sketch::Summary summary(0.01);
+    for (int i = 1; i <= 100; i++) summary.add(i);
+    summary.add(std::numeric_limits<double>::infinity());
+    summary.add(-std::numeric_limits<double>::infinity());
+    summary.add(std::numeric_limits<double>::quiet_NaN());
+    summary.add(fp16::toFloat(0x7C00));                     // +inf half
+    summary.add(1e15);                                      // Finite, but beyond max_indexable
+    EXPECT_EQ(summary.non_finite, 4u);
+    EXPECT_EQ(summary.moments.count, 101u);
+    EXPECT_TRUE(std::isfinite(summary.moments.mean));
+    EXPECT_TRUE(std::isfinite(summary.moments.variance()));
+    EXPECT_EQ(summary.quantiles.count(), 101u);
+    EXPECT_NEAR(summary.quantiles.quantile(0.5), 51.0, 51.0 * 0.01);
+    EXPECT_TRUE(std::isfinite(summary.quantiles.quantile(1.0)));
+    EXPECT_LT(summary.quantiles.memoryBytes(), 64u * 1024);
+
+    sketch::TimeWindows windows(60, 24, 0.01);
+    windows.add(0, std::numeric_limits<double>::infinity(), 20.0, std::numeric_limits<double>::quiet_NaN());
+    windows.add(1, 1013.0, 21.0, 1.0);
+    auto result = windows.query(0, 59);
+    EXPECT_EQ(result.fields[0].moments.count, 1u);
+    EXPECT_EQ(result.fields[0].non_finite, 1u);
+    EXPECT_EQ(result.fields[0].moments.mean, 1013.0);
+    EXPECT_EQ(result.fields[2].non_finite, 1u);
+    EXPECT_EQ(result.fields[1].moments.count, 2u);
+}
+
+// Hysteresis keeps a value hovering at the threshold from raising the rule again; rates are taken
+// per window. The ring keeps the last events
+TEST(AlertEngineTest, HysteresisRatesAndRing) {
+    std::vector<alerts::Rule> rules = parseAlertRules(nlohmann::json::parse(R"([
+        {"name": "hot", "channel": "temperature", "op": ">", "threshold": 30, "hysteresis": 2},
+        {"name": "falling", "channel": "pressure", "type": "rate", "op": "<", "threshold": -10, "window_ms": 1000}
+    ])"));
+    alerts::Engine engine(rules, 4);
+    const int64_t ms = 1000000;
+    int64_t t = 0;
+    for (float temperature : {29.0f, 31.0f, 29.5f, 30.5f, 27.5f, 31.0f}) {
+        engine.evaluate(t, t / ms, 1000.0f, temperature, 0.0f);
+        t += 100 * ms;
+    }
+    auto events = engine.eventsAfter(0, 100);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_TRUE(events[0].raised);
+    EXPECT_EQ(events[0].value, 31.0);
+    EXPECT_EQ(events[0].wall_ms, 100);
+    EXPECT_FALSE(events[1].raised);
+    EXPECT_EQ(events[1].value, 27.5);
+    EXPECT_TRUE(events[2].raised);
+    EXPECT_TRUE(engine.active(0));
+
+    // -3 / s over the first window, -20 / s over the second; a window only ends after 1 s
+    engine.evaluate(t += 1000 * ms, 0, 995.0f, 31.0f, 0.0f);
+    EXPECT_FALSE(engine.active(1));
+    engine.evaluate(t += 500 * ms, 0, 985.0f, 31.0f, 0.0f);
+    EXPECT_FALSE(engine.active(1));
+    engine.evaluate(t += 500 * ms, 0, 975.0f, 31.0f, 0.0f);
+    EXPECT_TRUE(engine.active(1));
+    EXPECT_DOUBLE_EQ(engine.eventsAfter(3, 1)[0].value, -20.0);
+
+    engine.evaluate(t += 1000 * ms, 0, 975.0f, 20.0f, 0.0f);
+    EXPECT_EQ(engine.getStats().events, 6u);
+    EXPECT_EQ(engine.getStats().overwritten, 2u);
+    EXPECT_EQ(engine.getStats().active, 0u);
+    events = engine.eventsAfter(0, 100);
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events.front().seq, 3u);
+    EXPECT_EQ(events.back().seq, 6u);
+    EXPECT_TRUE(engine.waitForEvents(5, std::chrono::milliseconds(0)));
+    EXPECT_FALSE(engine.waitForEvents(6, std::chrono::milliseconds(10)));
+
+    EXPECT_THROW(parseAlertRules(nlohmann::json::parse(R"([{"name": "x", "channel": "humidity", "threshold": 1}])")),
+                 std::invalid_argument);
+    EXPECT_THROW(parseAlertRules(nlohmann::json::parse(R"([{"name": "x", "channel": "pressure"}])")),
+                 std::invalid_argument);
+}
+
+// One worker, one queue slot: the third connection goes to the 503 thread, once that is a slot behind
+// as well the next one is refused. Queued connections are still served at shutdown
+TEST(RequestQueueTest, FullQueueShedsThenDrops) {
+    HttpQueueStats stats;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<bool> worker_shedding, shedder_shedding;
+    std::atomic<int> served{0};
+    {
+        RequestQueue queue(1, 1, stats);
+        ASSERT_TRUE(queue.enqueue([&] {
+            worker_shedding.set_value(RequestQueue::shedding());
+            released.wait();
+            served++;
+        }));
+        EXPECT_FALSE(worker_shedding.get_future().get());
+        ASSERT_TRUE(queue.enqueue([&] { served++; }));
+        EXPECT_EQ(stats.queued, 1u);
+        ASSERT_TRUE(queue.enqueue([&] {
+            shedder_shedding.set_value(RequestQueue::shedding());
+            released.wait();
+        }));
+        EXPECT_TRUE(shedder_shedding.get_future().get());
+        ASSERT_TRUE(queue.enqueue([] {}));
+        EXPECT_FALSE(queue.enqueue([] {}));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        release.set_value();
+        queue.shutdown();
+    }
+    EXPECT_EQ(served, 2);
+    EXPECT_EQ(stats.connections, 2u);
+    EXPECT_EQ(stats.shed, 2u);
+    EXPECT_EQ(stats.dropped, 1u);
+    EXPECT_EQ(stats.queued, 0u);
+    EXPECT_EQ(stats.busy, 0u);
+    EXPECT_GE(stats.max_wait_us, 20000);
+}
+
+// The vectorised conversions give the same bits as the scalar reference
+TEST(Fp16Test, BatchConversionMatchesScalar) {
+    std::vector<uint16_t> halves(65536);
+    for (size_t i = 0; i < halves.size(); i++) halves[i] = static_cast<uint16_t>(i);
+    std::vector<float> floats(halves.size());
+    fp16::toFloat(halves.data(), floats.data(), halves.size());
+    for (size_t i = 0; i < halves.size(); i++) {
+        float expected = fp16::toFloatScalar(halves[i]);
+        ASSERT_EQ(std::memcmp(&floats[i], &expected, sizeof(float)), 0) << "half 0x" << std::hex << i;
+    }
+
+    // Every half round trips, plus random floats incl. the subnormal, overflow and rounding ranges
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<uint32_t> bits;
+    for (int i = 0; i < 200000; i++) {
+        uint32_t x = bits(rng);
+        float value;
+        std::memcpy(&value, &x, sizeof(value));
+        floats.push_back(value);
+    }
+    std::vector<uint16_t> converted(floats.size());
+    fp16::fromFloat(floats.data(), converted.data(), floats.size());
+    for (size_t i = 0; i < floats.size(); i++) {
+        ASSERT_EQ(converted[i], fp16::fromFloatScalar(floats[i])) << "float " << floats[i] << " (" << i << ")";
+        ASSERT_EQ(converted[i], fp16::fromFloat(floats[i]));
+        if (i < 65536 && (halves[i] & 0x7C00) != 0x7C00) {
+            ASSERT_EQ(converted[i], halves[i]);
+        }
+    }
+    EXPECT_EQ(fp16::fromFloat(1.0f), 0x3C00);
+    EXPECT_EQ(fp16::fromFloat(65519.0f), 0x7BFF);   // Rounds down to the largest half
+    EXPECT_EQ(fp16::fromFloat(65520.0f), 0x7C00);   // Rounds up to infinity
+    EXPECT_EQ(fp16::toFloat(0x0001), std::ldexp(1.0f, -24));
+}
+
+// Readers racing a writer always see a frequency / debug pair that was published together,
+// and versions never go backwards
+TEST(ConfigStoreTest, SnapshotsAreNeverTorn) {
+    ConfigStore store(DeviceConfig{2, false});
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> torn{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; i++) {
+        readers.emplace_back([&] {
+            uint32_t last_version = 0;
+            while (!done) {
+                DeviceConfig config = store.load();
+                if (config.debug != (config.frequency % 2 == 1) || config.version < last_version) torn++;
+                last_version = config.version;
+            }
+        });
+    }
+    for (int i = 1; i <= 100000; i++) {
+        uint8_t frequency = static_cast<uint8_t>(i % 255 + 1);
+        store.publish(frequency, frequency % 2 == 1);
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    EXPECT_EQ(torn.load(), 0u);
+    EXPECT_EQ(store.load().version, 100000u);
+}
+
+// Spans land in the ring of their thread, oldest first; a full ring keeps the newest and counts the rest
+TEST(TraceTest, PerThreadRings) {
+    trace::collect(true);
+    { trace::Span span("disabled", "test"); }
+    for (const auto& trace : trace::collect(false)) EXPECT_TRUE(trace.events.empty()) << trace.name;
+
+    // Collecting with clear drains the rings - the span comes out once, the ring of this (running)
+    // thread stays
+    trace::setEnabled(true);
+    { trace::Span span("drained", "test"); }
+    trace::setEnabled(false);
+    size_t drained = 0;
+    for (const auto& trace : trace::collect(true)) {
+        for (const auto& event : trace.events) drained += std::string(event.name) == "drained";
+    }
+    EXPECT_EQ(drained, 1u);
+    auto empty = trace::collect(true);
+    EXPECT_FALSE(empty.empty());
+    for (const auto& trace : empty) {
+        EXPECT_TRUE(trace.events.empty()) << trace.name;
+        EXPECT_EQ(trace.overwritten, 0u) << trace.name;
+    }
+
+    trace::setCapacity(8);
+    trace::setEnabled(true);
+    std::thread worker([] {
+        trace::setThreadName("test worker");
+        for (int i = 0; i < 20; i++) {
+            trace::Span span("step", "test");
+            span.arg("i", i);
+        }
+    });
+    worker.join();
+    trace::setEnabled(false);
+    trace::setCapacity(4096);
+
+    auto traces = trace::collect(true);
+    auto it = std::find_if(traces.begin(), traces.end(), [](const trace::ThreadTrace& t) {
+        return t.name == "test worker";
+    });
+    ASSERT_NE(it, traces.end());
+    EXPECT_TRUE(it->exited);
+    EXPECT_EQ(it->overwritten, 12u);
+    ASSERT_EQ(it->events.size(), 8u);
+    EXPECT_EQ(it->events.front().arg, 12);
+    EXPECT_EQ(it->events.back().arg, 19);
+    EXPECT_STREQ(it->events.back().arg_name, "i");
+    EXPECT_GE(it->events.back().start_ns, it->events.front().start_ns);
+
+    auto json = traceToJson(traces);
+    EXPECT_EQ(json["otherData"]["overwritten"], 12);
+    // Exited threads are gone once collected with clear
+    for (const auto& trace : trace::collect(false)) EXPECT_NE(trace.name, "test worker");
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,236 @@
+#include "sketch.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace sketch {
+
+namespace {
+
+int64_t floorDiv(int64_t value, int64_t divisor) {
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+
+} // namespace
+
+void Moments::add(double value) {
+    if (!std::isfinite(value)) return;           // One inf / NaN would poison mean and m2 for good
+    count++;
+    double delta = value - mean;
+    mean += delta / static_cast<double>(count);
+    m2 += delta * (value - mean);
+    min = std::min(min, value);
+    max = std::max(max, value);
+}
+
+void Moments::merge(const Moments& other) {
+    if (other.count == 0) return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    const double n = static_cast<double>(count + other.count);
+    const double delta = other.mean - mean;
+    mean += delta * static_cast<double>(other.count) / n;
+    m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / n;
+    count += other.count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+double Moments::variance() const {
+    return count > 0 ? m2 / static_cast<double>(count) : 0.0;
+}
+
+DDSketch::DDSketch(double alpha)
+    : alpha_(alpha), gamma_((1 + alpha) / (1 - alpha)), log_gamma_(std::log(gamma_)) {}
+
+int DDSketch::key(double magnitude) const {
+    return static_cast<int>(std::ceil(std::log(std::min(magnitude, max_indexable)) / log_gamma_));
+}
+
+double DDSketch::value(int key) const {
+    return 2 * std::pow(gamma_, key) / (gamma_ + 1);
+}
+
+void DDSketch::Store::add(int key, uint64_t count) {
+    key = std::clamp(key, -max_key, max_key);
+    if (counts.empty()) {
+        offset = key;
+        counts.push_back(0);
+    } else if (key < offset) {
+        counts.insert(counts.begin(), static_cast<size_t>(offset - key), 0);
+        offset = key;
+    } else if (key >= offset + static_cast<int>(counts.size())) {
+        counts.resize(static_cast<size_t>(key - offset) + 1, 0);
+    }
+    counts[static_cast<size_t>(key - offset)] += count;
+}
+
+void DDSketch::add(double value) {
+    if (!std::isfinite(value)) return;
+    count_++;
+    if (value > min_indexable) {
+        positive_.add(key(value), 1);
+    } else if (value < -min_indexable) {
+        negative_.add(key(-value), 1);
+    } else {
+        zero_++;
+    }
+}
+
+void DDSketch::merge(const DDSketch& other) {
+    for (size_t i = 0; i < other.positive_.counts.size(); i++) {
+        if (other.positive_.counts[i]) positive_.add(other.positive_.offset + static_cast<int>(i), other.positive_.counts[i]);
+    }
+    for (size_t i = 0; i < other.negative_.counts.size(); i++) {
+        if (other.negative_.counts[i]) negative_.add(other.negative_.offset + static_cast<int>(i), other.negative_.counts[i]);
+    }
+    zero_ += other.zero_;
+    count_ += other.count_;
+}
+
+uint64_t DDSketch::count() const { return count_; }
+
+double DDSketch::quantile(double q) const {
+    if (count_ == 0) return std::numeric_limits<double>::quiet_NaN();
+    const double rank = std::clamp(q, 0.0, 1.0) * static_cast<double>(count_ - 1);
+    uint64_t seen = 0;
+    // Smallest values first: large negative magnitudes, zero, then the positive side
+    for (size_t i = negative_.counts.size(); i-- > 0;) {
+        seen += negative_.counts[i];
+        if (static_cast<double>(seen) > rank) return -value(negative_.offset + static_cast<int>(i));
+    }
+    seen += zero_;
+    if (static_cast<double>(seen) > rank) return 0.0;
+    for (size_t i = 0; i < positive_.counts.size(); i++) {
+        seen += positive_.counts[i];
+        if (static_cast<double>(seen) > rank) return value(positive_.offset + static_cast<int>(i));
+    }
+    return value(positive_.offset + static_cast<int>(positive_.counts.size()) - 1);
+}
+
+std::vector<DDSketch::Bucket> DDSketch::buckets() const {
+    std::vector<Bucket> result;
+    for (size_t i = negative_.counts.size(); i-- > 0;) {
+        if (!negative_.counts[i]) continue;
+        int k = negative_.offset + static_cast<int>(i);
+        result.push_back({-std::pow(gamma_, k), -std::pow(gamma_, k - 1), negative_.counts[i]});
+    }
+    if (zero_) {
+        result.push_back({0.0, 0.0, zero_});
+    }
+    for (size_t i = 0; i < positive_.counts.size(); i++) {
+        if (!positive_.counts[i]) continue;
+        int k = positive_.offset + static_cast<int>(i);
+        result.push_back({std::pow(gamma_, k - 1), std::pow(gamma_, k), positive_.counts[i]});
+    }
+    return result;
+}
+
+size_t DDSketch::memoryBytes() const {
+    return sizeof(*this) + (positive_.counts.capacity() + negative_.counts.capacity()) * sizeof(uint64_t);
+}
+
+void Summary::add(double value) {
+    if (!std::isfinite(value)) {
+        non_finite++;
+        return;
+    }
+    moments.add(value);
+    quantiles.add(value);
+}
+
+void Summary::merge(const Summary& other) {
+    non_finite += other.non_finite;
+    moments.merge(other.moments);
+    quantiles.merge(other.quantiles);
+}
+
+TimeWindows::TimeWindows(size_t minutes, size_t hours, double alpha)
+    : minutes_(std::max<size_t>(minutes, 60)), hours_(std::max<size_t>(hours, 1)), alpha_(alpha) {}
+
+TimeWindows::Bucket& TimeWindows::bucket(std::map<int64_t, Bucket>& buckets, int64_t key) {
+    auto it = buckets.find(key);
+    if (it == buckets.end()) {
+        it = buckets.emplace(key, Bucket{std::vector<Summary>(3, Summary(alpha_))}).first;
+    }
+    return it->second;
+}
+
+void TimeWindows::add(int64_t timestamp, double pressure, double temperature, double velocity) {
+    const double values[3] = {pressure, temperature, velocity};
+    const int64_t minute = floorDiv(timestamp, 60);
+    const int64_t hour = floorDiv(timestamp, 3600);
+    if (minute >= minute_horizon_) {
+        auto& fields = bucket(by_minute_, minute).fields;
+        for (int i = 0; i < 3; i++) fields[i].add(values[i]);
+    }
+    if (hour >= hour_horizon_) {
+        auto& fields = bucket(by_hour_, hour).fields;
+        for (int i = 0; i < 3; i++) fields[i].add(values[i]);
+    }
+
+    // Minutes go an hour at a time - what's before the oldest minute is always whole hours
+    while (!by_minute_.empty() &&
+           by_minute_.rbegin()->first - by_minute_.begin()->first >= static_cast<int64_t>(minutes_)) {
+        const int64_t hour_end = (floorDiv(by_minute_.begin()->first, 60) + 1) * 60;
+        by_minute_.erase(by_minute_.begin(), by_minute_.lower_bound(hour_end));
+        minute_horizon_ = hour_end;
+    }
+    while (!by_hour_.empty() &&
+           by_hour_.rbegin()->first - by_hour_.begin()->first >= static_cast<int64_t>(hours_)) {
+        hour_horizon_ = by_hour_.begin()->first + 1;
+        by_hour_.erase(by_hour_.begin());
+    }
+}
+
+TimeWindows::Result TimeWindows::query(int64_t from, int64_t to) const {
+    Result result;
+    result.fields.assign(3, Summary(alpha_));
+    int64_t covered_from = std::numeric_limits<int64_t>::max();
+    int64_t covered_to = std::numeric_limits<int64_t>::min();
+    auto merge = [&](const Bucket& bucket, int64_t start, int64_t length) {
+        for (int i = 0; i < 3; i++) result.fields[i].merge(bucket.fields[i]);
+        covered_from = std::min(covered_from, start);
+        covered_to = std::max(covered_to, start + length - 1);
+    };
+
+    const int64_t first_minute = floorDiv(from, 60);
+    const int64_t last_minute = floorDiv(to, 60);
+    for (auto it = by_minute_.lower_bound(std::max(first_minute, minute_horizon_));
+         it != by_minute_.end() && it->first <= last_minute; ++it) {
+        merge(it->second, it->first * 60, 60);
+    }
+    // Before the minutes: hours that ended before the oldest minute
+    if (minute_horizon_ != std::numeric_limits<int64_t>::min() && first_minute < minute_horizon_) {
+        const int64_t last_hour = std::min(floorDiv(to, 3600), minute_horizon_ / 60 - 1);
+        for (auto it = by_hour_.lower_bound(floorDiv(from, 3600)); it != by_hour_.end() && it->first <= last_hour; ++it) {
+            merge(it->second, it->first * 3600, 3600);
+        }
+    }
+    if (covered_from <= covered_to) {
+        result.from = covered_from;
+        result.to = covered_to;
+    }
+    return result;
+}
+
+int64_t TimeWindows::oldest() const {
+    if (!by_hour_.empty()) return by_hour_.begin()->first * 3600;
+    return by_minute_.empty() ? 0 : by_minute_.begin()->first * 60;
+}
+
+size_t TimeWindows::memoryBytes() const {
+    size_t bytes = sizeof(*this);
+    for (const auto* buckets : {&by_minute_, &by_hour_}) {
+        for (const auto& [key, bucket] : *buckets) {
+            bytes += sizeof(key) + sizeof(bucket) + 32;      // Plus the map node
+            for (const auto& field : bucket.fields) {
+                bytes += sizeof(field.moments) + field.quantiles.memoryBytes();
+            }
+        }
+    }
+    return bytes;
+}
+
+} // namespace sketch
@@ -0,0 +1,117 @@
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <vector>
+
+// Mergeable summaries of a stream of values, for GET /stats:
+//   Moments  - count, mean, variance (Welford), min, max; merged with Chan et al.'s formula
+//   DDSketch - quantiles with a relative error of at most alpha (Masson et al., VLDB 2019). Value x
+//              goes to bucket ceil(log_gamma(|x|)), gamma = (1 + alpha) / (1 - alpha); merging adds
+//              the bucket counts, so a merged sketch is exactly the sketch of all values
+// Sensor values are fp16, so the key range is bounded (~1300 buckets per sign for alpha = 1%) and
+// buckets are never collapsed. Infinite and NaN values (fp16 overflow, e.g. a pressure in Pa) are
+// counted by Summary and left out of everything else; magnitudes above max_indexable go to its bucket.
+namespace sketch {
+
+struct Moments {
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;                                   // Sum of squared differences from the mean
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void add(double value);
+    void merge(const Moments& other);
+    double variance() const;                         // Population variance, 0 if empty
+};
+
+class DDSketch {
+public:
+    struct Bucket {
+        double lower;
+        double upper;
+        uint64_t count;
+    };
+
+    explicit DDSketch(double alpha = 0.01);
+    void add(double value);
+    void merge(const DDSketch& other);               // Same alpha
+    uint64_t count() const;
+    double quantile(double q) const;                 // q in [0, 1]; NaN if empty
+    std::vector<Bucket> buckets() const;             // Ascending, non-empty ones only. Zero is [0, 0]
+    size_t memoryBytes() const;
+
+private:
+    // Counts of consecutive keys from `offset` on
+    struct Store {
+        static constexpr int max_key = 1 << 16;      // Keys are clamped to [-max_key, max_key]
+        int offset = 0;
+        std::vector<uint64_t> counts;
+        void add(int key, uint64_t count);
+    };
+
+    double alpha_;
+    double gamma_;
+    double log_gamma_;
+    Store positive_;
+    Store negative_;                                 // Keyed by |x|
+    uint64_t zero_ = 0;                              // |x| below min_indexable
+    uint64_t count_ = 0;
+
+    static constexpr double min_indexable = 1e-9;
+    static constexpr double max_indexable = 1e12;
+    int key(double magnitude) const;
+    double value(int key) const;                     // Inside the bucket, within alpha of all of it
+};
+
+// Moments and quantiles of one field
+struct Summary {
+    Moments moments;
+    DDSketch quantiles;
+    uint64_t non_finite = 0;                         // inf / NaN values, in neither of the above
+
+    explicit Summary(double alpha = 0.01) : quantiles(alpha) {}
+    void add(double value);
+    void merge(const Summary& other);
+};
+
+// Summaries of the three sensor fields per minute for the last `minutes` minutes of data, and per hour
+// for the last `hours` hours. Minutes are dropped in whole hours, so everything before the oldest
+// minute is covered by whole hours. The newest sample sets the horizon, not the clock
+class TimeWindows {
+public:
+    struct Result {
+        int64_t from = 0;                            // Covered range - the query rounded out to the buckets
+        int64_t to = 0;
+        std::vector<Summary> fields;                 // Pressure, temperature, velocity
+    };
+
+    TimeWindows(size_t minutes, size_t hours, double alpha);
+    void add(int64_t timestamp, double pressure, double temperature, double velocity);
+    Result query(int64_t from, int64_t to) const;    // Merges the buckets overlapping [from, to]
+    int64_t oldest() const;                          // First second covered, 0 if nothing yet
+    size_t memoryBytes() const;
+
+private:
+    struct Bucket {
+        std::vector<Summary> fields;
+    };
+
+    size_t minutes_;
+    size_t hours_;
+    double alpha_;
+    std::map<int64_t, Bucket> by_minute_;            // timestamp / 60 -> summaries
+    std::map<int64_t, Bucket> by_hour_;              // timestamp / 3600 -> summaries
+    int64_t minute_horizon_ = std::numeric_limits<int64_t>::min();  // Minutes before it were dropped
+    int64_t hour_horizon_ = std::numeric_limits<int64_t>::min();
+
+    Bucket& bucket(std::map<int64_t, Bucket>& buckets, int64_t key);
+};
+
+} // namespace sketch
+
+#endif // SKETCH_HPP
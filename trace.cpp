@@ -0,0 +1,153 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace trace {
+
+std::atomic<bool> enabled_flag{false};
+
+namespace {
+
+struct Ring {
+    std::mutex mutex;                                // Taken by the owner per span, by collect() while copying
+    std::vector<Event> events;                       // Span n goes to events[n % size]
+    uint64_t recorded = 0;
+    uint64_t collected = 0;                          // Spans before it were cleared
+    int tid = 0;
+    std::string name;
+    bool exited = false;
+};
+
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<Ring>> rings;            // Oldest first
+std::atomic<size_t> ring_capacity{4096};
+constexpr size_t max_exited = 16;                    // Rings of exited threads kept until they are collected
+
+// The ring is only created by the first span of the thread - a thread that never records while
+// tracing is enabled costs nothing. Marked exited when the thread ends
+struct LocalRing {
+    std::shared_ptr<Ring> ring;
+    const char* name = nullptr;
+    ~LocalRing() {
+        if (ring) {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            ring->exited = true;
+        }
+    }
+};
+thread_local LocalRing local;
+
+Ring& localRing() {
+    if (local.ring) {
+        return *local.ring;
+    }
+    auto ring = std::make_shared<Ring>();
+    ring->events.resize(std::max<size_t>(ring_capacity.load(), 1));
+    ring->tid = static_cast<int>(syscall(SYS_gettid));
+    ring->name = local.name ? local.name : "thread " + std::to_string(ring->tid);
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    // Short-lived threads would pile up - keep the newest exited rings only
+    size_t exited = 0;
+    for (auto it = rings.rbegin(); it != rings.rend();) {
+        bool drop;
+        {
+            std::lock_guard<std::mutex> ring_lock((*it)->mutex);
+            drop = (*it)->exited && ++exited > max_exited;
+        }
+        it = drop ? std::make_reverse_iterator(rings.erase(std::next(it).base())) : std::next(it);
+    }
+    rings.push_back(ring);
+    local.ring = std::move(ring);
+    return *local.ring;
+}
+
+std::vector<std::shared_ptr<Ring>> allRings() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    return rings;
+}
+
+} // namespace
+
+void setEnabled(bool enabled) {
+    enabled_flag.store(enabled, std::memory_order_relaxed);
+}
+
+void setCapacity(size_t capacity) {
+    ring_capacity.store(std::max<size_t>(capacity, 1));
+}
+
+void setThreadName(const char* name) {
+    local.name = name;
+    if (local.ring) {
+        std::lock_guard<std::mutex> lock(local.ring->mutex);
+        local.ring->name = name;
+    }
+}
+
+void record(const char* name, const char* category, int64_t start_ns, const char* arg_name, int64_t arg) {
+    const int64_t end_ns = now();
+    Ring& ring = localRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    Event& event = ring.events[ring.recorded % ring.events.size()];
+    const size_t length = strnlen(name, sizeof(event.name) - 1);
+    std::memcpy(event.name, name, length);
+    event.name[length] = '\0';
+    event.category = category;
+    event.arg_name = arg_name;
+    event.arg = arg;
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    ring.recorded++;
+}
+
+std::vector<ThreadTrace> collect(bool clear) {
+    std::vector<ThreadTrace> traces;
+    for (const auto& ring : allRings()) {
+        ThreadTrace trace;
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            const uint64_t size = ring->events.size();
+            const uint64_t first = std::max(ring->collected, ring->recorded > size ? ring->recorded - size : 0);
+            trace.tid = ring->tid;
+            trace.name = ring->name;
+            trace.exited = ring->exited;
+            trace.overwritten = first - ring->collected;
+            trace.events.reserve(ring->recorded - first);
+            for (uint64_t n = first; n < ring->recorded; n++) {
+                trace.events.push_back(ring->events[n % size]);
+            }
+            if (clear) {
+                ring->collected = ring->recorded;
+            }
+        }
+        traces.push_back(std::move(trace));
+    }
+    if (clear) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+            std::lock_guard<std::mutex> ring_lock(ring->mutex);
+            return ring->exited;
+        }), rings.end());
+    }
+    return traces;
+}
+
+Stats getStats() {
+    Stats stats;
+    stats.enabled = enabled();
+    stats.capacity = ring_capacity.load();
+    for (const auto& ring : allRings()) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        stats.threads++;
+        stats.recorded += ring->recorded;
+        stats.overwritten += ring->recorded > ring->events.size() ? ring->recorded - ring->events.size() : 0;
+    }
+    return stats;
+}
+
+} // namespace trace
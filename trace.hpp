@@ -0,0 +1,87 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Spans of the HTTP handlers, the command path, the serial reader and the journal writer, for
+// GET /debug/trace in the Chrome trace-event format (chrome://tracing, ui.perfetto.dev).
+// Every thread records into its own ring of the last `capacity` spans, so threads never wait for
+// each other - a ring's lock is only contended while collect() copies it. Disabled, a Span is one
+// relaxed atomic load and nothing is recorded
+namespace trace {
+
+struct Event {
+    char name[48];                                   // Copied, cut to 47 characters
+    const char* category = "";                       // String literal
+    const char* arg_name = nullptr;                  // String literal, nullptr if there is no argument
+    int64_t arg = 0;
+    int64_t start_ns = 0;                            // steady_clock
+    int64_t duration_ns = 0;
+};
+
+// Spans of one thread, oldest first
+struct ThreadTrace {
+    int tid = 0;                                     // Kernel thread id, as in top or perf
+    std::string name;
+    bool exited = false;
+    uint64_t overwritten = 0;                        // Spans no longer in the ring
+    std::vector<Event> events;
+};
+
+struct Stats {
+    bool enabled = false;
+    size_t capacity = 0;
+    size_t threads = 0;                              // With a ring
+    uint64_t recorded = 0;
+    uint64_t overwritten = 0;
+};
+
+extern std::atomic<bool> enabled_flag;
+
+inline bool enabled() { return enabled_flag.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+void setCapacity(size_t capacity);                   // Spans per thread, for rings created from now on
+void setThreadName(const char* name);                // Of the calling thread, shown in the trace
+
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A span of the calling thread that started at start_ns and ends now
+void record(const char* name, const char* category, int64_t start_ns,
+            const char* arg_name = nullptr, int64_t arg = 0);
+
+// Copies every ring. Rings of threads that exited are dropped once collected with clear
+std::vector<ThreadTrace> collect(bool clear);
+Stats getStats();
+
+// Records from construction to destruction if tracing was enabled at construction
+class Span {
+public:
+    Span(const char* name, const char* category)
+        : name_(name), category_(category), start_ns_(enabled() ? now() : 0) {}
+    ~Span() {
+        if (start_ns_ != 0) record(name_, category_, start_ns_, arg_name_, arg_);
+    }
+    void arg(const char* name, int64_t value) { arg_name_ = name; arg_ = value; }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name_;
+    const char* category_;
+    int64_t start_ns_;
+    const char* arg_name_ = nullptr;
+    int64_t arg_ = 0;
+};
+
+} // namespace trace
+
+#endif // TRACE_HPP